@@ -1,8 +1,13 @@
 #include "common/socket.h"
+#include "common/conn.h"
 #include "common/protocol.h"
+#include "common/sim_config.h"
+#include "common/state_codec.h"
+#include "common/shm_state.h"
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <inttypes.h>
 #include <string.h>
 #include <sys/socket.h>
 #include <unistd.h>
@@ -19,21 +24,34 @@
 //Prints the reason of a fatal failure and exits the client immediately. Used when continuing would leave the client in a broken state.
 static void die(const char *msg) { perror(msg); exit(1); }
 
-//Reads and discards a payload of len bytes so the client stays in sync with the message stream when it receives an unexpected message.
-static void skip_payload(int fd, uint16_t len) {
-    char tmp[1024];
-    uint16_t remaining = len;
-    while (remaining > 0) {
-        uint16_t chunk = remaining > sizeof(tmp) ? sizeof(tmp) : remaining;
-        if (rw_recv_all(fd, tmp, chunk) < 0) return;
-        remaining -= chunk;
-    }
+#define CLIENT_CONN_BYTES (RW_MSG_HDR_SIZE + UINT16_MAX)   // buffer sizes: any frame fits whole
+#define SHM_POLL_MS 20                                     // --shm: how often the shared state is checked
+#define RESUME_ATTEMPTS 5                                  // reconnects tried after the connection drops
+#define RESUME_FIRST_WAIT_MS 250                           // pause before the first one, doubled for each next
+
+// Part of the grid the client draws (--viewport); w or h 0 means up to the edge of the grid.
+typedef struct {
+    uint32_t x, y, w, h;
+} grid_rect_t;
+
+//Clips a viewport to the grid of st: cells [*x0, *x1) x [*y0, *y1) are drawn. A NULL viewport is the whole grid.
+static void clip_rect(const rw_state_msg_t *st, const grid_rect_t *vp, uint32_t *x0, uint32_t *y0, uint32_t *x1, uint32_t *y1) {
+    *x0 = *y0 = 0;
+    *x1 = st->w;
+    *y1 = st->h;
+    if (!vp) return;
+    *x0 = vp->x < st->w ? vp->x : st->w;
+    *y0 = vp->y < st->h ? vp->y : st->h;
+    if (vp->w && vp->w < *x1 - *x0) *x1 = *x0 + vp->w;
+    if (vp->h && vp->h < *y1 - *y0) *y1 = *y0 + vp->h;
 }
 
 //Draws an ASCII “live” view of the random walk: empty cells as ., obstacles as #, the goal [0,0] as G, the path as *,
-// and the current walker position as @.
-static void render_interactive(const rw_state_msg_t *st) {
+// and the current walker position as @. Only the viewport vp is drawn (NULL = everything).
+static void render_interactive(const rw_state_msg_t *st, const grid_rect_t *vp) {
     const uint32_t w = st->w, h = st->h;
+    uint32_t x0, y0, x1, y1;
+    clip_rect(st, vp, &x0, &y0, &x1, &y1);
 
     // character buffer: h rows, each w characters
     char grid[RW_MAX_H][RW_MAX_W];
@@ -80,17 +98,17 @@ static void render_interactive(const rw_state_msg_t *st) {
     printf("INTERACTIVE (rep %u/%u)  finished=%u\n", st->rep_done, st->rep_total, st->finished);
 
     // y-axis top->bottom (0..h-1)
-    for (uint32_t y = 0; y < h; y++) {
+    for (uint32_t y = y0; y < y1; y++) {
         printf("%2u | ", y);
-        for (uint32_t x = 0; x < w; x++) putchar(grid[y][x]);
+        for (uint32_t x = x0; x < x1; x++) putchar(grid[y][x]);
         printf("\n");
     }
 
     // x labels
     printf("    + ");
-    for (uint32_t x = 0; x < w; x++) putchar('-');
+    for (uint32_t x = x0; x < x1; x++) putchar('-');
     printf("\n     ");
-    for (uint32_t x = 0; x < w; x++) putchar((char)('0' + (x % 10)));
+    for (uint32_t x = x0; x < x1; x++) putchar((char)('0' + (x % 10)));
     printf("\n");
 }
 
@@ -102,9 +120,10 @@ static int digits_u32(uint32_t v) {
 }
 
 //Prints the grid as a table in “summary mode”, either showing average steps-to-goal per starting cell or
-// the probability of reaching the goal within K steps.
-static void render_summary(const rw_state_msg_t *st, rw_local_view_t view) {
-    const uint32_t w = st->w, h = st->h;
+// the probability of reaching the goal within K steps. Only the viewport vp is drawn (NULL = everything).
+static void render_summary(const rw_state_msg_t *st, rw_local_view_t view, const grid_rect_t *vp) {
+    uint32_t x0, y0, x1, y1;
+    clip_rect(st, vp, &x0, &y0, &x1, &y1);
 
     printf("\n");
     printf("SUMMARY (rep %u/%u) finished=%u  view=%s\n",
@@ -115,8 +134,8 @@ static void render_summary(const rw_state_msg_t *st, rw_local_view_t view) {
     if (view == RW_VIEW_AVG_STEPS) {
         // values are avg*1000
         uint32_t maxv = 0;
-        for (uint32_t y = 0; y < h; y++)
-            for (uint32_t x = 0; x < w; x++) {
+        for (uint32_t y = y0; y < y1; y++)
+            for (uint32_t x = x0; x < x1; x++) {
                 uint32_t i = y * RW_MAX_W + x;
                 uint32_t steps = st->cell_value[i] / 1000u;
                 if (steps > maxv) maxv = steps;
@@ -130,14 +149,14 @@ static void render_summary(const rw_state_msg_t *st, rw_local_view_t view) {
 
     // header x
     printf("    ");
-    for (uint32_t x = 0; x < w; x++) {
+    for (uint32_t x = x0; x < x1; x++) {
         printf(" %*u", colw, x);
     }
     printf("\n");
 
-    for (uint32_t y = 0; y < h; y++) {
+    for (uint32_t y = y0; y < y1; y++) {
         printf("%2u |", y);
-        for (uint32_t x = 0; x < w; x++) {
+        for (uint32_t x = x0; x < x1; x++) {
             uint32_t i = y * RW_MAX_W + x;
 
             if (view == RW_VIEW_AVG_STEPS) {
@@ -173,20 +192,45 @@ static int read_u32(const char *prompt, uint32_t *out) {
     return 1;
 }
 
+//Prompts the user and reads four unsigned integers from one line (e.g. a probability vector).
+static int read_u32x4(const char *prompt, uint32_t out[4]) {
+    char line[128];
+    printf("%s", prompt);
+    fflush(stdout);
+
+    if (!fgets(line, sizeof(line), stdin)) return 0;
+
+    char *p = line;
+    for (int i = 0; i < 4; i++) {
+        errno = 0;
+        char *end = NULL;
+        unsigned long v = strtoul(p, &end, 10);
+        if (errno != 0 || end == p) return 0;
+        out[i] = (uint32_t)v;
+        p = end;
+    }
+    return 1;
+}
+
 //Prompts the user and reads a line of text (e.g., output file path), trimming the newline.
-static void read_string(const char *prompt, char *dst, size_t dst_size) {
+//Returns 0 (and leaves dst empty) if the text does not fit in dst.
+static int read_string(const char *prompt, char *dst, size_t dst_size) {
     char line[256];
     printf("%s", prompt);
     fflush(stdout);
 
     if (!fgets(line, sizeof(line), stdin)) {
         dst[0] = '\0';
-        return;
+        return 1;
     }
 
     size_t n = strcspn(line, "\r\n");
     line[n] = '\0';
-    snprintf(dst, dst_size, "%s", line);
+    if ((size_t)snprintf(dst, dst_size, "%s", line) >= dst_size) {
+        dst[0] = '\0';
+        return 0;
+    }
+    return 1;
 }
 
 //Asks a yes/no question and returns true for y/Y. Used for confirming create/join/quit actions.
@@ -204,6 +248,7 @@ static void print_defaults(void) {
     printf("w=10 h=6 rep_total=20 K=200\n");
     printf("p_up=p_down=p_left=p_right=250000 (sum=%u)\n", (unsigned)RW_PROB_SCALE);
     printf("world_type=1 (wrap), mode=2 (summary), obstacles=0\n");
+    printf("seed=0 (random; use a fixed seed to reuse cached results), engine=0 (monte carlo)\n");
     printf("out_file=data/results/out.txt\n");
     printf("---------------------------------------------------------------\n\n");
 }
@@ -238,7 +283,58 @@ static int build_create_req_from_input(rw_create_sim_req_t *req) {
     /*if (!read_u32("obstacle density permille (0..1000): ", &req->obstacle_density_permille))*/
         req->obstacle_density_permille = 0;
 
-    read_string("out_file path: ", req->out_file, sizeof(req->out_file));
+    if (!read_u32("seed (0=random): ", &req->seed)) req->seed = 0;
+
+    uint32_t engine = RW_ENGINE_MONTE_CARLO;
+    if (!read_u32("engine (0=monte carlo, 1=exact spectral, wrap only): ", &engine)) engine = RW_ENGINE_MONTE_CARLO;
+    req->engine = (rw_engine_t)engine;
+
+    uint32_t vr = RW_VR_NONE;
+    if (!read_u32("variance reduction (0=none, 1=antithetic, 2=control variate, wrap only): ", &vr)) vr = RW_VR_NONE;
+    req->vr_scheme = (rw_vr_scheme_t)vr;
+    if (vr > RW_VR_CONTROL_VARIATE) {
+        fprintf(stderr, "variance reduction must be 0, 1 or 2.\n");
+        return 0;
+    }
+
+    // rare-event PROB_K estimator
+    if (!read_u32("splitting factor (0=off, 2..8): ", &req->split_factor)) req->split_factor = 0;
+    if (req->split_factor > 1) {
+        if (!read_u32("splitting level step (cells, >=1): ", &req->split_level_step)) req->split_level_step = 1;
+        if (req->split_factor > RW_MAX_SPLIT_FACTOR || req->split_level_step == 0) {
+            fprintf(stderr, "splitting factor must be 2..%d and level step >= 1.\n", RW_MAX_SPLIT_FACTOR);
+            return 0;
+        }
+    }
+
+    // approximate fast mode: finish walks with stored hit times of the cells they enter
+    if (!read_u32("tail memo reservoir (0=off, 1..64, plain monte carlo only): ", &req->tail_reservoir)) req->tail_reservoir = 0;
+    if (req->tail_reservoir > RW_MAX_TAIL_RESERVOIR) {
+        fprintf(stderr, "tail memo reservoir must be 0..%d.\n", RW_MAX_TAIL_RESERVOIR);
+        return 0;
+    }
+
+    // sweep: extra probability vectors evaluated from the same trajectories
+    if (!read_u32("sweep vectors (0..20, monte carlo only): ", &req->sweep_count)) req->sweep_count = 0;
+    if (req->sweep_count > RW_MAX_SWEEP) req->sweep_count = RW_MAX_SWEEP;
+    for (uint32_t v = 0; v < req->sweep_count; v++) {
+        char prompt[64];
+        snprintf(prompt, sizeof(prompt), "sweep %u (p_up p_down p_left p_right): ", v);
+        if (!read_u32x4(prompt, req->sweep_p[v])) {
+            fprintf(stderr, "Invalid sweep vector.\n");
+            return 0;
+        }
+        uint64_t vs = (uint64_t)req->sweep_p[v][0] + req->sweep_p[v][1] + req->sweep_p[v][2] + req->sweep_p[v][3];
+        if (vs != RW_PROB_SCALE) {
+            fprintf(stderr, "Sweep probabilities must sum to %u.\n", (unsigned)RW_PROB_SCALE);
+            return 0;
+        }
+    }
+
+    if (!read_string("out_file path: ", req->out_file, sizeof(req->out_file))) {
+        fprintf(stderr, "out_file path too long (max %d characters).\n", RW_PATH_MAX - 1);
+        return 0;
+    }
     if (req->out_file[0] == '\0') strcpy(req->out_file, "data/results/out.txt");
 
     // basic validation
@@ -263,6 +359,14 @@ static int build_create_req_from_input(rw_create_sim_req_t *req) {
         fprintf(stderr, "mode must be 1 or 2.\n");
         return 0;
     }
+    if (!(req->engine == RW_ENGINE_MONTE_CARLO || req->engine == RW_ENGINE_SPECTRAL)) {
+        fprintf(stderr, "engine must be 0 or 1.\n");
+        return 0;
+    }
+    if (req->engine == RW_ENGINE_SPECTRAL && req->world_type != RW_WORLD_WRAP) {
+        fprintf(stderr, "the spectral engine needs world_type 1 (wrap).\n");
+        return 0;
+    }
     if (req->obstacle_density_permille > 1000) {
         fprintf(stderr, "obstacle_density_permille must be 0..1000.\n");
         return 0;
@@ -275,75 +379,257 @@ static int build_create_req_from_input(rw_create_sim_req_t *req) {
 }
 
 typedef struct {
-    int fd;
+    rw_conn_t *conn;       // the receiver thread reads, the input thread writes (under lock)
+    pthread_mutex_t lock;  // the connection's send side, and the connection itself while it is replaced
+    const char *host;      // server, for reconnecting
+    uint16_t port;
+    uint64_t token;        // session token from HELLO_ACK (0 = the server cannot resume this client)
+    const rw_shm_state_t *shm;  // --shm: states come from the server's shared memory (NULL = over TCP only)
+    const grid_rect_t *viewport;  // --viewport: the part of the grid drawn (NULL = all)
     atomic_int mode;       // rw_global_mode_t
     atomic_int view;       // rw_local_view_t
     atomic_bool stop;
+    atomic_bool finished;  // last STATE reported a completed (extendable) run
 } client_ctx_t;
 
+//Sends a message from the input thread. Waits while the receiver is reconnecting, so it goes to the new connection.
+static int ctx_send(client_ctx_t *ctx, uint16_t type, const void *payload, uint16_t len) {
+    pthread_mutex_lock(&ctx->lock);
+    int rc = rw_conn_send(ctx->conn, type, payload, len);
+    pthread_mutex_unlock(&ctx->lock);
+    return rc;
+}
+
+//Stops the client and wakes the receiver (a blocked read returns).
+static void ctx_shutdown(client_ctx_t *ctx) {
+    atomic_store(&ctx->stop, 1);
+    pthread_mutex_lock(&ctx->lock);
+    shutdown(ctx->conn->fd, SHUT_RDWR);
+    pthread_mutex_unlock(&ctx->lock);
+}
+
+//After the connection dropped: connects again and resumes the session with RESUME, pausing longer before each
+//attempt. last_seq is the last state applied; a joined client gets the deltas it missed, or a keyframe. The input
+//thread waits meanwhile. Returns 0 once the client is back in the simulation, -1 if it cannot be.
+static int ctx_resume(client_ctx_t *ctx, uint32_t last_seq) {
+    if (ctx->token == 0) return -1;
+    pthread_mutex_lock(&ctx->lock);
+    int rc = -1;
+    unsigned wait_ms = RESUME_FIRST_WAIT_MS;
+    for (int attempt = 0; attempt < RESUME_ATTEMPTS && rc < 0 && !atomic_load(&ctx->stop); attempt++, wait_ms *= 2) {
+        usleep(wait_ms * 1000u);
+        int fd = rw_tcp_connect(ctx->host, ctx->port);
+        if (fd < 0) continue;
+        rw_conn_t conn;
+        if (rw_conn_init(&conn, fd, CLIENT_CONN_BYTES, CLIENT_CONN_BYTES) < 0) {
+            close(fd);
+            continue;
+        }
+
+        rw_resume_req_t rq = { .session_token = ctx->token, .last_seq = last_seq };
+        rw_resume_ack_t ack;
+        uint16_t type = 0, len = 0;
+        const unsigned char *p = NULL;
+        if (rw_conn_send(&conn, RW_MSG_RESUME, &rq, (uint16_t)sizeof(rq)) < 0 ||
+            rw_conn_recv(&conn, &type, &p, &len) < 0 || type != RW_MSG_RESUME_ACK || len != sizeof(ack)) {
+            rw_conn_free(&conn);
+            close(fd);
+            continue;
+        }
+        memcpy(&ack, p, sizeof(ack));
+        if (!ack.ok || !ack.joined) {
+            fprintf(stderr, "receiver: %s\n", ack.ok ? "the simulation has ended" : "the server no longer knows this client");
+            rw_conn_free(&conn);
+            close(fd);
+            break;
+        }
+
+        // the old connection goes; messages already read into the new one's buffer stay with it
+        close(ctx->conn->fd);
+        rw_conn_free(ctx->conn);
+        *ctx->conn = conn;
+        atomic_store(&ctx->mode, (int)ack.mode_now);
+        printf("client: reconnected as client_id=%u\n", ack.client_id);
+        rc = 0;
+    }
+    pthread_mutex_unlock(&ctx->lock);
+    return rc;
+}
+
+
+//Applies a STATE_DELTA payload to st. Returns 0 on success, -1 if it does not build on st or is malformed;
+//st is unchanged then, and the server's next keyframe brings the client back in sync.
+static int apply_state_delta(rw_state_msg_t *st, const unsigned char *p, size_t len) {
+    rw_state_delta_hdr_t dh;
+    if (len < sizeof(dh)) return -1;
+    memcpy(&dh, p, sizeof(dh));
+    if (st->seq == 0 || dh.base_seq != st->seq || dh.path_len > RW_MAX_PATH) return -1;
+    const size_t path_bytes = dh.path_len * sizeof(int16_t);
+    const size_t runs_at = sizeof(dh) + 2 * path_bytes;
+    if (len < runs_at) return -1;
+
+    // check every run before touching st
+    size_t pos = runs_at;
+    for (uint32_t r = 0; r < dh.nruns; r++) {
+        rw_delta_run_t run;
+        if (len - pos < sizeof(run)) return -1;
+        memcpy(&run, p + pos, sizeof(run));
+        pos += sizeof(run);
+        if ((uint32_t)run.start + run.count > RW_MAX_W * RW_MAX_H) return -1;
+        if (len - pos < run.count * sizeof(uint32_t)) return -1;
+        pos += run.count * sizeof(uint32_t);
+    }
+
+    st->seq = dh.seq;
+    st->rep_done = dh.rep_done;
+    st->rep_total = dh.rep_total;
+    st->mode = dh.mode;
+    st->finished = dh.finished;
+    st->path_len = dh.path_len;
+    memcpy(st->path_x, p + sizeof(dh), path_bytes);
+    memcpy(st->path_y, p + sizeof(dh) + path_bytes, path_bytes);
+    pos = runs_at;
+    for (uint32_t r = 0; r < dh.nruns; r++) {
+        rw_delta_run_t run;
+        memcpy(&run, p + pos, sizeof(run));
+        pos += sizeof(run);
+        memcpy(&st->cell_value[run.start], p + pos, run.count * sizeof(uint32_t));
+        pos += run.count * sizeof(uint32_t);
+    }
+    return 0;
+}
+
+//Draws a state in the current mode and view.
+static void render_state(client_ctx_t *ctx, const rw_state_msg_t *st) {
+    atomic_store(&ctx->mode, (int)st->mode);
+
+    rw_local_view_t view = (rw_local_view_t)atomic_load(&ctx->view);
+
+    if (st->mode == RW_MODE_INTERACTIVE) {
+        render_interactive(st, ctx->viewport);
+    } else {
+        render_summary(st, view, ctx->viewport);
+    }
+
+    if (st->mode == RW_MODE_INTERACTIVE) {
+        printf("PATH len=%u: ", st->path_len);
+        uint32_t show = st->path_len;
+        if (show > 12) show = 12;
+        for (uint32_t i = 0; i < show; i++) {
+            printf("(%d,%d) ", (int)st->path_x[i], (int)st->path_y[i]);
+        }
+        if (st->path_len > show) printf("...");
+        printf("\n");
+    }
+}
+
+//Reacts to the finished flag of the state just shown. Returns 1 if the client should stop.
+static int state_finished(client_ctx_t *ctx, uint32_t finished) {
+    if (finished == 2) {
+        ctx_shutdown(ctx);
+        printf("Simulation stopped. Quitting!\n");
+        return 1;
+    }
+
+    // completed runs stay on the server and can be extended; announce it once
+    int was_finished = atomic_exchange(&ctx->finished, finished ? 1 : 0);
+    if (finished && !was_finished) {
+        printf("Simulation finished. [e]=extend replications  [q]=quit\n");
+    }
+    return 0;
+}
+
+//Renders a state (full or rebuilt from deltas) and reacts to its finished flag. Returns 1 if the client should stop.
+static int show_state(client_ctx_t *ctx, const rw_state_msg_t *st) {
+    render_state(ctx, st);
+    return state_finished(ctx, st->finished);
+}
+
+//With --shm: shows each new state of the current view straight from the shared mapping, without copying it. The
+//server writes the other slot next, so a state stays intact for a tick; one that was overwritten while it was drawn
+//(a stalled terminal) is drawn again from the newer state.
+static void *shm_thread(void *arg) {
+    client_ctx_t *ctx = (client_ctx_t *)arg;
+    const rw_state_msg_t *last = NULL;
+    uint32_t last_ticket = 0;
+
+    for (;;) {
+        const int stopping = atomic_load(&ctx->stop);
+        uint32_t ticket = 0;
+        const rw_state_msg_t *st = rw_shm_state_begin(ctx->shm, (rw_local_view_t)atomic_load(&ctx->view), &ticket);
+        const int fresh = st && (st != last || ticket != last_ticket);
+        // a stopping server publishes the stopped run and closes the connection at once: that state is still shown
+        if (stopping && (!fresh || st->finished != 2)) break;
+        if (!fresh) {
+            usleep(SHM_POLL_MS * 1000);
+            continue;
+        }
+        render_state(ctx, st);
+        const uint32_t finished = st->finished;
+        if (!rw_shm_state_valid(ctx->shm, st, ticket)) continue;
+        last = st;
+        last_ticket = ticket;
+        if (state_finished(ctx, finished)) break;
+    }
+    return NULL;
+}
 
 //Background thread that continuously reads messages from the server, updates local mode state, 
-//renders incoming STATE updates, prints server errors/info messages, and stops the client when the simulation finishes or the connection drops.
+//renders incoming STATE updates (full, or deltas applied to the last one), prints server errors/info messages,
+//and stops the client when the simulation finishes or the connection drops and cannot be resumed.
 static void *receiver_thread(void *arg) {
     client_ctx_t *ctx = (client_ctx_t *)arg;
+    static rw_state_msg_t cur;            // last state, base of the next STATE_DELTA
+    static rw_world_t world;              // WORLD of the simulation, the rest of every STATE_DYN
 
     while (!atomic_load(&ctx->stop)) {
         uint16_t type = 0, len = 0;
-        if (rw_recv_hdr(ctx->fd, &type, &len) < 0) {
+        const unsigned char *p = NULL;
+        if (rw_conn_recv(ctx->conn, &type, &p, &len) < 0) {
+            if (atomic_load(&ctx->stop)) break;
+            fprintf(stderr, "receiver: disconnected, reconnecting\n");
+            if (ctx_resume(ctx, cur.seq) == 0) continue;
             fprintf(stderr, "receiver: disconnected\n");
             atomic_store(&ctx->stop, 1);
             break;
         }
 
         if (type == RW_MSG_STATE && len == sizeof(rw_state_msg_t)) {
-            rw_state_msg_t st;
-            if (rw_recv_all(ctx->fd, &st, sizeof(st)) < 0) {
-                fprintf(stderr, "receiver: read state failed\n");
-                atomic_store(&ctx->stop, 1);
-                break;
-            }
-            
-            /*            printf("STATE: %u/%u finished=%u mode=%u w=%u h=%u cell[0]=%u\n",
-                   st.rep_done, st.rep_total, st.finished,
-                   (unsigned)st.mode, st.w, st.h,
-                   st.cell_value[0]);
-            
-            */
-            atomic_store(&ctx->mode, (int)st.mode);
-
-            rw_local_view_t view = (rw_local_view_t)atomic_load(&ctx->view);
-
-            if (st.mode == RW_MODE_INTERACTIVE) {
-                render_interactive(&st);
-            } else {
-                render_summary(&st, view);
+            memcpy(&cur, p, sizeof(cur));
+            if (show_state(ctx, &cur)) break;
+        } else if (type == RW_MSG_STATE_DELTA) {
+            if (apply_state_delta(&cur, p, len) < 0) continue;   // out of sync until the next keyframe
+            if (show_state(ctx, &cur)) break;
+        } else if (type == RW_MSG_STATE_COMPACT) {
+            // decoded straight from the receive buffer; a broken one leaves no base for deltas until the next keyframe
+            if (rw_state_decode_compact(p, len, &cur) < 0) {
+                cur.seq = 0;
+                continue;
             }
-
-
-            if (st.mode == RW_MODE_INTERACTIVE) {
-                printf("PATH len=%u: ", st.path_len);
-                uint32_t show = st.path_len;
-                if (show > 12) show = 12;
-                for (uint32_t i = 0; i < show; i++) {
-                    printf("(%d,%d) ", (int)st.path_x[i], (int)st.path_y[i]);
-                }
-                if (st.path_len > show) printf("...");
-                printf("\n");
+            if (show_state(ctx, &cur)) break;
+        } else if (type == RW_MSG_WORLD) {
+            if (rw_world_decode(p, len, &world) < 0) fprintf(stderr, "receiver: bad WORLD message\n");
+        } else if (type == RW_MSG_STATE_DYN) {
+            // a broken one, or one of a world not received, leaves no base for deltas until the next keyframe
+            if (rw_state_decode_dyn(p, len, &world, &cur) < 0) {
+                cur.seq = 0;
+                continue;
             }
-
-            if (st.finished) {
-                atomic_store(&ctx->stop, 1);
-                shutdown(ctx->fd, SHUT_RDWR);
-                printf("Simulation stopped/finished. Quitting!\n");
-                break;
+            if (show_state(ctx, &cur)) break;
+        } else if (type == RW_MSG_STATE_TILES) {
+            // tiles overwrite their part of the last state; a broken message changes nothing
+            if (rw_state_decode_tiles(p, len, &cur, NULL) < 0) continue;
+            if (show_state(ctx, &cur)) break;
+        } else if (type == RW_MSG_STATE_RECT) {
+            // the subscribed part only; deltas are never sent on top of it
+            if (rw_state_decode_rect(p, len, &cur, NULL) < 0) {
+                cur.seq = 0;
+                continue;
             }
+            if (show_state(ctx, &cur)) break;
         } else if (type == RW_MSG_ERROR && len == sizeof(rw_error_msg_t)) {
             rw_error_msg_t e;
-            if (rw_recv_all(ctx->fd, &e, sizeof(e)) < 0) {
-                fprintf(stderr, "receiver: read error failed\n");
-                atomic_store(&ctx->stop, 1);
-                break;
-            }
+            memcpy(&e, p, sizeof(e));
 
             // code==0 -> INFO, do not stop
             if (e.code == 0) {
@@ -351,7 +637,8 @@ static void *receiver_thread(void *arg) {
                 continue;
             }
 
-            if (e.code == 71) {
+            // permission / argument errors for STOP_SIM and EXTEND_SIM are not fatal
+            if (e.code == 71 || (e.code >= 81 && e.code <= 84)) {
                 printf("server info: %s\n", e.msg);
                 continue;
             }
@@ -359,9 +646,8 @@ static void *receiver_thread(void *arg) {
             fprintf(stderr, "ERROR: code=%d msg=%s\n", e.code, e.msg);
             atomic_store(&ctx->stop, 1);
             break;
-        } else {
-            if (len) skip_payload(ctx->fd, len);
         }
+        // anything else was read whole and is ignored
     }
 
     return NULL;
@@ -372,7 +658,7 @@ static void *receiver_thread(void *arg) {
 static void *input_thread(void *arg) {
     client_ctx_t *ctx = (client_ctx_t *)arg;
 
-    printf("\nControls: [m]=toggle mode  [v]=toggle view  [s]=stop sim  [q]=quit\n");
+    printf("\nControls: [m]=toggle mode  [v]=toggle view  [e]=extend sim  [s]=stop sim  [q]=quit\n");
     fflush(stdout);
 
     struct pollfd pfd;
@@ -403,7 +689,7 @@ static void *input_thread(void *arg) {
                 int cur = atomic_load(&ctx->mode);
                 int next = (cur == RW_MODE_SUMMARY) ? RW_MODE_INTERACTIVE : RW_MODE_SUMMARY;
                 rw_set_mode_req_t req = { .mode = (rw_global_mode_t)next };
-                if (rw_send_msg(ctx->fd, RW_MSG_SET_MODE, &req, (uint16_t)sizeof(req)) < 0) {
+                if (ctx_send(ctx, RW_MSG_SET_MODE, &req, (uint16_t)sizeof(req)) < 0) {
                     fprintf(stderr, "input: send SET_MODE failed\n");
                     atomic_store(&ctx->stop, 1);
                     break;
@@ -417,7 +703,7 @@ static void *input_thread(void *arg) {
                 atomic_store(&ctx->view, next);
 
                 rw_set_view_req_t req = { .view = (rw_local_view_t)next };
-                if (rw_send_msg(ctx->fd, RW_MSG_SET_VIEW, &req, (uint16_t)sizeof(req)) < 0) {
+                if (ctx_send(ctx, RW_MSG_SET_VIEW, &req, (uint16_t)sizeof(req)) < 0) {
                     fprintf(stderr, "input: send SET_VIEW failed\n");
                     atomic_store(&ctx->stop, 1);
                     break;
@@ -425,9 +711,28 @@ static void *input_thread(void *arg) {
                 printf("client: sent SET_VIEW -> %d\n", next);
             }
 
+            if (c == 'e') {
+                // drop the rest of the command line before prompting
+                int rest = c;
+                while (rest != '\n' && rest != EOF) rest = getchar();
+
+                uint32_t extra = 0;
+                if (!read_u32("Additional replications: ", &extra) || extra == 0) {
+                    printf("client: extend cancelled\n");
+                    continue;
+                }
+                rw_extend_req_t req = { .extra_reps = extra };
+                if (ctx_send(ctx, RW_MSG_EXTEND_SIM, &req, (uint16_t)sizeof(req)) < 0) {
+                    fprintf(stderr, "input: send EXTEND_SIM failed\n");
+                    atomic_store(&ctx->stop, 1);
+                    break;
+                }
+                printf("client: sent EXTEND_SIM +%u\n", extra);
+            }
+
             if (c == 's') {
                 rw_stop_req_t req = { .reason = 1 };
-                if (rw_send_msg(ctx->fd, RW_MSG_STOP_SIM, &req, (uint16_t)sizeof(req)) < 0) {
+                if (ctx_send(ctx, RW_MSG_STOP_SIM, &req, (uint16_t)sizeof(req)) < 0) {
                     fprintf(stderr, "input: send STOP_SIM failed\n");
                     atomic_store(&ctx->stop, 1);
                     break;
@@ -436,8 +741,7 @@ static void *input_thread(void *arg) {
             }
 
             if (c == 'q') {
-                atomic_store(&ctx->stop, 1);
-                shutdown(ctx->fd, SHUT_RDWR);
+                ctx_shutdown(ctx);
                 printf("client: quitting...\n");
                 break;
             }
@@ -448,13 +752,14 @@ static void *input_thread(void *arg) {
 
 //Reads the server’s post-HELLO informational message (sent as RW_MSG_ERROR with code=0) and guesses whether 
 //a simulation is already running, so the client knows whether to create or join.
-static int recv_server_info(int fd, rw_error_msg_t *out_info) {
+static int recv_server_info(rw_conn_t *conn, rw_error_msg_t *out_info) {
     uint16_t type = 0, len = 0;
-    if (rw_recv_hdr(fd, &type, &len) < 0) return -1;
+    const unsigned char *p = NULL;
+    if (rw_conn_recv(conn, &type, &p, &len) < 0) return -1;
 
     if (type == RW_MSG_ERROR && len == sizeof(rw_error_msg_t)) {
         rw_error_msg_t e;
-        if (rw_recv_all(fd, &e, sizeof(e)) < 0) return -1;
+        memcpy(&e, p, sizeof(e));
         if (out_info) *out_info = e;
 
         if (e.code == 0) {
@@ -467,13 +772,13 @@ static int recv_server_info(int fd, rw_error_msg_t *out_info) {
     }
 
     // unknown, ignore
-    if (len) skip_payload(fd, len);
     return -1;
 }
 
 //Forks and execs a local ./server process on the chosen port, 
 //so a client can conveniently start the server automatically when connecting to localhost.
-static int spawn_server(uint16_t port) {
+//A server started for job submission is persistent, so later scripted clients find it running.
+static int spawn_server(uint16_t port, int persistent) {
     pid_t pid = fork();
     if (pid < 0) return -1;
 
@@ -482,7 +787,7 @@ static int spawn_server(uint16_t port) {
         char port_str[16];
         snprintf(port_str, sizeof(port_str), "%u", (unsigned)port);
 
-        char *argv[] = { "./server", "--port", port_str, NULL };
+        char *argv[] = { "./server", "--port", port_str, persistent ? "--persistent" : NULL, NULL };
         execv(argv[0], argv);
 
        
@@ -496,14 +801,14 @@ static int spawn_server(uint16_t port) {
 
 //Tries to connect to the server; if it fails and the host is local, 
 //it attempts to start the server and retries for a short time before giving up.
-static int connect_or_spawn(const char *host, uint16_t port) {
+static int connect_or_spawn(const char *host, uint16_t port, int persistent) {
     int fd = rw_tcp_connect(host, port);
     if (fd >= 0) return fd;
 
     // if connecting to localhost and it is not running, try to run it
     // if not localhost, dont run localhost
     if (strcmp(host, "127.0.0.1") == 0 || strcmp(host, "localhost") == 0) {
-        if (spawn_server(port) < 0) {
+        if (spawn_server(port, persistent) < 0) {
             perror("spawn_server");
             return -1;
         }
@@ -523,17 +828,267 @@ static int connect_or_spawn(const char *host, uint16_t port) {
     return -1;
 }
 
+// ---- Non-interactive job mode (--submit / --status / --wait-job) ----
+typedef enum { JOB_CMD_NONE = 0, JOB_CMD_SUBMIT, JOB_CMD_STATUS, JOB_CMD_WAIT } job_cmd_t;
+
+//Returns a printable name of a job state.
+static const char *job_state_name(rw_job_state_t s) {
+    switch (s) {
+        case RW_JOB_QUEUED: return "queued";
+        case RW_JOB_RUNNING: return "running";
+        case RW_JOB_DONE: return "done";
+        case RW_JOB_FAILED: return "failed";
+        default: return "unknown";
+    }
+}
+
+//Waits for the next message of the given type and size, printing server errors on the way and skipping anything else.
+//Returns 0 when it arrived, -1 if the connection broke.
+static int recv_reply(rw_conn_t *conn, uint16_t want_type, void *buf, uint16_t size) {
+    for (;;) {
+        uint16_t type = 0, len = 0;
+        const unsigned char *p = NULL;
+        if (rw_conn_recv(conn, &type, &p, &len) < 0) return -1;
+        if (type == want_type && len == size) {
+            memcpy(buf, p, size);
+            return 0;
+        }
+        if (type == RW_MSG_ERROR && len == sizeof(rw_error_msg_t)) {
+            rw_error_msg_t e;
+            memcpy(&e, p, sizeof(e));
+            if (e.code != 0) fprintf(stderr, "server error: code=%d msg=%s\n", e.code, e.msg);
+        }
+    }
+}
+
+//Prints one status line of a job in key=value form, easy to parse from scripts.
+static void print_job_status(const rw_job_status_t *st) {
+    printf("job_id=%u state=%s priority=%d", st->job_id, job_state_name(st->state), st->priority);
+    if (st->state == RW_JOB_QUEUED) printf(" queue_pos=%u", st->queue_pos);
+    if (st->state != RW_JOB_UNKNOWN) printf(" rep_done=%u rep_total=%u out=%s", st->rep_done, st->rep_total, st->out_file);
+    printf("\n");
+    fflush(stdout);
+}
+
+//Queries (or, with subscribe, waits for the end of) a job and prints its status.
+//Returns the process exit status: 0 unless the job failed or is unknown.
+static int job_status_cmd(rw_conn_t *conn, uint32_t job_id, int subscribe) {
+    rw_job_ref_t ref = {.job_id = job_id};
+    uint16_t type = subscribe ? RW_MSG_JOB_SUBSCRIBE : RW_MSG_JOB_STATUS_REQ;
+    if (rw_conn_send(conn, type, &ref, (uint16_t)sizeof(ref)) < 0) die("rw_conn_send(JOB_STATUS_REQ)");
+
+    rw_job_status_t st;
+    if (recv_reply(conn, RW_MSG_JOB_STATUS, &st, (uint16_t)sizeof(st)) < 0) die("recv(JOB_STATUS)");
+    // a subscription answers with the current status at once and again when the job ends
+    if (subscribe && (st.state == RW_JOB_QUEUED || st.state == RW_JOB_RUNNING)) {
+        if (recv_reply(conn, RW_MSG_JOB_STATUS, &st, (uint16_t)sizeof(st)) < 0) die("recv(JOB_STATUS)");
+    }
+    print_job_status(&st);
+    return (st.state == RW_JOB_FAILED || st.state == RW_JOB_UNKNOWN) ? 1 : 0;
+}
+
+//Runs one scripted job command on an established connection: submit a job (optionally waiting for the result),
+//query a job, or wait for one. Returns the process exit status.
+static int run_job_cmd(rw_conn_t *conn, job_cmd_t cmd, uint32_t job_id, const rw_submit_job_req_t *sj, int wait) {
+    if (cmd != JOB_CMD_SUBMIT) return job_status_cmd(conn, job_id, cmd == JOB_CMD_WAIT);
+
+    if (rw_conn_send(conn, RW_MSG_SUBMIT_JOB, sj, (uint16_t)sizeof(*sj)) < 0) die("rw_conn_send(SUBMIT_JOB)");
+
+    rw_submit_ack_t ack;
+    if (recv_reply(conn, RW_MSG_SUBMIT_ACK, &ack, (uint16_t)sizeof(ack)) < 0) die("recv(SUBMIT_ACK)");
+    if (!ack.ok) return 1;
+    if (!wait) {
+        printf("job_id=%u state=queued\n", ack.job_id);
+        return 0;
+    }
+    return job_status_cmd(conn, ack.job_id, 1);
+}
+
+// ---- Non-interactive statistics queries (--query / --query-rect) ----
+typedef struct {
+    uint32_t ncells;                            // --query cells (QUERY_CELLS), 0 = none
+    uint16_t cell[RW_QUERY_CELLS_MAX][2];
+    int have_rect;                              // --query-rect (QUERY_RECT)
+    rw_query_rect_req_t rect;
+} query_cmd_t;
+
+//Prints one cell of a QUERY_RESULT in key=value form: raw counts, then the mean steps and P(hit within K), each
+//with its 95% confidence interval.
+static void print_cell_stats(const rw_cell_stats_t *cs) {
+    printf("x=%u y=%u samples=%u steps_sum=%" PRIu64 " hits_k=%u", cs->x, cs->y, cs->samples, cs->steps_sum,
+           cs->hit_k_count);
+    printf(" avg_steps=%.3f", cs->avg_steps / 1000.0);
+    if (!(cs->flags & RW_CELL_NO_SPREAD)) printf(" avg_ci=%.3f,%.3f", cs->avg_lo / 1000.0, cs->avg_hi / 1000.0);
+    if (!(cs->flags & RW_CELL_EXACT)) {
+        printf(" prob_k=%.6f prob_ci=%.6f,%.6f", cs->prob_k / (double)RW_PROB_SCALE,
+               cs->prob_lo / (double)RW_PROB_SCALE, cs->prob_hi / (double)RW_PROB_SCALE);
+    }
+    printf("\n");
+}
+
+//Sends the query and prints its result, a progress line and one line per cell.
+//Returns the process exit status: 0 unless the server refused the query.
+static int run_query_cmd(rw_conn_t *conn, const query_cmd_t *q) {
+    const uint32_t query_id = 1;
+    if (q->have_rect) {
+        rw_query_rect_req_t qr = q->rect;
+        qr.query_id = query_id;
+        if (rw_conn_send(conn, RW_MSG_QUERY_RECT, &qr, (uint16_t)sizeof(qr)) < 0) die("rw_conn_send(QUERY_RECT)");
+    } else {
+        unsigned char req[sizeof(rw_query_cells_req_t) + sizeof(q->cell)];
+        rw_query_cells_req_t qc = { .query_id = query_id, .count = q->ncells };
+        memcpy(req, &qc, sizeof(qc));
+        memcpy(req + sizeof(qc), q->cell, q->ncells * sizeof(q->cell[0]));
+        uint16_t len = (uint16_t)(sizeof(qc) + q->ncells * sizeof(q->cell[0]));
+        if (rw_conn_send(conn, RW_MSG_QUERY_CELLS, req, len) < 0) die("rw_conn_send(QUERY_CELLS)");
+    }
+
+    // the result has a variable length, so it is taken here rather than with recv_reply
+    for (;;) {
+        uint16_t type = 0, len = 0;
+        const unsigned char *p = NULL;
+        if (rw_conn_recv(conn, &type, &p, &len) < 0) die("recv(QUERY_RESULT)");
+        if (type == RW_MSG_ERROR && len == sizeof(rw_error_msg_t)) {
+            rw_error_msg_t e;
+            memcpy(&e, p, sizeof(e));
+            if (e.code != 0) fprintf(stderr, "server error: code=%d msg=%s\n", e.code, e.msg);
+            continue;
+        }
+        rw_query_result_hdr_t qh;
+        if (type != RW_MSG_QUERY_RESULT || len < sizeof(qh)) continue;
+        memcpy(&qh, p, sizeof(qh));
+        if (qh.query_id != query_id) continue;
+        if (!qh.ok || len != sizeof(qh) + (size_t)qh.count * sizeof(rw_cell_stats_t)) return 1;
+
+        printf("rep_done=%u rep_total=%u K=%u cells=%u\n", qh.rep_done, qh.rep_total, qh.K, qh.count);
+        for (uint32_t k = 0; k < qh.count; k++) {
+            rw_cell_stats_t cs;
+            memcpy(&cs, p + sizeof(qh) + k * sizeof(cs), sizeof(cs));
+            print_cell_stats(&cs);
+        }
+        fflush(stdout);
+        return 0;
+    }
+}
+
+//Parses a job id given on the command line. Returns 0 on success, -1 if it is not a positive number.
+static int parse_job_id(const char *s, uint32_t *out) {
+    char *end = NULL;
+    unsigned long v = strtoul(s, &end, 10);
+    if (end == s || *end != '\0' || v == 0 || v > UINT32_MAX) return -1;
+    *out = (uint32_t)v;
+    return 0;
+}
+
+//Parses --viewport X,Y,W,H. Returns 0 on success, -1 if it is malformed or starts outside the largest grid.
+static int parse_viewport(const char *s, grid_rect_t *out) {
+    unsigned x, y, w, h;
+    int n = 0;
+    if (sscanf(s, "%u,%u,%u,%u%n", &x, &y, &w, &h, &n) != 4 || s[n] != '\0') return -1;
+    if (x >= RW_MAX_W || y >= RW_MAX_H) return -1;
+    *out = (grid_rect_t){ x, y, w, h };
+    return 0;
+}
+
+//Parses one --query cell X,Y and appends it. Returns 0 on success, -1 if it is malformed or there are too many.
+static int parse_query_cell(const char *s, query_cmd_t *q) {
+    unsigned x, y;
+    int n = 0;
+    if (sscanf(s, "%u,%u%n", &x, &y, &n) != 2 || s[n] != '\0') return -1;
+    if (x >= RW_MAX_W || y >= RW_MAX_H || q->ncells == RW_QUERY_CELLS_MAX) return -1;
+    q->cell[q->ncells][0] = (uint16_t)x;
+    q->cell[q->ncells][1] = (uint16_t)y;
+    q->ncells++;
+    return 0;
+}
+
+//Parses --query-rect X,Y,W,H. Returns 0 on success, -1 if it is malformed, empty or larger than one query.
+static int parse_query_rect(const char *s, query_cmd_t *q) {
+    unsigned x, y, w, h;
+    int n = 0;
+    if (sscanf(s, "%u,%u,%u,%u%n", &x, &y, &w, &h, &n) != 4 || s[n] != '\0') return -1;
+    if (x >= RW_MAX_W || y >= RW_MAX_H || w == 0 || h == 0 || w > RW_MAX_W || h > RW_MAX_H) return -1;
+    if (w * h > RW_QUERY_CELLS_MAX) return -1;
+    q->rect = (rw_query_rect_req_t){ .x = (uint16_t)x, .y = (uint16_t)y, .w = (uint16_t)w, .h = (uint16_t)h };
+    q->have_rect = 1;
+    return 0;
+}
+
+//Parses --fields, a comma-separated list of path, obstacles and values. Returns 0 on success, -1 on an unknown name.
+static int parse_fields(const char *s, uint32_t *out) {
+    uint32_t f = 0;
+    while (*s) {
+        size_t n = strcspn(s, ",");
+        if (n == 4 && strncmp(s, "path", n) == 0) f |= RW_FIELD_PATH;
+        else if (n == 9 && strncmp(s, "obstacles", n) == 0) f |= RW_FIELD_OBSTACLES;
+        else if (n == 6 && strncmp(s, "values", n) == 0) f |= RW_FIELD_VALUES;
+        else return -1;
+        s += n;
+        if (*s == ',') s++;
+    }
+    if (f == 0) return -1;
+    *out = f;
+    return 0;
+}
+
+//Prints command-line help.
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "Usage: %s [--host HOST] [--port N] [--q16] [--tiles] [--shm] [--viewport X,Y,W,H] [--max-fps F] [--fields LIST]\n"
+            "       %s [--host HOST] [--port N] --submit [--priority N] [--wait] key=value...\n"
+            "       %s [--host HOST] [--port N] --status JOB_ID | --wait-job JOB_ID\n"
+            "       %s [--host HOST] [--port N] --query X,Y [--query X,Y]... | --query-rect X,Y,W,H\n"
+            "  Without a job option the client runs interactively (--q16: cell values may arrive rounded to 16 bits;\n"
+            "  --tiles: receive the grid as tiles, only those that changed;\n"
+            "  --shm: read the states from the shared memory of a local server started with --shm;\n"
+            "  --viewport: draw only W x H cells from X,Y, W or H 0 = up to the edge; --max-fps: at most F states per\n"
+            "  second; --fields: any of path,obstacles,values. With these the server sends only what is asked for.)\n"
+            "  Job parameters use the rwbatch manifest keys\n"
+            "  (w h reps K out, optional p_up p_down p_left p_right seed engine vr tail split split_step sweep).\n"
+            "  --query / --query-rect print the counts, mean steps and P(hit within K) of cells of the running\n"
+            "  simulation, with 95%% confidence intervals (at most %u cells).\n",
+            prog, prog, prog, prog, RW_QUERY_CELLS_MAX);
+}
+
 //Parses command-line options (host/port), connects (or starts a local server), performs the HELLO handshake, 
 //decides whether to CREATE or JOIN a simulation based on server info and user choice, 
 //then starts the receiver/input threads and cleanly shuts down when the simulation ends or the user quits.
+//With --submit, --status or --wait-job it instead runs one job queue command and exits (for scripts), likewise
+//one statistics query with --query or --query-rect.
 int main(int argc, char **argv) {
 
         const char *host = "127.0.0.1";
     uint16_t port = 12345;
+    job_cmd_t job_cmd = JOB_CMD_NONE;
+    uint32_t job_id = 0;
+    rw_submit_job_req_t sj;
+    memset(&sj, 0, sizeof(sj));
+    int wait = 0;
+    int q16 = 0;
+    int tiles = 0;
+    int use_shm = 0;
+    grid_rect_t viewport = { 0, 0, 0, 0 };
+    int have_viewport = 0;
+    uint32_t min_interval_ms = 0;
+    uint32_t fields = RW_FIELD_ALL;
+    static query_cmd_t query;
 
     static struct option long_opts[] = {
         {"host", required_argument, 0, 'h'},
         {"port", required_argument, 0, 'p'},
+        {"submit", no_argument, 0, 's'},
+        {"priority", required_argument, 0, 'P'},
+        {"wait", no_argument, 0, 'w'},
+        {"status", required_argument, 0, 'S'},
+        {"wait-job", required_argument, 0, 'W'},
+        {"q16", no_argument, 0, 'q'},
+        {"tiles", no_argument, 0, 't'},
+        {"shm", no_argument, 0, 'm'},
+        {"viewport", required_argument, 0, 'V'},
+        {"max-fps", required_argument, 0, 'f'},
+        {"fields", required_argument, 0, 'F'},
+        {"query", required_argument, 0, 'Q'},
+        {"query-rect", required_argument, 0, 'R'},
         {0, 0, 0, 0}
     };
 
@@ -552,14 +1107,98 @@ int main(int argc, char **argv) {
                 port = (uint16_t)v;
                 break;
             }
+            case 's':
+                job_cmd = JOB_CMD_SUBMIT;
+                break;
+            case 'P': {
+                char *end = NULL;
+                long v = strtol(optarg, &end, 10);
+                if (end == optarg || *end != '\0' || v < INT32_MIN || v > INT32_MAX) {
+                    fprintf(stderr, "client: invalid priority: %s\n", optarg);
+                    return 1;
+                }
+                sj.priority = (int32_t)v;
+                break;
+            }
+            case 'w':
+                wait = 1;
+                break;
+            case 'q':
+                q16 = 1;
+                break;
+            case 't':
+                tiles = 1;
+                break;
+            case 'm':
+                use_shm = 1;
+                break;
+            case 'V':
+                if (parse_viewport(optarg, &viewport) < 0) {
+                    fprintf(stderr, "client: invalid viewport: %s\n", optarg);
+                    return 1;
+                }
+                have_viewport = 1;
+                break;
+            case 'f': {
+                char *end = NULL;
+                double fps = strtod(optarg, &end);
+                if (end == optarg || *end != '\0' || !(fps > 0.0) || fps > 1000.0) {
+                    fprintf(stderr, "client: invalid max fps: %s\n", optarg);
+                    return 1;
+                }
+                min_interval_ms = (uint32_t)(1000.0 / fps + 0.5);
+                break;
+            }
+            case 'F':
+                if (parse_fields(optarg, &fields) < 0) {
+                    fprintf(stderr, "client: invalid fields: %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'Q':
+                if (parse_query_cell(optarg, &query) < 0) {
+                    fprintf(stderr, "client: invalid query cell: %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'R':
+                if (parse_query_rect(optarg, &query) < 0) {
+                    fprintf(stderr, "client: invalid query rectangle: %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'S':
+            case 'W':
+                job_cmd = opt == 'S' ? JOB_CMD_STATUS : JOB_CMD_WAIT;
+                if (parse_job_id(optarg, &job_id) < 0) {
+                    fprintf(stderr, "client: invalid job id: %s\n", optarg);
+                    return 1;
+                }
+                break;
             default:
-                fprintf(stderr, "Usage: %s [--host HOST] [--port N]\n", argv[0]);
+                usage(argv[0]);
                 return 1;
         }
     }
+    const int query_cmd = query.ncells > 0 || query.have_rect;
+    if ((job_cmd == JOB_CMD_SUBMIT) != (optind < argc) || (wait && job_cmd != JOB_CMD_SUBMIT) ||
+        (query_cmd && (job_cmd != JOB_CMD_NONE || (query.ncells > 0 && query.have_rect)))) {
+        usage(argv[0]);
+        return 1;
+    }
+    // job parameters are checked before connecting; the server validates the rest
+    if (job_cmd == JOB_CMD_SUBMIT) {
+        char err[128];
+        if (rw_sim_config_parse(&sj.req, argv + optind, argc - optind, err, sizeof(err)) < 0) {
+            fprintf(stderr, "client: %s\n", err);
+            return 1;
+        }
+    }
 
-    int fd = connect_or_spawn(host, port);
+    int fd = connect_or_spawn(host, port, job_cmd != JOB_CMD_NONE || query_cmd);
     if (fd < 0) die("connect_or_spawn");
+    rw_conn_t conn;
+    if (rw_conn_init(&conn, fd, CLIENT_CONN_BYTES, CLIENT_CONN_BYTES) < 0) die("rw_conn_init");
 
     /*
     int fd = rw_tcp_connect("127.0.0.1", 12345);
@@ -567,28 +1206,43 @@ int main(int argc, char **argv) {
     */
 
     // HELLO
-    if (rw_send_msg(fd, RW_MSG_HELLO, NULL, 0) < 0) die("rw_send_msg(HELLO)");
+    if (rw_conn_send(&conn, RW_MSG_HELLO, NULL, 0) < 0) die("rw_conn_send(HELLO)");
 
     // HELLO_ACK
     uint16_t type = 0, len = 0;
-    if (rw_recv_hdr(fd, &type, &len) < 0) die("rw_recv_hdr(HELLO_ACK)");
-    if (type != RW_MSG_HELLO_ACK || len != sizeof(rw_hello_ack_t)) {
+    const unsigned char *p = NULL;
+    if (rw_conn_recv(&conn, &type, &p, &len) < 0) die("rw_conn_recv(HELLO_ACK)");
+    // an older server sends only the client id
+    if (type != RW_MSG_HELLO_ACK || (len != sizeof(rw_hello_ack_t) && len != sizeof(uint32_t))) {
         fprintf(stderr, "client: expected HELLO_ACK, got type=%u len=%u\n", type, len);
-        if (len) skip_payload(fd, len);
         close(fd);
         return 1;
     }
 
     rw_hello_ack_t hello;
-    if (rw_recv_all(fd, &hello, sizeof(hello)) < 0) die("rw_recv_all(hello)");
+    memset(&hello, 0, sizeof(hello));
+    memcpy(&hello, p, len);
+    const int hello_full = len == sizeof(rw_hello_ack_t);
+
+    if (query_cmd) {
+        int rc = run_query_cmd(&conn, &query);
+        close(fd);
+        return rc;
+    }
+    if (job_cmd != JOB_CMD_NONE) {
+        int rc = run_job_cmd(&conn, job_cmd, job_id, &sj, wait);
+        close(fd);
+        return rc;
+    }
     printf("client: connected client_id=%u\n", hello.client_id);
 
     // INFO (server sends as RW_MSG_ERROR with code=0)
     rw_error_msg_t info;
     memset(&info, 0, sizeof(info));
-    int sim_running = recv_server_info(fd, &info);
+    int sim_running = recv_server_info(&conn, &info);
     if (sim_running >= 0 && info.code == 0) {
         printf("server info: %s\n", info.msg);
+        if (hello_full) sim_running = hello.sim_running ? 1 : 0;
     }
     rw_global_mode_t start_mode = RW_MODE_SUMMARY;
 
@@ -606,19 +1260,18 @@ int main(int argc, char **argv) {
             return 1;
         }
 
-        if (rw_send_msg(fd, RW_MSG_CREATE_SIM, &req, (uint16_t)sizeof(req)) < 0)
-            die("rw_send_msg(CREATE_SIM)");
+        if (rw_conn_send(&conn, RW_MSG_CREATE_SIM, &req, (uint16_t)sizeof(req)) < 0)
+            die("rw_conn_send(CREATE_SIM)");
 
-        if (rw_recv_hdr(fd, &type, &len) < 0) die("rw_recv_hdr(CREATE_ACK)");
+        if (rw_conn_recv(&conn, &type, &p, &len) < 0) die("rw_conn_recv(CREATE_ACK)");
         if (type != RW_MSG_CREATE_ACK || len != sizeof(rw_create_ack_t)) {
             fprintf(stderr, "client: expected CREATE_ACK, got type=%u len=%u\n", type, len);
-            if (len) skip_payload(fd, len);
-            close(fd);
+                close(fd);
             return 1;
         }
 
         rw_create_ack_t ack;
-        if (rw_recv_all(fd, &ack, sizeof(ack)) < 0) die("rw_recv_all(create_ack)");
+        memcpy(&ack, p, sizeof(ack));
         printf("client: CREATE_ACK ok=%u sim_id=%u\n", ack.ok, ack.sim_id);
         if (!ack.ok) { close(fd); return 1; }
 
@@ -631,19 +1284,18 @@ int main(int argc, char **argv) {
         }
 
         rw_join_req_t jr = { .sim_id = 1 };
-        if (rw_send_msg(fd, RW_MSG_JOIN_SIM, &jr, (uint16_t)sizeof(jr)) < 0)
-            die("rw_send_msg(JOIN_SIM)");
+        if (rw_conn_send(&conn, RW_MSG_JOIN_SIM, &jr, (uint16_t)sizeof(jr)) < 0)
+            die("rw_conn_send(JOIN_SIM)");
 
-        if (rw_recv_hdr(fd, &type, &len) < 0) die("rw_recv_hdr(JOIN_ACK)");
+        if (rw_conn_recv(&conn, &type, &p, &len) < 0) die("rw_conn_recv(JOIN_ACK)");
         if (type != RW_MSG_JOIN_ACK || len != sizeof(rw_join_ack_t)) {
             fprintf(stderr, "client: expected JOIN_ACK, got type=%u len=%u\n", type, len);
-            if (len) skip_payload(fd, len);
-            close(fd);
+                close(fd);
             return 1;
         }
 
         rw_join_ack_t ja;
-        if (rw_recv_all(fd, &ja, sizeof(ja)) < 0) die("rw_recv_all(JOIN_ACK)");
+        memcpy(&ja, p, sizeof(ja));
         if (!ja.ok) {
             fprintf(stderr, "JOIN denied by server\n");
             close(fd);
@@ -665,41 +1317,88 @@ int main(int argc, char **argv) {
             return 1;
         }
 
-        if (rw_send_msg(fd, RW_MSG_CREATE_SIM, &req, (uint16_t)sizeof(req)) < 0)
-            die("rw_send_msg(CREATE_SIM)");
+        if (rw_conn_send(&conn, RW_MSG_CREATE_SIM, &req, (uint16_t)sizeof(req)) < 0)
+            die("rw_conn_send(CREATE_SIM)");
 
-        if (rw_recv_hdr(fd, &type, &len) < 0) die("rw_recv_hdr(CREATE_ACK)");
+        if (rw_conn_recv(&conn, &type, &p, &len) < 0) die("rw_conn_recv(CREATE_ACK)");
         if (type != RW_MSG_CREATE_ACK || len != sizeof(rw_create_ack_t)) {
             fprintf(stderr, "client: expected CREATE_ACK, got type=%u len=%u\n", type, len);
-            if (len) skip_payload(fd, len);
-            close(fd);
+                close(fd);
             return 1;
         }
 
         rw_create_ack_t ack;
-        if (rw_recv_all(fd, &ack, sizeof(ack)) < 0) die("rw_recv_all(create_ack)");
+        memcpy(&ack, p, sizeof(ack));
         printf("client: CREATE_ACK ok=%u sim_id=%u\n", ack.ok, ack.sim_id);
         if (!ack.ok) { close(fd); return 1; }
 
         start_mode = req.initial_mode;
     }
 
+    // a local server may publish the states in shared memory: then TCP carries only the control messages
+    rw_shm_state_t shm;
+    int have_shm = 0;
+    if (use_shm) {
+        char shm_name[64];
+        rw_shm_state_name(shm_name, sizeof(shm_name), port);
+        if (rw_shm_state_open(&shm, shm_name) == 0) {
+            have_shm = 1;
+            printf("client: reading states from shared memory %s\n", shm_name);
+        } else {
+            fprintf(stderr, "client: no shared-memory states at %s (%s), using TCP\n", shm_name, strerror(errno));
+        }
+    }
+
+    // summary viewers mostly see a few changed cells per tick: ask for deltas and compact keyframes (or states
+    // without the WORLD sent at join), or the changed tiles (an older server ignores this)
+    rw_state_opts_req_t so = { .flags = RW_STATE_OPT_DELTA | RW_STATE_OPT_COMPACT | RW_STATE_OPT_WORLD |
+                                        (q16 ? RW_STATE_OPT_Q16 : 0u) | (tiles ? RW_STATE_OPT_TILES : 0u) |
+                                        (have_shm ? RW_STATE_OPT_SHM : 0u) };
+    if (rw_conn_queue(&conn, RW_MSG_SET_STATE_OPTS, &so, (uint16_t)sizeof(so)) < 0) die("rw_conn_queue(SET_STATE_OPTS)");
+
+    // a viewport, rate or field limit makes the server send only that (STATE_RECT); shared memory has everything
+    // already, the viewport is then applied here
+    if (!have_shm && (have_viewport || min_interval_ms || fields != RW_FIELD_ALL)) {
+        rw_subscribe_req_t sub = { .x = (uint16_t)viewport.x, .y = (uint16_t)viewport.y,
+                                   .w = (uint16_t)(viewport.w < UINT16_MAX ? viewport.w : UINT16_MAX),
+                                   .h = (uint16_t)(viewport.h < UINT16_MAX ? viewport.h : UINT16_MAX),
+                                   .min_interval_ms = min_interval_ms, .fields = fields };
+        if (rw_conn_queue(&conn, RW_MSG_SUBSCRIBE, &sub, (uint16_t)sizeof(sub)) < 0) die("rw_conn_queue(SUBSCRIBE)");
+    }
+    if (rw_conn_flush(&conn, NULL, 0) < 0) die("rw_conn_flush");
+
     // Threads
     client_ctx_t ctx;
-    ctx.fd = fd;
+    ctx.conn = &conn;
+    pthread_mutex_init(&ctx.lock, NULL);
+    ctx.host = host;
+    ctx.port = port;
+    ctx.token = hello.session_token;
+    ctx.shm = have_shm ? &shm : NULL;
+    ctx.viewport = have_viewport ? &viewport : NULL;
     atomic_init(&ctx.mode, (int)start_mode);
     atomic_init(&ctx.view, (int)RW_VIEW_AVG_STEPS);
     atomic_init(&ctx.stop, 0);
+    atomic_init(&ctx.finished, 0);
 
     pthread_t th_recv, th_in;
     if (pthread_create(&th_recv, NULL, receiver_thread, &ctx) != 0) die("pthread_create(recv)");
     if (pthread_create(&th_in, NULL, input_thread, &ctx) != 0) die("pthread_create(input)");
+    pthread_t th_shm;
+    if (have_shm && pthread_create(&th_shm, NULL, shm_thread, &ctx) != 0) die("pthread_create(shm)");
 
+    // the receiver may have replaced the connection (and its socket) while resuming
     pthread_join(th_recv, NULL);
     atomic_store(&ctx.stop, 1);
-    shutdown(fd, SHUT_RDWR);
+    shutdown(conn.fd, SHUT_RDWR);
     pthread_join(th_in, NULL);
+    if (have_shm) {
+        pthread_join(th_shm, NULL);
+        rw_shm_state_close(&shm);
+    }
 
-    close(fd);
+    rw_conn_free(&conn);
+    close(conn.fd);
+    pthread_mutex_destroy(&ctx.lock);
     return 0;
 }
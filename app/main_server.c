@@ -1,407 +1,792 @@
-// app/main_server.c (multi-client via poll)
+// app/main_server.c (multi-client via epoll)
+#define _GNU_SOURCE
 #include "common/socket.h"
+#include "common/conn.h"
 #include "common/protocol.h"
+#include "common/result_cache.h"
+#include "common/state_codec.h"
+#include "common/shm_state.h"
+#include "engine/engine.h"
+#include "engine/par_sim.h"
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include <string.h>
 #include <unistd.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <sys/socket.h>
-#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/resource.h>
+#include <sys/random.h>
 #include <time.h>
 #include <getopt.h>
 
-#define MAX_CLIENTS 16
+#define MAX_CLIENTS_DEFAULT 4096     // connected clients; the client table grows up to this
+#define JOB_MAX_SUBSCRIBERS 16       // clients waiting for the end of one job
+#define EPOLL_BATCH 256              // events taken per epoll_wait
+#define CLIENT_READS_PER_WAKE 8      // reads per client before the others get their turn
 #define TICK_MS 200
+#define SIM_STEPS_PER_TICK 1000000u  // statistics budget per tick, independent of the display mode
+#define CACHE_DIR_DEFAULT "data/cache"
+#define CACHE_MAX_MB_DEFAULT 256
+#define JOB_STEPS_PER_SLICE 250000u  // steps per running job between two event waits, keeps the sockets responsive
+#define JOB_SLOTS_DEFAULT 1
+#define JOB_HISTORY_MAX 4096         // finished jobs kept for status queries before the oldest are forgotten
+#define STATE_KEYFRAME_EVERY 50      // deltas in a row before a delta client gets a full STATE again
+#define CLIENT_OUTQ_BYTES 65536u     // unsent bytes per client before it is dropped as too slow
+#define CLIENT_INQ_BYTES 4096u       // receive buffer per client; longer messages are rejected
+#define STATE_MSG_MAX (RW_MSG_HDR_SIZE + sizeof(rw_state_msg_t))  // largest STATE / STATE_DELTA / STATE_COMPACT
+#define STATE_TILES_MSG_MAX (RW_MSG_HDR_SIZE + 8192u)  // longest STATE_TILES; tiles beyond it follow with the next states
+#define SLOW_TIMEOUT_DEFAULT 30      // seconds a client may take nothing before it is dropped
+#define SHUTDOWN_DRAIN_MS 1000       // time the last messages get to reach the clients on exit
+#define RESUME_HISTORY 16            // STATE_DELTA messages kept per view for resumed clients (about 3 s of ticks)
+#define RESUME_WINDOW_MS 30000       // time a dropped client has to RESUME
+#define RESUME_PARKED_MAX 256        // dropped clients remembered at once; the oldest go first
+_Static_assert(CLIENT_OUTQ_BYTES >= 2 * STATE_MSG_MAX, "a client's ring must hold a started state and more");
+_Static_assert(RW_MSG_HDR_SIZE + RW_STATE_RECT_MAX <= STATE_MSG_MAX, "a STATE_RECT fits a client's pending state");
+_Static_assert(RW_MSG_HDR_SIZE + RW_STATE_DYN_MAX <= STATE_MSG_MAX, "a STATE_DYN fits a client's pending state");
+_Static_assert(STATE_TILES_MSG_MAX <= STATE_MSG_MAX, "a STATE_TILES fits a client's pending state");
+_Static_assert(RW_MSG_HDR_SIZE + sizeof(rw_state_tiles_hdr_t) + 4 * RW_MAX_PATH + sizeof(rw_state_tile_hdr_t) +
+               RW_STATE_TILE * RW_STATE_TILE * 5 <= STATE_TILES_MSG_MAX, "a STATE_TILES holds at least one tile");
+_Static_assert(RW_MSG_HDR_SIZE + sizeof(rw_submit_job_req_t) <= CLIENT_INQ_BYTES, "largest request must fit the receive buffer");
+_Static_assert(RW_MSG_HDR_SIZE + sizeof(rw_query_cells_req_t) + RW_QUERY_CELLS_MAX * 2 * sizeof(uint16_t) <=
+               CLIENT_INQ_BYTES, "a full QUERY_CELLS must fit the receive buffer");
+_Static_assert(RW_MSG_HDR_SIZE + RW_QUERY_RESULT_MAX + STATE_MSG_MAX <= CLIENT_OUTQ_BYTES,
+               "a QUERY_RESULT fits a client's ring next to a started state");
 
 //Prints a system error message (via perror) and terminates the server process immediately.
-// Used for failures the server can’t recover from (e.g., listen socket setup, poll failure).
+// Used for failures the server can’t recover from (e.g., listen socket setup, epoll failure).
 static void die(const char *msg) { perror(msg); exit(1); }
 
-//Packs an error code + short text into an RW_MSG_ERROR message and sends it to a client using the common message framing (header + payload).
-static int send_error(int fd, int32_t code, const char *msg) {
-    rw_error_msg_t e;
-    memset(&e, 0, sizeof(e));
-    e.code = code;
-    snprintf(e.msg, sizeof(e.msg), "%s", msg);
-    return rw_send_msg(fd, RW_MSG_ERROR, &e, (uint16_t)sizeof(e));
-}
-
-//Reads and discards len bytes from the socket. 
-//This keeps the stream aligned when the server receives an unknown message type or payload it doesn’t want to parse.
-static void skip_payload(int fd, uint16_t len) {
-    char tmp[1024];
-    uint16_t remaining = len;
-    while (remaining > 0) {
-        uint16_t chunk = remaining > sizeof(tmp) ? sizeof(tmp) : remaining;
-        if (rw_recv_all(fd, tmp, chunk) < 0) return;
-        remaining -= chunk;
-    }
-}
-
-//Converts 2D coordinates (x, y) into a 1D array index for the grid-based buffers (cell statistics, obstacles, etc.).
-static inline uint32_t idx(uint32_t x, uint32_t y) { return y * RW_MAX_W + x; }
-
-//Randomly selects a movement direction (up/down/left/right) according to the configured probabilities.
-//Uses rand_r with a per-simulation seed so the simulation can run without global RNG state.
-static int pick_dir(uint32_t p_up, uint32_t p_down, uint32_t p_left, uint32_t p_right, unsigned int *seed) {
-    uint32_t r = (uint32_t)(rand_r(seed) % RW_PROB_SCALE);
-    uint32_t c = 0;
-    c += p_up;   if (r < c) return 0;
-    c += p_down; if (r < c) return 1;
-    c += p_left; if (r < c) return 2;
-    (void)p_right;
-    return 3;
-}
-
-//Applies one movement step in the chosen direction and wraps around the edges 
-//(“world without obstacles” wrap behavior: going off one side reappears on the opposite side).
-static void step_wrap(uint32_t w, uint32_t h, int *x, int *y, int dir) {
-    int nx = *x, ny = *y;
-    switch (dir) {
-        case 0: ny -= 1; break;
-        case 1: ny += 1; break;
-        case 2: nx -= 1; break;
-        case 3: nx += 1; break;
-        default: break;
-    }
-    if (w > 0) {
-        if (nx < 0) nx += (int)w;
-        if (nx >= (int)w) nx -= (int)w;
-    }
-    if (h > 0) {
-        if (ny < 0) ny += (int)h;
-        if (ny >= (int)h) ny -= (int)h;
-    }
-    *x = nx; *y = ny;
-}
-
-// ---- Simulation state (one global sim) ----
-typedef struct {
-    int created;
-
-    // config
-    uint32_t w, h, K, rep_total;
-    uint32_t p_up, p_down, p_left, p_right;
-    unsigned int rng_seed;
+//Returns a monotonic timestamp in milliseconds.
+static uint64_t now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000u + (uint64_t)ts.tv_nsec / 1000000u;
+}
 
-    // global control
-    rw_global_mode_t mode_global;
+//Packs an error code + short text into an RW_MSG_ERROR payload.
+static void error_msg(rw_error_msg_t *e, int32_t code, const char *msg) {
+    memset(e, 0, sizeof(*e));
+    e->code = code;
+    snprintf(e->msg, sizeof(e->msg), "%s", msg);
+}
 
-    // progress in summary sense: completed full-grid replications
-    uint32_t rep_done;
+// ---- Threads per simulation ----
+typedef struct {
+    uint32_t threads;             // workers per simulation; 1 = run in the server thread
+    const rw_numa_topo_t *topo;   // CPUs to pin the workers to, NULL = no pinning
+} sim_threads_t;
+
+//Creates a simulation, split into per-thread accumulator shards when several threads are configured and the request
+//allows it (*par is set then and *sim is its merged view). Returns 0, or -1 with errno as for rw_sim_create.
+static int sim_open(const rw_create_sim_req_t *req, const sim_threads_t *T, rw_sim_t **sim, rw_par_sim_t **par) {
+    *par = NULL;
+    if (T->threads > 1 && rw_par_sim_supported(req)) {
+        *sim = NULL;
+        if (rw_par_sim_create(req, T->threads, T->topo, par) < 0) return -1;
+        *sim = rw_par_sim_merged(*par);
+        return 0;
+    }
+    return rw_sim_create(req, sim);
+}
 
-    // accumulators
-    uint64_t steps_sum[RW_MAX_W * RW_MAX_H];
-    uint32_t hit_k_count[RW_MAX_W * RW_MAX_H];
+//Advances a simulation by up to max_steps; the shards of a split one are merged again so *sim shows the new counts.
+static void sim_advance(rw_sim_t **sim, rw_par_sim_t *par, uint64_t max_steps) {
+    if (!par) {
+        rw_sim_run(*sim, max_steps);
+        return;
+    }
+    // an idle (finished) run keeps its merged view, and with it the cached STATE frames
+    if (rw_par_sim_run(par, max_steps) > 0) *sim = rw_par_sim_merged(par);
+}
 
-    // current replication scanning
-    uint32_t cur_cell_x, cur_cell_y;
-    int tx, ty;
-    uint32_t t_steps;
-    int traj_active;
+//Releases a simulation from sim_open.
+static void sim_close(rw_sim_t *sim, rw_par_sim_t *par) {
+    if (par) rw_par_sim_destroy(par);
+    else rw_sim_destroy(sim);
+}
 
-    // last path for interactive
-    uint32_t path_len;
-    int16_t path_x[RW_MAX_PATH];
-    int16_t path_y[RW_MAX_PATH];
+// ---- STATE frames: built at most once per view and tick, the same bytes go to every viewer of that view ----
+typedef struct {
+    unsigned char hdr[RW_MSG_HDR_SIZE];
+    rw_state_msg_t st;
+} state_wire_t;
+_Static_assert(offsetof(state_wire_t, st) == RW_MSG_HDR_SIZE, "STATE frame must be contiguous");
 
-    // represents how many replications were started from specific cell
-    uint32_t samples[RW_MAX_H * RW_MAX_W];
+typedef struct {
+    uint32_t base_seq, seq;       // the delta leads from state base_seq to state seq
+    size_t len;                   // header + payload, 0 = there was no delta (the chain breaks here)
+    unsigned char *msg;           // len bytes (malloc'd), NULL if len is 0
+} state_hist_t;
 
-    // creator id
+typedef struct {
+    int valid;
+    uint64_t version;             // rw_sim_version the frame was built from
+    rw_global_mode_t mode;
+    int stopped;
+    state_wire_t wire;            // header + payload, sent as is; wire.st.seq numbers it
+    uint32_t shm_seq;             // wire.st.seq last published to shared memory (--shm)
+
+    // delta from the frame before (built with the frame, for RW_STATE_OPT_DELTA clients and the history)
+    rw_state_msg_t prev;          // valid if prev.seq != 0
+    uint16_t delta_len;           // payload bytes, 0 = no delta (send the keyframe)
+    unsigned char delta[RW_MSG_HDR_SIZE + RW_STATE_DELTA_MAX];
+
+    // the last RESUME_HISTORY deltas of this view, oldest first from hist_head, for resumed clients
+    state_hist_t hist[RESUME_HISTORY];
+    uint32_t hist_head, hist_count;
+
+    // STATE_COMPACT form of wire.st, exact [0] and quantized [1] (built on first use, for RW_STATE_OPT_COMPACT clients)
+    int compact_built[2];
+    uint16_t compact_len[2];      // payload bytes, 0 = not smaller than STATE (send that)
+    unsigned char compact[2][RW_MSG_HDR_SIZE + RW_STATE_COMPACT_MAX];
+
+    // STATE_DYN form of wire.st (built on first use, for RW_STATE_OPT_WORLD clients)
+    int dyn_built;
+    uint16_t dyn_len;
+    unsigned char dyn[RW_MSG_HDR_SIZE + RW_STATE_DYN_MAX];
+
+    // per-tile change record (brought up to date on first use, for RW_STATE_OPT_TILES clients)
+    uint32_t tile_seq[RW_STATE_TILES_MAX];  // state in which each tile last changed
+    uint32_t tiles_seq;           // wire.st.seq the record is up to date with, 0 = none
+} state_frame_t;
+
+// ---- Session: the one simulation this server runs, plus who controls it ----
+typedef struct {
+    rw_sim_t *sim;                // NULL until CREATE_SIM succeeds; the merged view if par is set
+    rw_par_sim_t *par;            // per-thread shards (--sim-threads), NULL for a serial run
     uint32_t creator_id;
-
+    rw_global_mode_t mode_global;
     char out_file[RW_PATH_MAX];
     int stop_requested;
     int results_written;
-} sim_t;
+    state_frame_t frames[2];      // per view (AVG_STEPS, PROB_K)
+    uint32_t state_seq;           // last STATE sequence number handed out
+    uint64_t world_hash;          // WORLD of the simulation (built on first use), 0 = not built yet
+    size_t world_len;             // header + payload
+    unsigned char world_msg[RW_MSG_HDR_SIZE + RW_WORLD_MAX];
+    unsigned char rect_msg[RW_MSG_HDR_SIZE + RW_STATE_RECT_MAX];  // one subscriber's STATE_RECT, built just before sending
+    unsigned char tiles_msg[STATE_TILES_MSG_MAX];                  // one tiles client's STATE_TILES, likewise
+    unsigned char query_msg[RW_QUERY_RESULT_MAX];                  // one QUERY_RESULT payload
+} session_t;
+
+// ---- Job queue: batch simulations submitted with SUBMIT_JOB, run next to the session without STATE streaming ----
+typedef struct {
+    uint32_t id;                  // also the FIFO order within a priority
+    int32_t priority;
+    rw_job_state_t state;
+    rw_create_sim_req_t req;
+    rw_sim_t *sim;                // only while RUNNING
+    rw_par_sim_t *par;
+    uint32_t rep_done, rep_total;
+    uint32_t subscribers[JOB_MAX_SUBSCRIBERS]; // client ids waiting for the final JOB_STATUS
+    int nsubs;
+} job_t;
 
+typedef struct {
+    job_t *jobs;                  // ordered by id
+    size_t count, cap;
+    uint32_t next_id;
+    int slots;                    // jobs allowed to run at the same time
+    int closed;                   // no new submissions (server is going to exit)
+} job_queue_t;
 
-//Initializes a new simulation from the CREATE request: 
-//copies world size, probabilities, K, replication count, mode, output filename, and records who created the simulation.
-static void sim_init(sim_t *S, const rw_create_sim_req_t *req, uint32_t creator_id) {
-    memset(S, 0, sizeof(*S));
-    S->created = 1;
+// ---- Clients ----
+typedef struct {
+    rw_conn_t conn;               // socket with its receive buffer and send queue
+    uint32_t client_id;
+    uint32_t slot;                // index in the client table
+    int hello_done;
+    int joined;
+    rw_local_view_t view;
+    uint32_t state_opts;          // RW_STATE_OPT_*
+    uint32_t last_seq;            // last state this client holds (0 = none, next one is a keyframe)
+    uint32_t deltas_since_key;
+    rw_subscribe_req_t sub;       // SUBSCRIBE: with sub.fields != 0 the client gets STATE_RECT instead of STATE
+    uint64_t sub_next_ms;         // now_ms() from which the next STATE_RECT may go out
+    uint64_t token;               // session token from HELLO_ACK (0 = none): a RESUME with it takes this client over
+    uint32_t resume_seq;          // RESUME of a delta client: the state it last applied, caught up from at the next tick
+    uint32_t tile_have[RW_STATE_TILES_MAX];  // RW_STATE_OPT_TILES: tile_seq of each tile the client holds (0 = none)
+    uint32_t tile_next[RW_STATE_TILES_MAX];  // what it holds once its newest STATE_TILES has started to go out
+
+    int read_ready;               // on the table's ready list: the socket may hold more input
+
+    // output: the socket is written without blocking. conn's send queue holds the committed bytes in order (control
+    // messages, the rest of a started state); the newest state waits beside it until the queue is empty
+    unsigned char *state_msg;     // newest state message not started yet (STATE_MSG_MAX, allocated on first use)
+    size_t state_len;             // 0 = none; a newer state replaces it
+    uint32_t state_msg_seq;
+    uint32_t sent_seq;            // newest state that went out (or is committed to out)
+    uint32_t skipped;             // states replaced before they went out, in a row
+    uint64_t stalled_since;       // now_ms() when output began waiting without progress, 0 = not waiting
+} client_t;
 
-    S->w = req->w; S->h = req->h; S->K = req->K; S->rep_total = req->rep_total;
-    S->p_up = req->p_up; S->p_down = req->p_down; S->p_left = req->p_left; S->p_right = req->p_right;
-    S->rng_seed = (unsigned int)time(NULL) ^ (unsigned int)getpid();
-    S->mode_global = req->initial_mode;
+// ---- Parked clients: what a dropped client gets back with RESUME ----
+typedef struct {
+    uint64_t token;
+    uint32_t client_id;
+    int joined;
+    rw_local_view_t view;
+    uint32_t state_opts;
+    rw_subscribe_req_t sub;
+    uint64_t parked_ms;           // now_ms() when the connection was closed
+} parked_t;
 
-    S->rep_done = 0;
-    S->cur_cell_x = 0; S->cur_cell_y = 0;
-    S->traj_active = 0;
-    S->path_len = 0;
+// ---- Client table: clients are allocated one by one (their address never changes), slots come from a free list ----
+typedef struct {
+    client_t **slot;              // slot[i] is NULL while free
+    uint32_t cap;                 // slots so far; grows up to max
+    uint32_t max;
+    uint32_t count;               // connected clients
+    uint32_t *free;               // free slot numbers (a stack)
+    uint32_t nfree;
+    uint64_t *ready;              // client_key of clients with input left after their last read; may hold stale keys
+    size_t nready, ready_cap;
+    parked_t parked[RESUME_PARKED_MAX];  // closed clients that may RESUME, oldest first
+    uint32_t nparked;
+} client_table_t;
+
+// epoll keys: a client's key has its id (never 0) in the high half, so these two cannot be clients
+#define EV_LISTEN 0u
+#define EV_TIMER 1u
+
+//Returns the epoll key of a client: id and slot, so an event for a closed client never reaches the slot's next owner.
+static uint64_t client_key(const client_t *c) {
+    return (uint64_t)c->client_id << 32 | c->slot;
+}
 
-    S->creator_id = creator_id;
+//Returns the client an epoll key or ready-list entry refers to, or NULL if it is gone.
+static client_t *client_lookup(const client_table_t *CT, uint64_t key) {
+    uint32_t slot = (uint32_t)key;
+    client_t *c = slot < CT->cap ? CT->slot[slot] : NULL;
+    return (c && c->client_id == (uint32_t)(key >> 32)) ? c : NULL;
+}
 
-    snprintf(S->out_file, sizeof(S->out_file), "%s", req->out_file);
-    S->stop_requested = 0;
-    S->results_written = 0;
+//Takes a free slot for a new connection, growing the table if needed. Returns NULL if the server is full
+//(errno = ENOSPC) or out of memory.
+static client_t *client_add(client_table_t *CT, int fd, uint32_t client_id) {
+    if (CT->count >= CT->max) { errno = ENOSPC; return NULL; }
+    if (CT->nfree == 0) {
+        uint32_t cap = CT->cap ? CT->cap * 2 : 64;
+        if (cap > CT->max) cap = CT->max;
+        client_t **slot = realloc(CT->slot, cap * sizeof(*slot));
+        if (!slot) { errno = ENOMEM; return NULL; }
+        CT->slot = slot;
+        uint32_t *fl = realloc(CT->free, cap * sizeof(*fl));
+        if (!fl) { errno = ENOMEM; return NULL; }
+        CT->free = fl;
+        for (uint32_t i = cap; i > CT->cap; i--) {
+            CT->slot[i - 1] = NULL;
+            CT->free[CT->nfree++] = i - 1;
+        }
+        CT->cap = cap;
+    }
+    client_t *c = calloc(1, sizeof(*c));
+    if (!c) { errno = ENOMEM; return NULL; }
+    if (rw_conn_init(&c->conn, fd, CLIENT_INQ_BYTES, CLIENT_OUTQ_BYTES) < 0) { free(c); return NULL; }
+    c->client_id = client_id;
+    c->slot = CT->free[--CT->nfree];
+    c->view = RW_VIEW_AVG_STEPS;
+    CT->slot[c->slot] = c;
+    CT->count++;
+    return c;
 }
 
-//Starts a new walk from the current starting cell, resets the step counter, and begins recording the trajectory for interactive display.
-static void start_traj(sim_t *S) {
-    S->tx = (int)S->cur_cell_x;
-    S->ty = (int)S->cur_cell_y;
-    S->t_steps = 0;
-    S->traj_active = 1;
+//Remembers a closing client's session under its token for RESUME_WINDOW_MS, dropping expired entries and, if the
+//table is full, the oldest.
+static void client_park(client_table_t *CT, const client_t *c) {
+    const uint64_t now = now_ms();
+    uint32_t keep = 0;
+    for (uint32_t i = 0; i < CT->nparked; i++) {
+        if (now - CT->parked[i].parked_ms < RESUME_WINDOW_MS) CT->parked[keep++] = CT->parked[i];
+    }
+    CT->nparked = keep;
+    if (CT->nparked == RESUME_PARKED_MAX) {
+        memmove(&CT->parked[0], &CT->parked[1], (RESUME_PARKED_MAX - 1) * sizeof(parked_t));
+        CT->nparked--;
+    }
+    CT->parked[CT->nparked++] = (parked_t){
+        .token = c->token, .client_id = c->client_id, .joined = c->joined, .view = c->view,
+        .state_opts = c->state_opts, .sub = c->sub, .parked_ms = now
+    };
+}
 
-    S->path_len = 0;
-    if (S->path_len < RW_MAX_PATH) {
-        S->path_x[S->path_len] = (int16_t)S->tx;
-        S->path_y[S->path_len] = (int16_t)S->ty;
-        S->path_len++;
+//Takes the parked session of a token out of the table. Returns 0 if it was there and not expired, -1 if not.
+static int client_unpark(client_table_t *CT, uint64_t token, parked_t *out) {
+    for (uint32_t i = 0; i < CT->nparked; i++) {
+        if (CT->parked[i].token != token) continue;
+        *out = CT->parked[i];
+        memmove(&CT->parked[i], &CT->parked[i + 1], (CT->nparked - i - 1) * sizeof(parked_t));
+        CT->nparked--;
+        return now_ms() - out->parked_ms < RESUME_WINDOW_MS ? 0 : -1;
     }
+    return -1;
 }
 
-//Finalizes one walk result for the current starting cell (stores steps-to-center, updates hit-within-K stats), 
-//then advances to the next cell and tracks when a full-grid replication is complete.
-static void finish_traj_advance(sim_t *S, uint32_t steps_to_hit, int hit_within_k) {
-    uint32_t i = idx(S->cur_cell_x, S->cur_cell_y);
-    S->steps_sum[i] += steps_to_hit;
-    S->samples[i]++;
-    if (hit_within_k) S->hit_k_count[i]++;
+//Closes a client socket (which also removes it from epoll), releases its buffers and returns its slot to the free
+//list. A client with a session token is parked, so it can RESUME over a new connection.
+static void client_close(client_table_t *CT, client_t *c) {
+    if (c->token) client_park(CT, c);
+    close(c->conn.fd);
+    rw_conn_free(&c->conn);
+    free(c->state_msg);
+    CT->slot[c->slot] = NULL;
+    CT->free[CT->nfree++] = c->slot;
+    CT->count--;
+    free(c);
+}
 
-    // advance cell
-    S->cur_cell_x++;
-    if (S->cur_cell_x >= S->w) {
-        S->cur_cell_x = 0;
-        S->cur_cell_y++;
-        if (S->cur_cell_y >= S->h) {
-            S->cur_cell_y = 0;
-            S->rep_done++; // one full-grid replication finished
-        }
+//Puts a client on the ready list (input left to read) once.
+static void client_mark_ready(client_table_t *CT, client_t *c) {
+    if (c->read_ready) return;
+    if (CT->nready == CT->ready_cap) {
+        size_t cap = CT->ready_cap ? CT->ready_cap * 2 : 64;
+        uint64_t *r = realloc(CT->ready, cap * sizeof(*r));
+        if (!r) return;   // the next input edge brings it back
+        CT->ready = r;
+        CT->ready_cap = cap;
     }
+    CT->ready[CT->nready++] = client_key(c);
+    c->read_ready = 1;
+}
 
-    S->traj_active = 0;
+//Records whether output is waiting and since when the client has been taking none of it.
+static void client_track_stall(client_t *c, int progress) {
+    if (c->conn.out_len == 0 && c->state_len == 0) c->stalled_since = 0;
+    else if (progress || c->stalled_since == 0) c->stalled_since = now_ms();
 }
 
-//Advances the simulation by a limited “budget” of steps. In interactive mode it moves slowly (so clients can see the path), 
-//and in summary mode it runs faster. Stops a trajectory as soon as it reaches the center [0,0].
-static void sim_do_steps(sim_t *S, uint32_t budget) {
-    if (!S->created) return;
-    if (S->rep_done >= S->rep_total) return;
+//Commits the unsent rest of a state message that has started to go out to the send queue.
+static void client_state_started(client_t *c, const unsigned char *msg, size_t len, size_t sent, uint32_t seq) {
+    // the queue is empty once a state starts, and it holds at least one state message
+    (void)rw_conn_queue_bytes(&c->conn, msg + sent, len - sent);
+    c->sent_seq = seq;
+    c->skipped = 0;
+    if (c->state_opts & RW_STATE_OPT_TILES) memcpy(c->tile_have, c->tile_next, sizeof(c->tile_have));
+}
 
-    if (!S->traj_active) start_traj(S);
+//Forgets which state the client holds: the next one it gets is complete (a keyframe, or every tile).
+static void client_state_reset(client_t *c) {
+    c->last_seq = 0;
+    memset(c->tile_have, 0, sizeof(c->tile_have));
+    memset(c->tile_next, 0, sizeof(c->tile_next));
+}
 
-    // if already at [0,0]
-    if (S->tx == 0 && S->ty == 0) {
-        finish_traj_advance(S, 0, 1);
-        return;
+//Writes as much queued output as the socket takes, the send queue and the pending state in one sendmsg().
+//Returns 0, or -1 on a socket error.
+static int client_flush(client_t *c) {
+    size_t queued = c->conn.out_len;
+    ssize_t k = rw_conn_flush(&c->conn, c->state_len ? c->state_msg : NULL, c->state_len);
+    if (k < 0) return -1;
+    if (k > 0) {
+        client_state_started(c, c->state_msg, c->state_len, (size_t)k, c->state_msg_seq);
+        c->state_len = 0;
     }
+    client_track_stall(c, k > 0 || c->conn.out_len < queued);
+    return 0;
+}
 
-    for (uint32_t n = 0; n < budget; n++) {
-        int dir = pick_dir(S->p_up, S->p_down, S->p_left, S->p_right, &S->rng_seed);
-        step_wrap(S->w, S->h, &S->tx, &S->ty, dir);
-        S->t_steps++;
+//Queues a control message behind the client's earlier output. It goes out with the next flush, together with
+//everything else queued by then. Returns 0 on success, -1 if the client has too much unsent output.
+static int client_send(client_t *c, uint16_t type, const void *payload, uint16_t len) {
+    return rw_conn_queue(&c->conn, type, payload, len);
+}
 
-        if (S->path_len < RW_MAX_PATH) {
-            S->path_x[S->path_len] = (int16_t)S->tx;
-            S->path_y[S->path_len] = (int16_t)S->ty;
-            S->path_len++;
+//Sends a state message behind the queued output, straight from the shared frame when no older state is waiting,
+//otherwise as the client's pending state, replacing one that has not started yet. Returns 0 on success, -1 on a
+//socket error.
+static int client_send_state(client_t *c, const void *msg, size_t len, uint32_t seq) {
+    const int tried = c->state_len == 0;
+    int progress = 0;
+    if (tried) {
+        size_t queued = c->conn.out_len;
+        ssize_t k = rw_conn_flush(&c->conn, msg, len);
+        if (k < 0) return -1;
+        if (k > 0) {
+            client_state_started(c, msg, len, (size_t)k, seq);
+            client_track_stall(c, 1);
+            return 0;
         }
+        progress = c->conn.out_len < queued;
+    }
+    if (!c->state_msg && !(c->state_msg = malloc(STATE_MSG_MAX))) return -1;
+    if (c->state_len > 0) c->skipped++;
+    memcpy(c->state_msg, msg, len);
+    c->state_len = len;
+    c->state_msg_seq = seq;
+    if (tried) {
+        // the socket just took all it could
+        client_track_stall(c, progress);
+        return 0;
+    }
+    return client_flush(c);
+}
 
-        if (S->tx == 0 && S->ty == 0) {
-            int hitK = (S->t_steps <= S->K) ? 1 : 0;
-            finish_traj_advance(S, S->t_steps, hitK);
-            return;
-        }
+//Drops the session's STATE frames and the delta history they keep, so the next state of each view is built afresh.
+static void session_frames_reset(session_t *S) {
+    for (int v = 0; v < 2; v++) {
+        for (uint32_t i = 0; i < RESUME_HISTORY; i++) free(S->frames[v].hist[i].msg);
     }
+    memset(S->frames, 0, sizeof(S->frames));
 }
 
-// Builds a RW_MSG_STATE snapshot for a client: progress, mode, finished flag, optional trajectory path (interactive mode),
-// and the per-cell values depending on the client’s chosen view (average steps vs probability of reaching center within K).
-static void build_state_for_view(sim_t *S, rw_local_view_t view, rw_state_msg_t *st_out) {
-    rw_state_msg_t st;
-    memset(&st, 0, sizeof(st));
-
-    st.w = S->w;
-    st.h = S->h;
-    st.rep_done = S->rep_done;
-    st.rep_total = S->rep_total;
-    st.mode = S->mode_global;
-    st.finished = (S->stop_requested || (S->rep_done >= S->rep_total)) ? 1u : 0u;
-
-    // interactive path is same for everyone (last/ongoing traj)
-    if (S->mode_global == RW_MODE_INTERACTIVE) {
-        st.path_len = S->path_len;
-        for (uint32_t i = 0; i < st.path_len; i++) {
-            st.path_x[i] = S->path_x[i];
-            st.path_y[i] = S->path_y[i];
-        }
-    } else {
-        st.path_len = 0;
-    }
-
-    // obstacles none now
-    for (uint32_t y = 0; y < st.h; y++) {
-        for (uint32_t x = 0; x < st.w; x++) {
-            st.obstacle[idx(x, y)] = 0;
-        }
-    }
-
-    if (S->rep_done == 0) {
-        // nothing yet
-        for (uint32_t y = 0; y < st.h; y++)
-            for (uint32_t x = 0; x < st.w; x++)
-                st.cell_value[idx(x, y)] = 0;
-    } else if (view == RW_VIEW_AVG_STEPS) {
-        for (uint32_t y = 0; y < st.h; y++) {
-            for (uint32_t x = 0; x < st.w; x++) {
-                uint32_t i = idx(x, y);
-                uint64_t avg = S->steps_sum[i] / (uint64_t)S->samples[i];
-                st.cell_value[i] = (uint32_t)(avg * 1000ULL);
-            }
-        }
-    } else {
-        for (uint32_t y = 0; y < st.h; y++) {
-            for (uint32_t x = 0; x < st.w; x++) {
-                uint32_t i = idx(x, y);
-                uint32_t prob = (uint32_t)((uint64_t)S->hit_k_count[i] * RW_PROB_SCALE / S->samples[i]);
-                st.cell_value[i] = prob;
-            }
-        }
+//Returns the session's WORLD message, building it on first use: grid size, world type and obstacles stay the same
+//for the whole run.
+static const unsigned char *session_world(session_t *S, size_t *msg_len) {
+    if (S->world_len == 0) {
+        rw_state_msg_t st;
+        rw_sim_info_t info;
+        rw_sim_snapshot(S->sim, RW_VIEW_AVG_STEPS, 0, &st);
+        rw_sim_get_info(S->sim, &info);
+        size_t n = rw_world_encode(&st, info.world_type, &S->world_hash, S->world_msg + RW_MSG_HDR_SIZE, RW_WORLD_MAX);
+        rw_pack_hdr(S->world_msg, RW_MSG_WORLD, (uint16_t)n);
+        S->world_len = RW_MSG_HDR_SIZE + n;
     }
+    *msg_len = S->world_len;
+    return S->world_msg;
+}
 
-    *st_out = st;
+//Queues the session's WORLD for a client that has just joined.
+static int send_world(client_t *c, session_t *S) {
+    size_t n;
+    const unsigned char *m = session_world(S, &n);
+    return rw_conn_queue_bytes(&c->conn, m, n);
 }
 
-//Writes the final results into the requested output file in two sections: average steps per cell and probability-to-hit-within-K per cell.
-// Ensures results are written only once.
-static int write_results_to_file(sim_t *S) {
-    if (!S->created) return -1;
-    if (S->results_written) return 0;
+//Queues an RW_MSG_ERROR (code 0 = information) for a client.
+static int send_error(client_t *c, int32_t code, const char *msg) {
+    rw_error_msg_t e;
+    error_msg(&e, code, msg);
+    return client_send(c, RW_MSG_ERROR, &e, (uint16_t)sizeof(e));
+}
 
-    FILE *f = fopen(S->out_file, "w");
-    if (!f) return -1;
+//Returns the job with the given id, or NULL if it was never submitted or has been forgotten.
+static job_t *job_find(job_queue_t *Q, uint32_t id) {
+    for (size_t i = 0; i < Q->count; i++)
+        if (Q->jobs[i].id == id) return &Q->jobs[i];
+    return NULL;
+}
 
-    // Header
-    fprintf(f, "# Random Walk results\n");
-    fprintf(f, "# w=%u h=%u K=%u rep_done=%u rep_total=%u\n",
-            S->w, S->h, S->K, S->rep_done, S->rep_total);
-    fprintf(f, "# Prob scale: %u\n\n", (unsigned)RW_PROB_SCALE);
+//Returns 1 while a job is queued or running.
+static int job_active(const job_t *j) {
+    return j->state == RW_JOB_QUEUED || j->state == RW_JOB_RUNNING;
+}
 
-    // AVG_STEPS
-fprintf(f, "[AVG_STEPS]\n");
-for (uint32_t y = 0; y < S->h; y++) {
-    for (uint32_t x = 0; x < S->w; x++) {
-        uint32_t i = idx(x, y);
-        double avg = 0.0;
-        uint32_t s = (uint32_t)S->samples[i];
-        if (s > 0) {
-            avg = (double)S->steps_sum[i] / (double)s;
+//Returns 1 if no job is queued or running.
+static int jobs_idle(const job_queue_t *Q) {
+    for (size_t i = 0; i < Q->count; i++)
+        if (job_active(&Q->jobs[i])) return 0;
+    return 1;
+}
+
+//Returns 1 if the session or an unfinished job already writes to path (two runs would overwrite each other).
+static int out_file_in_use(const job_queue_t *Q, const session_t *S, const char *path) {
+    if (S->sim && strcmp(S->out_file, path) == 0) return 1;
+    for (size_t i = 0; i < Q->count; i++)
+        if (job_active(&Q->jobs[i]) && strcmp(Q->jobs[i].req.out_file, path) == 0) return 1;
+    return 0;
+}
+
+//Drops the oldest finished job once more than JOB_HISTORY_MAX are kept, so a persistent server does not grow without bound.
+static void jobs_prune(job_queue_t *Q) {
+    size_t finished = 0, oldest = Q->count;
+    for (size_t i = 0; i < Q->count; i++) {
+        if (job_active(&Q->jobs[i])) continue;
+        if (oldest == Q->count) oldest = i;
+        finished++;
+    }
+    if (finished <= JOB_HISTORY_MAX) return;
+    memmove(&Q->jobs[oldest], &Q->jobs[oldest + 1], (Q->count - oldest - 1) * sizeof(job_t));
+    Q->count--;
+}
+
+//Appends a validated request to the queue. Returns the new job id, 0 if out of memory.
+static uint32_t job_submit(job_queue_t *Q, int32_t priority, const rw_create_sim_req_t *req) {
+    jobs_prune(Q);
+    if (Q->count == Q->cap) {
+        size_t cap = Q->cap ? Q->cap * 2 : 16;
+        job_t *jobs = realloc(Q->jobs, cap * sizeof(job_t));
+        if (!jobs) return 0;
+        Q->jobs = jobs;
+        Q->cap = cap;
+    }
+    job_t *j = &Q->jobs[Q->count++];
+    memset(j, 0, sizeof(*j));
+    j->id = Q->next_id++;
+    j->priority = priority;
+    j->state = RW_JOB_QUEUED;
+    j->req = *req;
+    j->rep_total = req->rep_total;
+    return j->id;
+}
+
+//Fills a JOB_STATUS message; an unknown id gives state RW_JOB_UNKNOWN.
+static void job_fill_status(job_queue_t *Q, uint32_t id, rw_job_status_t *st) {
+    memset(st, 0, sizeof(*st));
+    st->job_id = id;
+    const job_t *j = job_find(Q, id);
+    if (!j) return;
+    st->state = j->state;
+    st->priority = j->priority;
+    st->rep_done = j->rep_done;
+    st->rep_total = j->rep_total;
+    snprintf(st->out_file, sizeof(st->out_file), "%s", j->req.out_file);
+    if (j->state != RW_JOB_QUEUED) return;
+    for (size_t i = 0; i < Q->count; i++) {
+        const job_t *o = &Q->jobs[i];
+        if (o->state != RW_JOB_QUEUED || o == j) continue;
+        if (o->priority > j->priority || (o->priority == j->priority && o->id < j->id)) st->queue_pos++;
+    }
+}
+
+//Sends the final JOB_STATUS of a finished job to every subscriber that is still connected.
+static void job_notify(job_queue_t *Q, job_t *j, client_table_t *CT) {
+    rw_job_status_t st;
+    job_fill_status(Q, j->id, &st);
+    for (uint32_t i = 0; i < CT->cap && j->nsubs > 0; i++) {
+        client_t *c = CT->slot[i];
+        if (!c) continue;
+        for (int s = 0; s < j->nsubs; s++) {
+            if (c->client_id != j->subscribers[s]) continue;
+            if (client_send(c, RW_MSG_JOB_STATUS, &st, (uint16_t)sizeof(st)) < 0 || client_flush(c) < 0) {
+                printf("server: drop client %u (send failed)\n", c->client_id);
+                client_close(CT, c);
+            }
+            break;
         }
-        fprintf(f, "%.3f%s", avg, (x + 1 == S->w) ? "" : " ");
     }
-    fprintf(f, "\n");
+    j->nsubs = 0;
 }
 
-// PROB_K
-fprintf(f, "\n[PROB_K]\n");
-for (uint32_t y = 0; y < S->h; y++) {
-    for (uint32_t x = 0; x < S->w; x++) {
-        uint32_t i = idx(x, y);
-        double p = 0.0;
-        uint32_t s = (uint32_t)S->samples[i];
-        if (s > 0) {
-            p = (double)S->hit_k_count[i] / (double)s;
+//Starts queued jobs, highest priority first and FIFO within a priority, until all job slots are busy.
+//A job the engine rejects (e.g. a spectral run without a finite solution) fails right away.
+static void jobs_schedule(job_queue_t *Q, const sim_threads_t *T, const rw_cache_t *cache, client_table_t *CT) {
+    for (;;) {
+        int running = 0;
+        job_t *next = NULL;
+        for (size_t i = 0; i < Q->count; i++) {
+            job_t *j = &Q->jobs[i];
+            if (j->state == RW_JOB_RUNNING) running++;
+            if (j->state != RW_JOB_QUEUED) continue;
+            if (!next || j->priority > next->priority) next = j;
+        }
+        if (!next || running >= Q->slots) return;
+
+        if (sim_open(&next->req, T, &next->sim, &next->par) < 0) {
+            perror("server: job rw_sim_create");
+            next->state = RW_JOB_FAILED;
+            job_notify(Q, next, CT);
+            continue;
         }
-        fprintf(f, "%.6f%s", p, (x + 1 == S->w) ? "" : " ");
+        int loaded = rw_sim_load_cached(next->sim, cache);
+        if (loaded < 0) perror("server: rw_cache_load");
+        rw_sim_info_t info;
+        rw_sim_get_info(next->sim, &info);
+        next->rep_done = info.rep_done;
+        next->state = RW_JOB_RUNNING;
+        printf("server: job %u started (priority %d, %u of %u replications cached)\n",
+               next->id, next->priority, info.rep_done, info.rep_total);
     }
-    fprintf(f, "\n");
 }
 
-    fclose(f);
-    S->results_written = 1;
+//Runs one slice of every running job; a job that completes is exported, cached, released and reported to its subscribers.
+static void jobs_step(job_queue_t *Q, const rw_cache_t *cache, client_table_t *CT) {
+    for (size_t i = 0; i < Q->count; i++) {
+        job_t *j = &Q->jobs[i];
+        if (j->state != RW_JOB_RUNNING) continue;
+
+        sim_advance(&j->sim, j->par, JOB_STEPS_PER_SLICE);
+        rw_sim_info_t info;
+        rw_sim_get_info(j->sim, &info);
+        j->rep_done = info.rep_done;
+        if (!info.finished) continue;
+
+        if (rw_sim_export(j->sim, j->req.out_file) == 0) {
+            j->state = RW_JOB_DONE;
+            printf("server: job %u done, results saved to %s\n", j->id, j->req.out_file);
+        } else {
+            j->state = RW_JOB_FAILED;
+            perror("server: job rw_sim_export");
+        }
+        if (rw_sim_store_cached(j->sim, cache) < 0) perror("server: rw_cache_store");
+        sim_close(j->sim, j->par);
+        j->sim = NULL;
+        j->par = NULL;
+        job_notify(Q, j, CT);
+    }
+}
+
+//Releases the simulations of jobs that never finished (server shutdown).
+static void jobs_free(job_queue_t *Q) {
+    for (size_t i = 0; i < Q->count; i++) sim_close(Q->jobs[i].sim, Q->jobs[i].par);
+    free(Q->jobs);
+    memset(Q, 0, sizeof(*Q));
+}
+
+//Gives a resumed client the session of its token: its old id's rights pass to the new id, view and STATE options come
+//back, and a joined delta client is caught up at the next tick. A connection still holding the token (the server
+//has not noticed it drop yet) is closed first. Returns 0 if the token was known and not expired, -1 if not.
+static int client_resume(client_t *c, const rw_resume_req_t *rq, session_t *S, job_queue_t *Q, client_table_t *CT) {
+    if (rq->session_token == 0) return -1;
+    for (uint32_t i = 0; i < CT->cap; i++) {
+        client_t *o = CT->slot[i];
+        if (o && o != c && o->token == rq->session_token) client_close(CT, o);
+    }
+    parked_t pk;
+    if (client_unpark(CT, rq->session_token, &pk) < 0) return -1;
+
+    if (S->sim && S->creator_id == pk.client_id) S->creator_id = c->client_id;
+    for (size_t i = 0; i < Q->count; i++) {
+        job_t *j = &Q->jobs[i];
+        for (int k = 0; k < j->nsubs; k++) {
+            if (j->subscribers[k] == pk.client_id) j->subscribers[k] = c->client_id;
+        }
+    }
+    c->token = pk.token;
+    c->hello_done = 1;
+    c->joined = pk.joined && S->sim;
+    c->view = pk.view;
+    c->state_opts = pk.state_opts;
+    c->sub = pk.sub;
+    client_state_reset(c);
+    const uint32_t opts = c->state_opts;
+    if (c->joined && (opts & RW_STATE_OPT_DELTA) && !(opts & RW_STATE_OPT_TILES) && c->sub.fields == 0) {
+        c->resume_seq = rq->last_seq;
+    }
+    printf("server: client_id=%u resumed as client_id=%u (%s)\n", pk.client_id, c->client_id,
+           c->joined ? "joined" : "not joined");
     return 0;
 }
 
+//Answers a failed QUERY_CELLS or QUERY_RECT: an ERROR with the reason, then the empty QUERY_RESULT (ok = 0).
+static int send_query_error(client_t *c, uint32_t query_id, int32_t code, const char *msg) {
+    rw_query_result_hdr_t qh = {.query_id = query_id};
+    if (send_error(c, code, msg) < 0) return -1;
+    return client_send(c, RW_MSG_QUERY_RESULT, &qh, (uint16_t)sizeof(qh));
+}
 
-// ---- Clients ----
-typedef struct {
-    int active;
-    int fd;
-    uint32_t client_id;
-    int hello_done;
-    int joined;
-    rw_local_view_t view;
-} client_t;
+//Answers a QUERY_CELLS or QUERY_RECT with the statistics of n cells (xy[k] = x, y; n <= RW_QUERY_CELLS_MAX), read
+//from the simulation as the last tick left it. Returns -1 if the client could not be answered.
+static int send_query_result(client_t *c, session_t *S, uint32_t query_id, const uint16_t (*xy)[2], uint32_t n) {
+    if (!S->sim) return send_query_error(c, query_id, 100, "No simulation to query");
+    rw_sim_info_t info;
+    rw_sim_get_info(S->sim, &info);
+    for (uint32_t k = 0; k < n; k++) {
+        if (xy[k][0] >= info.w || xy[k][1] >= info.h) return send_query_error(c, query_id, 101, "Query cell outside the grid");
+    }
 
-//Closes a client socket (if active) and clears the client slot so it can be reused.
-static void client_close(client_t *c) {
-    if (c->active) close(c->fd);
-    memset(c, 0, sizeof(*c));
-}
-
-//Validates a CREATE_SIM request: checks world bounds, probability sum, replication/K values, 
-//and that the initial mode is one of the supported modes.
-static int validate_create(const rw_create_sim_req_t *r) {
-    if (r->w == 0 || r->h == 0) return 0;
-    if (r->w > RW_MAX_W || r->h > RW_MAX_H) return 0;
-    uint64_t sum = (uint64_t)r->p_up + r->p_down + r->p_left + r->p_right;
-    if (sum != RW_PROB_SCALE) return 0;
-    if (r->rep_total == 0 || r->K == 0) return 0;
-    if (r->initial_mode != RW_MODE_INTERACTIVE && r->initial_mode != RW_MODE_SUMMARY) return 0;
-    return 1;
+    rw_query_result_hdr_t qh = {
+        .query_id = query_id, .ok = 1, .rep_done = info.rep_done, .rep_total = info.rep_total, .K = info.K, .count = n
+    };
+    memcpy(S->query_msg, &qh, sizeof(qh));
+    for (uint32_t k = 0; k < n; k++) {
+        rw_cell_stats_t cs;
+        rw_sim_cell_stats(S->sim, xy[k][0], xy[k][1], &cs);
+        memcpy(S->query_msg + sizeof(qh) + k * sizeof(cs), &cs, sizeof(cs));
+    }
+    return client_send(c, RW_MSG_QUERY_RESULT, S->query_msg, (uint16_t)(sizeof(qh) + n * sizeof(rw_cell_stats_t)));
 }
 
-//Reads a single framed message from a client and handles protocol actions (HELLO, CREATE_SIM, JOIN_SIM, SET_MODE, STOP_SIM, SET_VIEW). 
-//For unknown messages, discards the payload to keep the connection usable.
-static int handle_one_msg(client_t *c, sim_t *S) {
-    uint16_t type = 0, len = 0;
-    if (rw_recv_hdr(c->fd, &type, &len) < 0) return -1;
+//Handles one complete message from a client: protocol actions (HELLO, RESUME, CREATE_SIM, JOIN_SIM, SET_MODE,
+//STOP_SIM, SET_VIEW, the job queue requests SUBMIT_JOB, JOB_STATUS_REQ, JOB_SUBSCRIBE, and the statistics queries
+//QUERY_CELLS, QUERY_RECT). p holds the len payload bytes. Unknown messages, and known ones with the wrong length, are ignored. Returns -1 if the client could not be
+//answered.
+static int handle_msg(client_t *c, uint16_t type, const unsigned char *p, uint16_t len, session_t *S,
+                      job_queue_t *Q, client_table_t *CT, const sim_threads_t *T, const rw_cache_t *cache) {
 
     // HELLO
     if (type == RW_MSG_HELLO && len == 0) {
       if (c->hello_done) return 0;
       c->hello_done = 1;
 
-      rw_hello_ack_t ack = {.client_id = c->client_id};
-      if (rw_send_msg(c->fd, RW_MSG_HELLO_ACK, &ack, (uint16_t)sizeof(ack)) < 0) return -1;
+      // a client that cannot get a token still works, it just cannot RESUME
+      if (getrandom(&c->token, sizeof(c->token), GRND_NONBLOCK) != (ssize_t)sizeof(c->token)) c->token = 0;
+      rw_hello_ack_t ack = {.client_id = c->client_id, .sim_running = S->sim != NULL, .session_token = c->token};
+      if (client_send(c, RW_MSG_HELLO_ACK, &ack, (uint16_t)sizeof(ack)) < 0) return -1;
 
       rw_error_msg_t info;
       memset(&info.msg, 0, sizeof(info.msg));
       info.code = 0;
 
-      if (!S->created) {
+      if (!S->sim) {
       snprintf(info.msg, sizeof(info.msg), "No active simulation, needs to be created!");
       } else {
         snprintf(info.msg, sizeof(info.msg), "Simulation is running. Can be joined!");
       }
 
-      if (rw_send_msg(c->fd, RW_MSG_ERROR, &info, (uint16_t)sizeof(info)) < 0 ) return -1;
+      if (client_send(c, RW_MSG_ERROR, &info, (uint16_t)sizeof(info)) < 0 ) return -1;
 
       return 0;
     }
 
+    // RESUME (instead of HELLO, on a new connection)
+    if (type == RW_MSG_RESUME && len == sizeof(rw_resume_req_t)) {
+        if (c->hello_done) return 0;
+        rw_resume_req_t rq;
+        memcpy(&rq, p, sizeof(rq));
+
+        rw_resume_ack_t ack = {.client_id = c->client_id, .mode_now = S->mode_global};
+        if (client_resume(c, &rq, S, Q, CT) == 0) {
+            ack.ok = 1;
+            ack.joined = (uint32_t)c->joined;
+        }
+        if (client_send(c, RW_MSG_RESUME_ACK, &ack, (uint16_t)sizeof(ack)) < 0) return -1;
+        if (c->joined && send_world(c, S) < 0) return -1;
+        return 0;
+    }
+
 
     // CREATE_SIM (only if sim not created yet)
     if (type == RW_MSG_CREATE_SIM && len == sizeof(rw_create_sim_req_t)) {
         rw_create_sim_req_t req;
-        if (rw_recv_all(c->fd, &req, sizeof(req)) < 0) return -1;
+        memcpy(&req, p, sizeof(req));
 
-        if (S->created) {
-            send_error(c->fd, 20, "Simulation already created; use JOIN_SIM");
+        if (S->sim) {
+            send_error(c, 20, "Simulation already created; use JOIN_SIM");
             rw_create_ack_t nack = {.ok = 0, .sim_id = 0};
-            (void)rw_send_msg(c->fd, RW_MSG_CREATE_ACK, &nack, (uint16_t)sizeof(nack));
+            (void)client_send(c, RW_MSG_CREATE_ACK, &nack, (uint16_t)sizeof(nack));
             return 0;
         }
-        if (!validate_create(&req)) {
-            send_error(c->fd, 21, "CREATE_SIM validation failed");
+        req.out_file[sizeof(req.out_file) - 1] = '\0';
+        if (out_file_in_use(Q, S, req.out_file)) {
+            send_error(c, 25, "out_file is already used by a queued job");
             rw_create_ack_t nack = {.ok = 0, .sim_id = 0};
-            (void)rw_send_msg(c->fd, RW_MSG_CREATE_ACK, &nack, (uint16_t)sizeof(nack));
+            (void)client_send(c, RW_MSG_CREATE_ACK, &nack, (uint16_t)sizeof(nack));
             return 0;
         }
-
-        sim_init(S, &req, c->client_id);
+        if (sim_open(&req, T, &S->sim, &S->par) < 0) {
+            if (errno == EINVAL) send_error(c, 21, "CREATE_SIM validation failed");
+            else if (errno != EDOM) send_error(c, 24, "Out of memory");
+            else if (req.engine == RW_ENGINE_SPECTRAL) send_error(c, 22, "Spectral engine: some cells can never reach [0,0]");
+            else send_error(c, 23, "Control variate: reference solution unavailable");
+            rw_create_ack_t nack = {.ok = 0, .sim_id = 0};
+            (void)client_send(c, RW_MSG_CREATE_ACK, &nack, (uint16_t)sizeof(nack));
+            return 0;
+        }
+        S->creator_id = c->client_id;
+        S->mode_global = req.initial_mode;
+        session_frames_reset(S);
+        snprintf(S->out_file, sizeof(S->out_file), "%s", req.out_file);
+        S->stop_requested = 0;
+        S->results_written = 0;
+
+        int loaded = rw_sim_load_cached(S->sim, cache);
+        if (loaded < 0) {
+            perror("server: rw_cache_load");
+        } else if (loaded > 0) {
+            printf("server: cache hit (%d of %u replications reused)\n", loaded, req.rep_total);
+        }
         c->joined = 1;               // creator auto-joins
         c->view = RW_VIEW_AVG_STEPS;
+        client_state_reset(c);
 
         rw_create_ack_t ack = {.ok = 1, .sim_id = 1};
-        if (rw_send_msg(c->fd, RW_MSG_CREATE_ACK, &ack, (uint16_t)sizeof(ack)) < 0) return -1;
+        if (client_send(c, RW_MSG_CREATE_ACK, &ack, (uint16_t)sizeof(ack)) < 0) return -1;
+        if (send_world(c, S) < 0) return -1;
 
         printf("server: sim created by client_id=%u\n", c->client_id);
         return 0;
@@ -410,28 +795,32 @@ static int handle_one_msg(client_t *c, sim_t *S) {
     // JOIN_SIM
     if (type == RW_MSG_JOIN_SIM && len == sizeof(rw_join_req_t)) {
         rw_join_req_t jr;
-        if (rw_recv_all(c->fd, &jr, sizeof(jr)) < 0) return -1;
+        memcpy(&jr, p, sizeof(jr));
 
-        if (!S->created) {
-            send_error(c->fd, 30, "No simulation yet; wait for creator to CREATE_SIM");
+        if (!S->sim) {
+            send_error(c, 30, "No simulation yet; wait for creator to CREATE_SIM");
             rw_join_ack_t nack;
             memset(&nack, 0, sizeof(nack));
             nack.ok = 0;
-            (void)rw_send_msg(c->fd, RW_MSG_JOIN_ACK, &nack, (uint16_t)sizeof(nack));
+            (void)client_send(c, RW_MSG_JOIN_ACK, &nack, (uint16_t)sizeof(nack));
             return 0;
         }
 
         c->joined = 1;
         c->view = RW_VIEW_AVG_STEPS;
+        client_state_reset(c);
 
         rw_join_ack_t ack;
         memset(&ack, 0, sizeof(ack));
+        rw_sim_info_t info;
+        rw_sim_get_info(S->sim, &info);
         ack.ok = 1;
-        ack.w = S->w; ack.h = S->h; ack.rep_total = S->rep_total; ack.K = S->K;
+        ack.w = info.w; ack.h = info.h; ack.rep_total = info.rep_total; ack.K = info.K;
         ack.world_type = RW_WORLD_WRAP;
         ack.mode_now = S->mode_global;
-        ack.rep_done = S->rep_done;
-        if (rw_send_msg(c->fd, RW_MSG_JOIN_ACK, &ack, (uint16_t)sizeof(ack)) < 0) return -1;
+        ack.rep_done = info.rep_done;
+        if (client_send(c, RW_MSG_JOIN_ACK, &ack, (uint16_t)sizeof(ack)) < 0) return -1;
+        if (send_world(c, S) < 0) return -1;
 
         printf("server: client_id=%u joined\n", c->client_id);
         return 0;
@@ -440,13 +829,13 @@ static int handle_one_msg(client_t *c, sim_t *S) {
     // SET_MODE
     if (type == RW_MSG_SET_MODE && len == sizeof(rw_set_mode_req_t)) {
         rw_set_mode_req_t sm;
-        if (rw_recv_all(c->fd, &sm, sizeof(sm)) < 0) return -1;
+        memcpy(&sm, p, sizeof(sm));
 
-        if (!S->created) { send_error(c->fd, 40, "No simulation yet"); return 0; }
-        //if (c->client_id != S->creator_id) { send_error(c->fd, 41, "Only creator may SET_MODE"); return 0; }
+        if (!S->sim) { send_error(c, 40, "No simulation yet"); return 0; }
+        //if (c->client_id != S->creator_id) { send_error(c, 41, "Only creator may SET_MODE"); return 0; }
 
         if (sm.mode != RW_MODE_INTERACTIVE && sm.mode != RW_MODE_SUMMARY) {
-            send_error(c->fd, 42, "Invalid mode");
+            send_error(c, 42, "Invalid mode");
             return 0;
         }
         S->mode_global = sm.mode;
@@ -457,10 +846,10 @@ static int handle_one_msg(client_t *c, sim_t *S) {
     //STOP_SIM (creator only)
     if (type == RW_MSG_STOP_SIM && len == sizeof(rw_stop_req_t)) {
     rw_stop_req_t sr;
-    if (rw_recv_all(c->fd, &sr, sizeof(sr)) < 0) return -1;
+    memcpy(&sr, p, sizeof(sr));
 
-    if (!S->created) { send_error(c->fd, 70, "No simulation yet"); return 0; }
-    if (c->client_id != S->creator_id) { send_error(c->fd, 71, "Only creator may STOP_SIM"); return 0; }
+    if (!S->sim) { send_error(c, 70, "No simulation yet"); return 0; }
+    if (c->client_id != S->creator_id) { send_error(c, 71, "Only creator may STOP_SIM"); return 0; }
 
     S->stop_requested = 1;
     printf("server: STOP_SIM requested by creator=%u (reason=%u)\n",
@@ -468,45 +857,568 @@ static int handle_one_msg(client_t *c, sim_t *S) {
     return 0;
 }
 
+    // EXTEND_SIM (creator only): raise rep_total, keep accumulators and RNG position
+    if (type == RW_MSG_EXTEND_SIM && len == sizeof(rw_extend_req_t)) {
+        rw_extend_req_t er;
+        memcpy(&er, p, sizeof(er));
+
+        if (!S->sim) { send_error(c, 80, "No simulation yet"); return 0; }
+        if (c->client_id != S->creator_id) { send_error(c, 81, "Only creator may EXTEND_SIM"); return 0; }
+        if (S->stop_requested) { send_error(c, 82, "Simulation was stopped"); return 0; }
+        int rc_ext = S->par ? rw_par_sim_extend(S->par, er.extra_reps) : rw_sim_extend(S->sim, er.extra_reps);
+        if (rc_ext < 0) {
+            if (errno == ENOTSUP) send_error(c, 84, "Exact results cannot be extended");
+            else send_error(c, 83, "Invalid replication count");
+            return 0;
+        }
+        if (S->par) S->sim = rw_par_sim_merged(S->par);
+        S->results_written = 0; // rewrite the output file once the extra replications are done
+
+        rw_sim_info_t si;
+        rw_sim_get_info(S->sim, &si);
+
+        rw_error_msg_t info;
+        memset(&info, 0, sizeof(info));
+        info.code = 0;
+        snprintf(info.msg, sizeof(info.msg), "Simulation extended to %u replications", si.rep_total);
+        if (client_send(c, RW_MSG_ERROR, &info, (uint16_t)sizeof(info)) < 0) return -1;
+
+        printf("server: EXTEND_SIM by creator=%u -> rep_total=%u\n", S->creator_id, si.rep_total);
+        return 0;
+    }
+
     // SET_VIEW (any joined client)
     if (type == RW_MSG_SET_VIEW && len == sizeof(rw_set_view_req_t)) {
         rw_set_view_req_t sv;
-        if (rw_recv_all(c->fd, &sv, sizeof(sv)) < 0) return -1;
+        memcpy(&sv, p, sizeof(sv));
 
         if (sv.view != RW_VIEW_AVG_STEPS && sv.view != RW_VIEW_PROB_K) {
-            send_error(c->fd, 50, "Invalid view");
+            send_error(c, 50, "Invalid view");
             return 0;
         }
         c->view = sv.view;
         return 0;
     }
 
-    // unknown -> skip payload to keep stream aligned
-    if (len) skip_payload(c->fd, len);
+    // SUBMIT_JOB: queue a batch simulation (initial_mode is ignored; jobs never stream STATE)
+    if (type == RW_MSG_SUBMIT_JOB && len == sizeof(rw_submit_job_req_t)) {
+        rw_submit_job_req_t sj;
+        memcpy(&sj, p, sizeof(sj));
+        sj.req.out_file[sizeof(sj.req.out_file) - 1] = '\0';
+        sj.req.initial_mode = RW_MODE_SUMMARY;
+
+        rw_submit_ack_t ack = {.ok = 0, .job_id = 0};
+        if (Q->closed) {
+            send_error(c, 92, "Server is shutting down; job not queued");
+        } else if (!rw_sim_validate(&sj.req)) {
+            send_error(c, 90, "SUBMIT_JOB validation failed");
+        } else if (out_file_in_use(Q, S, sj.req.out_file)) {
+            send_error(c, 91, "out_file is already used by another simulation");
+        } else if ((ack.job_id = job_submit(Q, sj.priority, &sj.req)) == 0) {
+            send_error(c, 24, "Out of memory");
+        } else {
+            ack.ok = 1;
+            printf("server: job %u queued by client_id=%u (priority %d)\n", ack.job_id, c->client_id, sj.priority);
+        }
+        if (client_send(c, RW_MSG_SUBMIT_ACK, &ack, (uint16_t)sizeof(ack)) < 0) return -1;
+        return 0;
+    }
+
+    // JOB_STATUS_REQ / JOB_SUBSCRIBE: current status now; a subscriber gets the final one when the job ends
+    if ((type == RW_MSG_JOB_STATUS_REQ || type == RW_MSG_JOB_SUBSCRIBE) && len == sizeof(rw_job_ref_t)) {
+        rw_job_ref_t ref;
+        memcpy(&ref, p, sizeof(ref));
+
+        job_t *j = job_find(Q, ref.job_id);
+        if (type == RW_MSG_JOB_SUBSCRIBE && j && job_active(j)) {
+            int known = 0;
+            for (int s = 0; s < j->nsubs; s++)
+                if (j->subscribers[s] == c->client_id) known = 1;
+            if (!known && j->nsubs == JOB_MAX_SUBSCRIBERS) {
+                send_error(c, 93, "Too many subscribers for this job");
+            } else if (!known) {
+                j->subscribers[j->nsubs++] = c->client_id;
+            }
+        }
+        rw_job_status_t st;
+        job_fill_status(Q, ref.job_id, &st);
+        if (client_send(c, RW_MSG_JOB_STATUS, &st, (uint16_t)sizeof(st)) < 0) return -1;
+        return 0;
+    }
+
+    // SET_STATE_OPTS (any client): STATE encoding; always answered by a keyframe at the next broadcast
+    if (type == RW_MSG_SET_STATE_OPTS && len == sizeof(rw_state_opts_req_t)) {
+        rw_state_opts_req_t so;
+        memcpy(&so, p, sizeof(so));
+        c->state_opts = so.flags & (RW_STATE_OPT_DELTA | RW_STATE_OPT_COMPACT | RW_STATE_OPT_Q16 | RW_STATE_OPT_SHM |
+                                    RW_STATE_OPT_TILES | RW_STATE_OPT_WORLD);
+        client_state_reset(c);
+        return 0;
+    }
+
+    // SUBSCRIBE (any client): STATE_RECT with its own viewport, fields and rate instead of STATE
+    if (type == RW_MSG_SUBSCRIBE && len == sizeof(rw_subscribe_req_t)) {
+        rw_subscribe_req_t sr;
+        memcpy(&sr, p, sizeof(sr));
+        sr.fields &= RW_FIELD_ALL;
+        if (sr.fields && (sr.x >= RW_MAX_W || sr.y >= RW_MAX_H)) {
+            send_error(c, 55, "Invalid subscription");
+            return 0;
+        }
+        c->sub = sr;
+        c->sub_next_ms = 0;
+        client_state_reset(c);   // the next state goes out at the next tick (back on STATE: as a keyframe)
+        return 0;
+    }
+
+    // QUERY_CELLS (any client): statistics of a list of cells
+    if (type == RW_MSG_QUERY_CELLS && len >= sizeof(rw_query_cells_req_t)) {
+        rw_query_cells_req_t qc;
+        memcpy(&qc, p, sizeof(qc));
+        if (qc.count == 0 || qc.count > RW_QUERY_CELLS_MAX) {
+            return send_query_error(c, qc.query_id, 102, "Query needs 1 to 256 cells");
+        }
+        if (len != sizeof(qc) + qc.count * sizeof(uint16_t[2])) return 0;
+        uint16_t xy[RW_QUERY_CELLS_MAX][2];
+        memcpy(xy, p + sizeof(qc), qc.count * sizeof(xy[0]));
+        return send_query_result(c, S, qc.query_id, (const uint16_t (*)[2])xy, qc.count);
+    }
+
+    // QUERY_RECT (any client): statistics of every cell of a rectangle, row by row
+    if (type == RW_MSG_QUERY_RECT && len == sizeof(rw_query_rect_req_t)) {
+        rw_query_rect_req_t qr;
+        memcpy(&qr, p, sizeof(qr));
+        const uint32_t n = (uint32_t)qr.w * qr.h;
+        if (n == 0 || n > RW_QUERY_CELLS_MAX) return send_query_error(c, qr.query_id, 102, "Query needs 1 to 256 cells");
+        uint16_t xy[RW_QUERY_CELLS_MAX][2];
+        for (uint32_t k = 0; k < n; k++) {
+            // x + w may pass the grid (or 16 bits): such cells are refused as outside it
+            uint32_t x = (uint32_t)qr.x + k % qr.w, y = (uint32_t)qr.y + k / qr.w;
+            xy[k][0] = (uint16_t)(x < UINT16_MAX ? x : UINT16_MAX);
+            xy[k][1] = (uint16_t)(y < UINT16_MAX ? y : UINT16_MAX);
+        }
+        return send_query_result(c, S, qr.query_id, (const uint16_t (*)[2])xy, n);
+    }
+
+    // unknown -> ignored, the framing already skipped its payload
     return 0;
 }
 
-//Iterates through all client slots and cleanly closes any active connections.
-static void close_all_clients(client_t clients[MAX_CLIENTS]) {
-    for (int i = 0; i < MAX_CLIENTS; i++) {
-        if (!clients[i].active) continue;
-        client_close(&clients[i]);
+//Reads what the socket has without blocking and handles every complete message in the client's receive buffer; a
+//partial one waits there for the next read. Stops after CLIENT_READS_PER_WAKE reads so one busy client cannot hold
+//up the others. The replies to everything handled go out together in one flush at the end.
+//Returns 0 once the socket is drained, 1 if more input may be waiting (the socket is edge-triggered, so the caller
+//must come back), -1 if the client hung up, announced a message longer than any request, or could not be answered.
+static int client_read(client_t *c, session_t *S, job_queue_t *Q, client_table_t *CT, const sim_threads_t *T,
+                       const rw_cache_t *cache) {
+    int more = 1;
+    for (int r = 0; r < CLIENT_READS_PER_WAKE && more; r++) {
+        ssize_t k = rw_conn_fill(&c->conn);
+        if (k < 0) return -1;
+        if (k == 0) more = 0;
+
+        uint16_t type = 0, len = 0;
+        const unsigned char *p = NULL;
+        int rc;
+        while ((rc = rw_conn_next(&c->conn, &type, &p, &len)) > 0) {
+            if (handle_msg(c, type, p, len, S, Q, CT, T, cache) < 0) return -1;
+        }
+        if (rc < 0) {
+            (void)send_error(c, 61, "Message too long");
+            (void)client_flush(c);
+            return -1;
+        }
+    }
+    if (client_flush(c) < 0) return -1;
+    return more;
+}
+
+//Accepts every pending connection (the listening socket is edge-triggered) and registers the new clients with epoll.
+static void accept_clients(int listen_fd, int ep, client_table_t *CT, uint32_t *next_id) {
+    for (;;) {
+        int cfd = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (cfd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) perror("server: accept4");
+            return;
+        }
+        client_t *c = client_add(CT, cfd, *next_id);
+        if (!c) {
+            rw_error_msg_t e;
+            error_msg(&e, 60, "Server full");
+            (void)rw_send_msg(cfd, RW_MSG_ERROR, &e, (uint16_t)sizeof(e));
+            close(cfd);
+            continue;
+        }
+        (*next_id)++;
+        // client sockets never block the loop: reads go through client_read, writes through the queues
+        struct epoll_event ev = {.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET, .data.u64 = client_key(c)};
+        if (epoll_ctl(ep, EPOLL_CTL_ADD, cfd, &ev) < 0) {
+            perror("server: epoll_ctl");
+            client_close(CT, c);
+            continue;
+        }
+        printf("server: accepted client slot=%u id=%u\n", c->slot, c->client_id);
+    }
+}
+
+//Iterates through all client slots and cleanly closes any active connections, then frees the table.
+static void close_all_clients(client_table_t *CT) {
+    for (uint32_t i = 0; i < CT->cap; i++) {
+        if (CT->slot[i]) client_close(CT, CT->slot[i]);
+    }
+    free(CT->slot);
+    free(CT->free);
+    free(CT->ready);
+    memset(CT, 0, sizeof(*CT));
+}
+
+//Gives the clients up to timeout_ms to take their queued output (e.g. the final STATE) before the server exits.
+//Only client sockets may be left in the epoll set.
+static void drain_clients(client_table_t *CT, int ep, uint64_t timeout_ms) {
+    const uint64_t end = now_ms() + timeout_ms;
+    struct epoll_event evs[EPOLL_BATCH];
+    for (;;) {
+        int waiting = 0;
+        for (uint32_t i = 0; i < CT->cap; i++) {
+            client_t *c = CT->slot[i];
+            if (!c || (c->conn.out_len == 0 && c->state_len == 0)) continue;
+            if (client_flush(c) < 0) client_close(CT, c);
+            else waiting += c->conn.out_len > 0 || c->state_len > 0;
+        }
+        uint64_t now = now_ms();
+        if (!waiting || now >= end) return;
+        int n = epoll_wait(ep, evs, EPOLL_BATCH, (int)(end - now));
+        if (n < 0 && errno != EINTR) return;
+        for (int k = 0; k < n; k++) {
+            client_t *c = client_lookup(CT, evs[k].data.u64);
+            if (!c) continue;
+            if ((evs[k].events & (EPOLLERR | EPOLLHUP)) || ((evs[k].events & EPOLLOUT) && client_flush(c) < 0)) {
+                client_close(CT, c);
+            }
+        }
+    }
+}
+
+//Encodes the changes from f->prev to the current state as a STATE_DELTA message into f->delta. Neighbouring changed
+//cells share a run, and runs one unchanged cell apart are joined (a run header costs as much as a value).
+//Leaves delta_len 0 if there is no previous state, the obstacles changed, or the delta would not be smaller.
+static void state_delta_build(state_frame_t *f) {
+    const rw_state_msg_t *a = &f->prev, *b = &f->wire.st;
+    f->delta_len = 0;
+    if (a->seq == 0 || a->w != b->w || a->h != b->h || memcmp(a->obstacle, b->obstacle, sizeof(a->obstacle)) != 0) return;
+
+    unsigned char *out = f->delta + RW_MSG_HDR_SIZE;
+    const size_t cap = sizeof(rw_state_msg_t);   // a delta must beat the keyframe
+    rw_state_delta_hdr_t dh = {
+        .seq = b->seq, .base_seq = a->seq, .rep_done = b->rep_done, .rep_total = b->rep_total,
+        .mode = b->mode, .finished = b->finished, .path_len = b->path_len, .nruns = 0
+    };
+    size_t n = sizeof(dh);
+    memcpy(out + n, b->path_x, b->path_len * sizeof(int16_t));
+    n += b->path_len * sizeof(int16_t);
+    memcpy(out + n, b->path_y, b->path_len * sizeof(int16_t));
+    n += b->path_len * sizeof(int16_t);
+
+    const uint32_t cells = RW_MAX_W * RW_MAX_H;
+    uint32_t i = 0;
+    while (i < cells) {
+        if (a->cell_value[i] == b->cell_value[i]) { i++; continue; }
+        // the run [start, end) grows while the next change is at most one unchanged cell away
+        uint32_t start = i, end = i + 1;
+        for (;;) {
+            if (end < cells && a->cell_value[end] != b->cell_value[end]) end += 1;
+            else if (end + 1 < cells && a->cell_value[end + 1] != b->cell_value[end + 1]) end += 2;
+            else break;
+        }
+
+        rw_delta_run_t run = { .start = (uint16_t)start, .count = (uint16_t)(end - start) };
+        size_t bytes = sizeof(run) + run.count * sizeof(uint32_t);
+        if (n + bytes >= cap) return;
+        memcpy(out + n, &run, sizeof(run));
+        memcpy(out + n + sizeof(run), &b->cell_value[start], run.count * sizeof(uint32_t));
+        n += bytes;
+        dh.nruns++;
+        i = end;
     }
+    memcpy(out, &dh, sizeof(dh));
+    rw_pack_hdr(f->delta, RW_MSG_STATE_DELTA, (uint16_t)n);
+    f->delta_len = (uint16_t)n;
+}
+
+//Keeps the frame's new delta in its history, dropping the oldest entry once RESUME_HISTORY are kept.
+static void state_hist_push(state_frame_t *f) {
+    uint32_t i = (f->hist_head + f->hist_count) % RESUME_HISTORY;
+    if (f->hist_count == RESUME_HISTORY) f->hist_head = (f->hist_head + 1) % RESUME_HISTORY;
+    else f->hist_count++;
+    state_hist_t *h = &f->hist[i];
+    h->base_seq = f->prev.seq;
+    h->seq = f->wire.st.seq;
+    h->len = f->delta_len ? RW_MSG_HDR_SIZE + (size_t)f->delta_len : 0;
+    if (h->len == 0) { free(h->msg); h->msg = NULL; return; }
+    unsigned char *msg = realloc(h->msg, h->len);
+    if (!msg) { h->len = 0; return; }   // out of memory: the chain breaks here, resumed clients get a keyframe
+    memcpy(msg, f->delta, h->len);
+    h->msg = msg;
+}
+
+//Returns the STATE frame of a view. It is rebuilt only if the simulation, the mode or the stop flag changed since it
+//was last built, so a tick costs one snapshot per view in use whatever the number of viewers. Every rebuild gets
+//a new sequence number, and its delta from the previous state goes into the history for resumed clients.
+static state_frame_t *state_frame(session_t *S, rw_local_view_t view) {
+    state_frame_t *f = &S->frames[view == RW_VIEW_PROB_K ? 1 : 0];
+    uint64_t version = rw_sim_version(S->sim);
+    if (f->valid && f->version == version && f->mode == S->mode_global && f->stopped == S->stop_requested) {
+        return f;
+    }
+
+    if (f->valid) f->prev = f->wire.st;
+    rw_sim_snapshot(S->sim, view, S->mode_global == RW_MODE_INTERACTIVE, &f->wire.st);
+    f->wire.st.mode = S->mode_global;
+    // NOTE: st.finished will be 1 if rep_done>=rep_total, 2 if stop_requested
+    if (S->stop_requested) f->wire.st.finished = 2u;
+    f->wire.st.seq = ++S->state_seq;
+    rw_pack_hdr(f->wire.hdr, RW_MSG_STATE, (uint16_t)sizeof(f->wire.st));
+
+    f->valid = 1;
+    f->version = version;
+    f->mode = S->mode_global;
+    f->stopped = S->stop_requested;
+    f->compact_built[0] = f->compact_built[1] = 0;
+    f->dyn_built = 0;
+    state_delta_build(f);
+    state_hist_push(f);
+    return f;
+}
+
+//Returns the STATE_COMPACT message of the frame (q16: quantized), encoding it on first use; NULL if it would not be
+//smaller than the full STATE.
+static const unsigned char *state_compact(state_frame_t *f, int q16, size_t *msg_len) {
+    if (!f->compact_built[q16]) {
+        size_t n = rw_state_encode_compact(&f->wire.st, q16, f->compact[q16] + RW_MSG_HDR_SIZE,
+                                           RW_STATE_COMPACT_MAX - 1);
+        f->compact_len[q16] = (uint16_t)n;
+        if (n) rw_pack_hdr(f->compact[q16], RW_MSG_STATE_COMPACT, (uint16_t)n);
+        f->compact_built[q16] = 1;
+    }
+    if (f->compact_len[q16] == 0) return NULL;
+    *msg_len = RW_MSG_HDR_SIZE + (size_t)f->compact_len[q16];
+    return f->compact[q16];
+}
+
+//Brings the frame's per-tile change record up to its state: tiles that differ from the previous state get the new
+//sequence number. If the record missed a state (no tiles client looked at it) or the grid changed, all tiles do.
+static void state_tiles_build(state_frame_t *f) {
+    const rw_state_msg_t *st = &f->wire.st;
+    const int diff = f->tiles_seq != 0 && f->tiles_seq == f->prev.seq && f->prev.w == st->w && f->prev.h == st->h;
+    const uint32_t n = rw_state_tile_count(st);
+    for (uint32_t t = 0; t < n; t++) {
+        if (!diff || rw_state_tile_changed(&f->prev, st, t)) f->tile_seq[t] = st->seq;
+    }
+    f->tiles_seq = st->seq;
+}
+
+//Sends a tiles client the newest state of its view with the tiles it does not hold yet, the ones it has held longest
+//first, as many as fit in one STATE_TILES_MSG_MAX message; the rest follow with the next states. A state without
+//new tiles still goes out once, for its header and path.
+static int send_state_tiles(client_t *c, session_t *S) {
+    state_frame_t *f = state_frame(S, c->view);
+    const rw_state_msg_t *st = &f->wire.st;
+    if (f->tiles_seq != st->seq) state_tiles_build(f);
+    if (c->state_len > 0 && c->state_msg_seq == st->seq) return 0;   // the waiting message already has what fits
+
+    // the tiles to send, oldest copy first, so a busy grid larger than one message is refreshed in turn
+    uint32_t want[RW_STATE_TILES_MAX];
+    uint32_t n = 0;
+    const uint32_t count = rw_state_tile_count(st);
+    for (uint32_t t = 0; t < count; t++) {
+        if (c->tile_have[t] == f->tile_seq[t]) continue;
+        uint32_t k = n++;
+        for (; k > 0 && c->tile_have[want[k - 1]] > c->tile_have[t]; k--) want[k] = want[k - 1];
+        want[k] = t;
+    }
+    if (n == 0 && c->sent_seq == st->seq) return 0;
+
+    const size_t cap = STATE_TILES_MSG_MAX - RW_MSG_HDR_SIZE;
+    size_t bytes = sizeof(rw_state_tiles_hdr_t) + 2 * st->path_len * sizeof(int16_t);
+    uint32_t take = 0;
+    while (take < n && bytes + rw_state_tile_bytes(st, want[take]) <= cap) bytes += rw_state_tile_bytes(st, want[take++]);
+    size_t len = rw_state_encode_tiles(st, want, take, f->tile_seq, n - take, S->tiles_msg + RW_MSG_HDR_SIZE, cap);
+    rw_pack_hdr(S->tiles_msg, RW_MSG_STATE_TILES, (uint16_t)len);
+
+    // the client holds these tiles once the message starts to go out (a waiting one may still be replaced)
+    memcpy(c->tile_next, c->tile_have, sizeof(c->tile_next));
+    for (uint32_t k = 0; k < take; k++) c->tile_next[want[k]] = f->tile_seq[want[k]];
+    if (client_send_state(c, S->tiles_msg, RW_MSG_HDR_SIZE + len, st->seq) < 0) return -1;
+    c->last_seq = st->seq;
+    return 0;
+}
+
+//Returns the STATE_DYN message of the frame, encoding it on first use.
+static const unsigned char *state_dyn(state_frame_t *f, session_t *S, size_t *msg_len) {
+    if (!f->dyn_built) {
+        size_t w;
+        (void)session_world(S, &w);
+        size_t n = rw_state_encode_dyn(&f->wire.st, S->world_hash, f->dyn + RW_MSG_HDR_SIZE, RW_STATE_DYN_MAX);
+        rw_pack_hdr(f->dyn, RW_MSG_STATE_DYN, (uint16_t)n);
+        f->dyn_len = (uint16_t)n;
+        f->dyn_built = 1;
+    }
+    *msg_len = RW_MSG_HDR_SIZE + (size_t)f->dyn_len;
+    return f->dyn;
+}
+
+//Returns the full state message a client gets of the frame: STATE, or the smaller STATE_COMPACT (compact clients)
+//or STATE_DYN (world clients).
+static const unsigned char *state_key(const client_t *c, state_frame_t *f, session_t *S, size_t *msg_len) {
+    const unsigned char *key = (const unsigned char *)&f->wire;
+    size_t key_len = RW_MSG_HDR_SIZE + sizeof(f->wire.st);
+    if (c->state_opts & RW_STATE_OPT_COMPACT) {
+        size_t n;
+        const unsigned char *m = state_compact(f, (c->state_opts & RW_STATE_OPT_Q16) ? 1 : 0, &n);
+        if (m) { key = m; key_len = n; }
+    }
+    if (c->state_opts & RW_STATE_OPT_WORLD) {
+        size_t n;
+        const unsigned char *m = state_dyn(f, S, &n);
+        if (n < key_len) { key = m; key_len = n; }
+    }
+    *msg_len = key_len;
+    return key;
+}
+
+//Queues for a resumed delta client the STATE_DELTA messages from the state it last applied (resume_seq) to the
+//frame's, if the view's history still links them and together they are smaller than a keyframe. Otherwise the
+//client's next state is a keyframe, as after JOIN.
+static void send_catch_up(client_t *c, state_frame_t *f, session_t *S) {
+    const uint32_t last_seq = c->resume_seq, seq = f->wire.st.seq;
+    c->resume_seq = 0;
+
+    // find the delta that leads on from last_seq; each one after it leads on from the one before
+    uint32_t from = 0, k = 0, at = last_seq;
+    size_t total = 0;
+    for (; k < f->hist_count && at != seq; k++) {
+        const state_hist_t *h = &f->hist[(f->hist_head + k) % RESUME_HISTORY];
+        if (h->base_seq != at) {
+            if (at != last_seq) return;
+            from = k + 1;
+            continue;
+        }
+        if (h->len == 0) return;
+        total += h->len;
+        at = h->seq;
+    }
+    if (at != seq) return;
+
+    size_t key_len;
+    (void)state_key(c, f, S, &key_len);
+    if (total >= key_len || c->conn.out_cap - c->conn.out_len < total) return;
+    for (uint32_t i = from; i < k; i++) {
+        const state_hist_t *h = &f->hist[(f->hist_head + i) % RESUME_HISTORY];
+        (void)rw_conn_queue_bytes(&c->conn, h->msg, h->len);
+    }
+    c->last_seq = c->sent_seq = seq;
+    c->deltas_since_key = k - from;
+}
+
+//Sends a joined client the current state of its view: the full STATE, or for delta clients nothing if they are up to
+//date, a STATE_DELTA if they hold the previous state, and a keyframe otherwise or every STATE_KEYFRAME_EVERY deltas.
+//Compact clients get full states (keyframes) as STATE_COMPACT, and a delta only if it is smaller than that.
+//World clients get a full state as STATE_DYN when that is smaller. Tiles clients get STATE_TILES instead (send_state_tiles).
+//Nothing blocks: a client that is behind gets the newest state once its socket drains, older ones are skipped.
+static int send_state(client_t *c, session_t *S) {
+    if (c->state_opts & RW_STATE_OPT_TILES) return send_state_tiles(c, S);
+    state_frame_t *f = state_frame(S, c->view);
+    const rw_state_msg_t *st = &f->wire.st;
+    if (c->resume_seq) send_catch_up(c, f, S);
+    // a slow client's pending state has not started yet: this one replaces it, so deltas build on what went out
+    if (c->state_len > 0) {
+        if (c->state_msg_seq == st->seq) return 0;
+        c->last_seq = c->sent_seq;
+    }
+    if ((c->state_opts & RW_STATE_OPT_DELTA) && c->last_seq == st->seq) return 0;
+    size_t key_len;
+    const unsigned char *key = state_key(c, f, S, &key_len);
+    if (c->state_opts & RW_STATE_OPT_DELTA) {
+        if (c->last_seq != 0 && c->last_seq == f->prev.seq && c->deltas_since_key < STATE_KEYFRAME_EVERY) {
+            if (f->delta_len > 0 && RW_MSG_HDR_SIZE + (size_t)f->delta_len < key_len) {
+                if (client_send_state(c, f->delta, RW_MSG_HDR_SIZE + (size_t)f->delta_len, st->seq) < 0) return -1;
+                c->last_seq = st->seq;
+                c->deltas_since_key++;
+                return 0;
+            }
+        }
+        c->deltas_since_key = 0;
+    }
+    if (client_send_state(c, key, key_len, st->seq) < 0) return -1;
+    c->last_seq = st->seq;
+    return 0;
 }
 
-//Parses command-line options (port), starts the listening socket, manages multiple clients with poll,
-// runs the simulation in timed ticks, broadcasts state updates to joined clients, writes results when finished, 
-//and shuts down when the simulation ends.
+//Sends a subscribed client the part of the newest state it asked for, if that state is new to it and its interval has
+//passed. Only the subscribed rectangle and fields are copied, so a small or slow viewer costs little.
+static int send_state_rect(client_t *c, session_t *S, uint64_t now) {
+    if (now < c->sub_next_ms) return 0;
+    state_frame_t *f = state_frame(S, c->view);
+    const rw_state_msg_t *st = &f->wire.st;
+    if (c->last_seq == st->seq || (c->state_len > 0 && c->state_msg_seq == st->seq)) return 0;
+
+    size_t n = rw_state_encode_rect(st, &c->sub, S->rect_msg + RW_MSG_HDR_SIZE, RW_STATE_RECT_MAX);
+    rw_pack_hdr(S->rect_msg, RW_MSG_STATE_RECT, (uint16_t)n);
+    if (client_send_state(c, S->rect_msg, RW_MSG_HDR_SIZE + n, st->seq) < 0) return -1;
+    c->last_seq = st->seq;
+    // ticks come a few ms early or late: half a tick of slack keeps e.g. a 1 s interval on every 5th tick
+    c->sub_next_ms = now + c->sub.min_interval_ms - (c->sub.min_interval_ms >= TICK_MS ? TICK_MS / 2 : 0);
+    return 0;
+}
+
+//Ends the session in a persistent server: releases the simulation and detaches its viewers, so a new one can be
+//created. Parked clients come back unjoined.
+static void session_clear(session_t *S, client_table_t *CT) {
+    sim_close(S->sim, S->par);
+    session_frames_reset(S);
+    memset(S, 0, sizeof(*S));
+    for (uint32_t i = 0; i < CT->cap; i++) {
+        if (CT->slot[i]) CT->slot[i]->joined = 0;
+    }
+    for (uint32_t i = 0; i < CT->nparked; i++) CT->parked[i].joined = 0;
+}
+
+//Parses command-line options (port, result cache, job queue), starts the listening socket, manages the clients with epoll,
+// runs the simulation in timed ticks, broadcasts state updates to joined clients, writes results when finished,
+//and keeps serving the finished simulation (so it can be extended) until the creator stops it.
+//Queued jobs run between the ticks; the server exits only once they are done, or never with --persistent.
 int main(int argc, char **argv) {
     uint16_t port = 12345;
+    const char *cache_dir = CACHE_DIR_DEFAULT;
+    int exit_on_finish = 0;
+    int persistent = 0;
+    int job_slots = JOB_SLOTS_DEFAULT;
+    long sim_threads = 1;
+    int pin = 1;
+    uint64_t cache_max_mb = CACHE_MAX_MB_DEFAULT;
+    long slow_timeout = SLOW_TIMEOUT_DEFAULT;
+    long max_clients = MAX_CLIENTS_DEFAULT;
+    int use_shm = 0;
 
     static struct option long_opts[] = {
         {"port", required_argument, 0, 'p'},
+        {"cache-dir", required_argument, 0, 'c'},
+        {"cache-max-mb", required_argument, 0, 'm'},
+        {"no-cache", no_argument, 0, 'n'},
+        {"exit-on-finish", no_argument, 0, 'x'},
+        {"persistent", no_argument, 0, 'P'},
+        {"job-slots", required_argument, 0, 'j'},
+        {"sim-threads", required_argument, 0, 't'},
+        {"no-pin", no_argument, 0, 'u'},
+        {"slow-timeout", required_argument, 0, 's'},
+        {"max-clients", required_argument, 0, 'C'},
+        {"shm", no_argument, 0, 'M'},
         {0, 0, 0, 0}
     };
 
     int opt;
-    while ((opt = getopt_long(argc, argv, "p:", long_opts, NULL)) != -1) {
+    while ((opt = getopt_long(argc, argv, "p:c:m:nxPj:t:us:C:M", long_opts, NULL)) != -1) {
         switch (opt) {
             case 'p': {
                 long v = strtol(optarg, NULL, 10);
@@ -517,143 +1429,302 @@ int main(int argc, char **argv) {
                 port = (uint16_t)v;
                 break;
             }
+            case 'c':
+                cache_dir = optarg;
+                break;
+            case 'm': {
+                long v = strtol(optarg, NULL, 10);
+                if (v < 0) {
+                    fprintf(stderr, "server: invalid cache size: %s\n", optarg);
+                    return 1;
+                }
+                cache_max_mb = (uint64_t)v;
+                break;
+            }
+            case 'n':
+                cache_dir = NULL;
+                break;
+            case 'x':
+                exit_on_finish = 1;
+                break;
+            case 'P':
+                persistent = 1;
+                break;
+            case 'j': {
+                long v = strtol(optarg, NULL, 10);
+                if (v <= 0 || v > 1024) {
+                    fprintf(stderr, "server: invalid job slot count: %s\n", optarg);
+                    return 1;
+                }
+                job_slots = (int)v;
+                break;
+            }
+            case 't':
+                sim_threads = strtol(optarg, NULL, 10);
+                if (sim_threads < 0 || sim_threads > RW_NUMA_MAX_CPUS) {
+                    fprintf(stderr, "server: invalid thread count: %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'u':
+                pin = 0;
+                break;
+            case 's':
+                slow_timeout = strtol(optarg, NULL, 10);
+                if (slow_timeout < 0 || slow_timeout > 86400) {
+                    fprintf(stderr, "server: invalid slow client timeout: %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'C':
+                max_clients = strtol(optarg, NULL, 10);
+                if (max_clients <= 0 || max_clients > 1000000) {
+                    fprintf(stderr, "server: invalid client limit: %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'M':
+                use_shm = 1;
+                break;
             default:
-                fprintf(stderr, "Usage: %s [--port N]\n", argv[0]);
+                fprintf(stderr, "Usage: %s [--port N] [--cache-dir DIR] [--cache-max-mb N] [--no-cache] [--exit-on-finish]\n"
+                                "       [--persistent] [--job-slots N] [--sim-threads N (0 = all CPUs)] [--no-pin]\n"
+                                "       [--slow-timeout SEC (0 = never drop slow clients)] [--max-clients N]\n"
+                                "       [--shm (also publish states in shared memory for local viewers)]\n", argv[0]);
                 return 1;
         }
     }
-    int listen_fd = rw_tcp_listen(NULL, port, 16);
+
+    // result cache (0 MB = unbounded); the server keeps working without it if the directory is unusable
+    rw_cache_t cache_store;
+    rw_cache_t *cache = NULL;
+    if (cache_dir) {
+        if (rw_cache_init(&cache_store, cache_dir, cache_max_mb * 1024ULL * 1024ULL) == 0) {
+            cache = &cache_store;
+        } else {
+            perror("server: rw_cache_init (result cache disabled)");
+        }
+    }
+    // multi-threaded runs: one accumulator shard per worker, workers spread over the NUMA nodes
+    rw_numa_topo_t topo;
+    rw_numa_detect(&topo);
+    sim_threads_t threads = {.threads = sim_threads ? (uint32_t)sim_threads : topo.ncpus, .topo = pin ? &topo : NULL};
+    if (threads.threads > 1) {
+        printf("server: %u thread(s) per simulation on %u CPU(s) in %u NUMA node(s)%s\n",
+               threads.threads, topo.ncpus, topo.nnodes, pin ? ", pinned" : "");
+    }
+
+    // one descriptor per viewer: allow as many as the hard limit permits
+    struct rlimit nofile;
+    if (getrlimit(RLIMIT_NOFILE, &nofile) == 0 && nofile.rlim_cur < nofile.rlim_max) {
+        nofile.rlim_cur = nofile.rlim_max;
+        (void)setrlimit(RLIMIT_NOFILE, &nofile);
+    }
+
+    int listen_fd = rw_tcp_listen(NULL, port, SOMAXCONN);
     if (listen_fd < 0) die("rw_tcp_listen");
+    if (fcntl(listen_fd, F_SETFL, fcntl(listen_fd, F_GETFL) | O_NONBLOCK) < 0) die("fcntl");
+
+    // the tick is a periodic timer in the same event set as the sockets; the first one fires right away
+    int ep = epoll_create1(EPOLL_CLOEXEC);
+    if (ep < 0) die("epoll_create1");
+    int tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (tfd < 0) die("timerfd_create");
+    struct itimerspec tick = {
+        .it_interval = {.tv_sec = TICK_MS / 1000, .tv_nsec = (TICK_MS % 1000) * 1000000L},
+        .it_value = {.tv_sec = 0, .tv_nsec = 1},
+    };
+    if (timerfd_settime(tfd, 0, &tick, NULL) < 0) die("timerfd_settime");
+    struct epoll_event lev = {.events = EPOLLIN | EPOLLET, .data.u64 = EV_LISTEN};
+    struct epoll_event tev = {.events = EPOLLIN, .data.u64 = EV_TIMER};
+    if (epoll_ctl(ep, EPOLL_CTL_ADD, listen_fd, &lev) < 0 || epoll_ctl(ep, EPOLL_CTL_ADD, tfd, &tev) < 0) die("epoll_ctl");
 
     printf("server: listening on %u...\n", (unsigned)port);
 
-    client_t clients[MAX_CLIENTS];
-    memset(clients, 0, sizeof(clients));
+    // after the port is ours, so a second server on it cannot take the region over
+    rw_shm_state_t shm;
+    memset(&shm, 0, sizeof(shm));
+    if (use_shm) {
+        char shm_name[64];
+        rw_shm_state_name(shm_name, sizeof(shm_name), port);
+        if (rw_shm_state_create(&shm, shm_name) < 0) die("rw_shm_state_create");
+        printf("server: publishing states in shared memory %s\n", shm_name);
+    }
+
+    client_table_t clients;
+    memset(&clients, 0, sizeof(clients));
+    clients.max = (uint32_t)max_clients;
     uint32_t next_id = 1;
 
-    sim_t sim;
-    memset(&sim, 0, sizeof(sim));
+    static session_t sess;   // the STATE frames and message buffers make it too large for the stack
+
+    job_queue_t jobs;
+    memset(&jobs, 0, sizeof(jobs));
+    jobs.next_id = 1;
+    jobs.slots = job_slots;
 
     int should_exit = 0;
+    struct epoll_event evs[EPOLL_BATCH];
 
     while (1) {
-        // build pollfds: [listen] + active clients
-        struct pollfd pfds[1 + MAX_CLIENTS];
-        int map_idx[1 + MAX_CLIENTS]; // poll index -> client index, -1 for listen
-        int nfds = 0;
-
-        pfds[nfds].fd = listen_fd;
-        pfds[nfds].events = POLLIN;
-        map_idx[nfds] = -1;
-        nfds++;
-
-        for (int i = 0; i < MAX_CLIENTS; i++) {
-            if (!clients[i].active) continue;
-            pfds[nfds].fd = clients[i].fd;
-            pfds[nfds].events = POLLIN;
-            map_idx[nfds] = i;
-            nfds++;
-        }
-
-        int rc = poll(pfds, nfds, TICK_MS);
-        if (rc < 0) {
+        // running jobs and unread input use the time between ticks, so only block when there is nothing to do
+        int timeout = (!jobs_idle(&jobs) || clients.nready > 0) ? 0 : -1;
+        int n = epoll_wait(ep, evs, EPOLL_BATCH, timeout);
+        if (n < 0) {
             if (errno == EINTR) continue;
-            die("poll");
+            die("epoll_wait");
         }
 
-        // 1) new connections
-        if (pfds[0].revents & POLLIN) {
-            int cfd = accept(listen_fd, NULL, NULL);
-            if (cfd >= 0) {
-                int slot = -1;
-                for (int i = 0; i < MAX_CLIENTS; i++) {
-                    if (!clients[i].active) { slot = i; break; }
-                }
-                if (slot < 0) {
-                    send_error(cfd, 60, "Server full");
-                    close(cfd);
-                } else {
-                    clients[slot].active = 1;
-                    clients[slot].fd = cfd;
-                    clients[slot].client_id = next_id++;
-                    clients[slot].hello_done = 0;
-                    clients[slot].joined = 0;
-                    clients[slot].view = RW_VIEW_AVG_STEPS;
-                    printf("server: accepted client slot=%d id=%u\n", slot, clients[slot].client_id);
-                }
+        // 1) new connections, the tick timer, client output and input
+        int tick_due = 0;
+        for (int k = 0; k < n; k++) {
+            if (evs[k].data.u64 == EV_LISTEN) {
+                accept_clients(listen_fd, ep, &clients, &next_id);
+                continue;
             }
-        }
-
-        // 2) handle incoming messages
-        for (int pi = 1; pi < nfds; pi++) {
-            int ci = map_idx[pi];
-            if (ci < 0) continue;
-            if (pfds[pi].revents & (POLLERR | POLLHUP | POLLNVAL)) {
-                printf("server: client %u disconnected\n", clients[ci].client_id);
-                client_close(&clients[ci]);
+            if (evs[k].data.u64 == EV_TIMER) {
+                uint64_t expirations;
+                if (read(tfd, &expirations, sizeof(expirations)) == (ssize_t)sizeof(expirations)) tick_due = 1;
                 continue;
             }
-            if (pfds[pi].revents & POLLIN) {
-                if (handle_one_msg(&clients[ci], &sim) < 0) {
-                    printf("server: client %u read error/disconnect\n", clients[ci].client_id);
-                    client_close(&clients[ci]);
+            client_t *c = client_lookup(&clients, evs[k].data.u64);
+            if (!c) continue;   // closed earlier in this batch
+            if (evs[k].events & (EPOLLERR | EPOLLHUP)) {
+                printf("server: client %u disconnected\n", c->client_id);
+                client_close(&clients, c);
+                continue;
+            }
+            if ((evs[k].events & EPOLLOUT) && client_flush(c) < 0) {
+                printf("server: client %u write error/disconnect\n", c->client_id);
+                client_close(&clients, c);
+                continue;
+            }
+            if (evs[k].events & (EPOLLIN | EPOLLRDHUP)) {
+                int rc = client_read(c, &sess, &jobs, &clients, &threads, cache);
+                if (rc < 0) {
+                    printf("server: client %u read error/disconnect\n", c->client_id);
+                    client_close(&clients, c);
+                } else if (rc > 0) {
+                    client_mark_ready(&clients, c);
                 }
             }
         }
 
-        // 3) tick simulation + (optional) finish + broadcast state
+        // 2) clients that had more input than one turn (taken from the list first: reading may put them back)
+        size_t nready = clients.nready;
+        for (size_t r = 0; r < nready; r++) {
+            client_t *c = client_lookup(&clients, clients.ready[r]);
+            if (!c) continue;
+            c->read_ready = 0;
+            int rc = client_read(c, &sess, &jobs, &clients, &threads, cache);
+            if (rc < 0) {
+                printf("server: client %u read error/disconnect\n", c->client_id);
+                client_close(&clients, c);
+            } else if (rc > 0) {
+                client_mark_ready(&clients, c);
+            }
+        }
+        memmove(clients.ready, clients.ready + nready, (clients.nready - nready) * sizeof(*clients.ready));
+        clients.nready -= nready;
+
+        // 3) job queue: start what fits in the job slots, then one slice of each running job
+        jobs_schedule(&jobs, &threads, cache, &clients);
+        jobs_step(&jobs, cache, &clients);
+
+        if (!tick_due) continue;
+
+        // 4) tick simulation + (optional) finish + broadcast state
 
-        // run simulation only if not stopped and not finished
-        if (sim.created && !sim.stop_requested && sim.rep_done < sim.rep_total) {
-          uint32_t budget = (sim.mode_global == RW_MODE_INTERACTIVE) ? 1u : 500u;
-          sim_do_steps(&sim, budget);
+        // statistics run at full budget in both modes; interactive mode only adds the display walker
+        rw_sim_info_t info;
+        memset(&info, 0, sizeof(info));
+        if (sess.sim && !sess.stop_requested) {
+          sim_advance(&sess.sim, sess.par, SIM_STEPS_PER_TICK);
+          if (sess.mode_global == RW_MODE_INTERACTIVE) rw_sim_display_step(sess.sim);
         }
+        if (sess.sim) rw_sim_get_info(sess.sim, &info);
 
         // determine finished state
         int finished_now = 0;
-        if (sim.created) {
-          if (sim.stop_requested) finished_now = 1;
-          if (sim.rep_done >= sim.rep_total) finished_now = 1;
+        if (sess.sim) {
+          if (sess.stop_requested) finished_now = 1;
+          if (info.finished) finished_now = 1;
         }
 
         // if finished for the first time -> write results once
-        if (sim.created && finished_now && !sim.results_written) {
-          if (write_results_to_file(&sim) == 0) {
-            printf("server: results saved to %s\n", sim.out_file);
+        if (sess.sim && finished_now && !sess.results_written) {
+          if (rw_sim_export(sess.sim, sess.out_file) == 0) {
+            printf("server: results saved to %s\n", sess.out_file);
           } else {
-            perror("server: write_results_to_file");
-            // if saving failes, we end the simulation anyway and set the results to written so it can end
-            sim.results_written = 1;
+            perror("server: rw_sim_export");
             }
+          // if saving fails, we end the simulation anyway and set the results to written so it can end
+          sess.results_written = 1;
+          if (!sess.stop_requested) {
+            int rc_cache = rw_sim_store_cached(sess.sim, cache);
+            if (rc_cache < 0) perror("server: rw_cache_store");
+            else if (rc_cache > 0) printf("server: cached results (rep_done=%u)\n", info.rep_done);
+          }
         }
 
-        if (sim.created && finished_now) {
+        // a completed run stays available for EXTEND_SIM; only STOP_SIM (or --exit-on-finish) ends the server,
+        // after the queued jobs are done
+        int session_over = sess.sim && (sess.stop_requested || (finished_now && exit_on_finish && !persistent));
+        if (session_over && !persistent) {
             should_exit = 1;
+            jobs.closed = 1;
         }
 
         // broadcast to all joined clients
-        if (sim.created) {
-          for (int i = 0; i < MAX_CLIENTS; i++) {
-            if (!clients[i].active || !clients[i].joined) continue;
-
-            rw_state_msg_t st;
-            build_state_for_view(&sim, clients[i].view, &st);
-
-            // NOTE: st.finished will be 1, if stop_requested or rep_done>=rep_total
-            if (rw_send_msg(clients[i].fd, RW_MSG_STATE, &st, (uint16_t)sizeof(st)) < 0) {
-              printf("server: drop client %u (send failed)\n", clients[i].client_id);
-              client_close(&clients[i]);
+        const uint64_t now = now_ms();
+        if (sess.sim) {
+          for (uint32_t i = 0; i < clients.cap; i++) {
+            client_t *c = clients.slot[i];
+            if (!c || !c->joined) continue;
+            if ((c->state_opts & RW_STATE_OPT_SHM) && shm.r) continue;   // reads the shared copy
+
+            if ((c->sub.fields ? send_state_rect(c, &sess, now) : send_state(c, &sess)) < 0) {
+              printf("server: drop client %u (send failed)\n", c->client_id);
+              client_close(&clients, c);
              }
           }
       }
-        if (should_exit) {
-            printf("server: shutting down (simulation finished)\n");
-            close_all_clients(clients);
+        // local viewers: both views are published whatever the number of readers, each new state once
+        if (shm.r) {
+            for (int v = 0; v < 2 && sess.sim; v++) {
+                state_frame_t *f = state_frame(&sess, v ? RW_VIEW_PROB_K : RW_VIEW_AVG_STEPS);
+                if (f->shm_seq == f->wire.st.seq) continue;
+                rw_shm_state_publish(&shm, v ? RW_VIEW_PROB_K : RW_VIEW_AVG_STEPS, &f->wire.st);
+                f->shm_seq = f->wire.st.seq;
+            }
+            rw_shm_state_set_live(&shm, sess.sim != NULL);
+        }
+
+        // a viewer that falls behind only skips states; one that takes nothing at all for too long is dropped
+        for (uint32_t i = 0; i < clients.cap && slow_timeout > 0; i++) {
+            client_t *c = clients.slot[i];
+            if (!c || c->stalled_since == 0 || now - c->stalled_since < (uint64_t)slow_timeout * 1000u) continue;
+            printf("server: drop client %u (took no data for %ld s, %u states skipped)\n", c->client_id, slow_timeout, c->skipped);
+            client_close(&clients, c);
+        }
+        if (session_over && persistent) {
+            printf("server: simulation %s, ready for a new one\n", sess.stop_requested ? "stopped" : "finished");
+            session_clear(&sess, &clients);
+        }
+        if (should_exit && jobs_idle(&jobs)) {
+            printf("server: shutting down (simulation %s)\n", sess.stop_requested ? "stopped" : "finished");
             close(listen_fd);
+            close(tfd);
+            drain_clients(&clients, ep, SHUTDOWN_DRAIN_MS);
+            close_all_clients(&clients);
+            rw_shm_state_close(&shm);
             break;
         }
   }
 
-    close(listen_fd);
+    close(ep);
+    sim_close(sess.sim, sess.par);
+    session_frames_reset(&sess);
+    jobs_free(&jobs);
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,116 @@
+// app/rw_merge.c (combine result shards of independent runs)
+#include "common/results_io.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <getopt.h>
+
+//Prints command-line help.
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "Usage: %s -o OUT [--format results|shard] [--allow-same-seed] SHARD...\n"
+            "  Merges shards of the same configuration (different seeds) in one pass.\n"
+            "  The output format follows the extension of OUT (.shard = shard) unless --format is given.\n",
+            prog);
+}
+
+//Returns 1 if any seed of b already occurs in a. Runs sharing a seed produced identical samples and must not be pooled.
+static int seeds_overlap(const rw_shard_t *a, const rw_shard_t *b) {
+    for (uint32_t i = 0; i < b->nseeds; i++)
+        for (uint32_t j = 0; j < a->nseeds; j++)
+            if (a->seeds[j] == b->seeds[i]) return 1;
+    return 0;
+}
+
+//Reads every shard given on the command line, checks that the configurations match, sums the raw accumulators
+//and writes the combined result in the requested format.
+int main(int argc, char **argv) {
+    const char *out_path = NULL;
+    const char *format = NULL;
+    int allow_same_seed = 0;
+
+    static struct option long_opts[] = {
+        {"out", required_argument, 0, 'o'},
+        {"format", required_argument, 0, 'f'},
+        {"allow-same-seed", no_argument, 0, 's'},
+        {0, 0, 0, 0}
+    };
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "o:f:s", long_opts, NULL)) != -1) {
+        switch (opt) {
+            case 'o': out_path = optarg; break;
+            case 'f': format = optarg; break;
+            case 's': allow_same_seed = 1; break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+    if (!out_path || optind >= argc) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (format && strcmp(format, "results") != 0 && strcmp(format, "shard") != 0) {
+        fprintf(stderr, "rw_merge: unknown format: %s\n", format);
+        return 1;
+    }
+
+    rw_shard_t total;
+    memset(&total, 0, sizeof(total));
+    int have_total = 0;
+
+    for (int a = optind; a < argc; a++) {
+        rw_shard_t sh;
+        if (rw_shard_read(argv[a], &sh) < 0) {
+            fprintf(stderr, "rw_merge: cannot read shard %s: %s\n", argv[a], strerror(errno));
+            if (have_total) rw_shard_free(&total);
+            return 1;
+        }
+
+        if (!have_total) {
+            total = sh;
+            have_total = 1;
+            continue;
+        }
+
+        if (!allow_same_seed && seeds_overlap(&total, &sh)) {
+            fprintf(stderr, "rw_merge: %s repeats a seed of an earlier shard (use --allow-same-seed to force)\n", argv[a]);
+            rw_shard_free(&sh);
+            rw_shard_free(&total);
+            return 1;
+        }
+
+        if (rw_shard_merge(&total, &sh) < 0) {
+            if (errno == EINVAL) {
+                fprintf(stderr, "rw_merge: %s has a different configuration (w/h/K/probabilities/world)\n", argv[a]);
+            } else {
+                fprintf(stderr, "rw_merge: cannot merge %s: %s\n", argv[a], strerror(errno));
+            }
+            rw_shard_free(&sh);
+            rw_shard_free(&total);
+            return 1;
+        }
+        rw_shard_free(&sh);
+    }
+
+    int rc;
+    if (format && strcmp(format, "shard") == 0) {
+        rc = rw_shard_write(out_path, &total.key, total.rep_done, total.seeds, total.nseeds, &total.acc);
+    } else if (format) {
+        rc = rw_results_write_text(out_path, &total.key, total.rep_done, total.rep_done, &total.acc, NULL);
+    } else {
+        rc = rw_shard_write_any(out_path, &total);
+    }
+    if (rc < 0) {
+        fprintf(stderr, "rw_merge: cannot write %s: %s\n", out_path, strerror(errno));
+        rw_shard_free(&total);
+        return 1;
+    }
+
+    printf("rw_merge: merged %d shard(s), rep_done=%u -> %s\n", argc - optind, total.rep_done, out_path);
+    rw_shard_free(&total);
+    return 0;
+}
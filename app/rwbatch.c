@@ -0,0 +1,400 @@
+// app/rwbatch.c (headless batch runner: many simulations on all cores, no sockets)
+#include "engine/engine.h"
+#include "engine/par_sim.h"
+#include "common/spectral.h"
+#include "common/sim_config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <math.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MANIFEST_LINE_MAX 4096
+#define MANIFEST_TOKENS_MAX 64
+
+// One manifest entry.
+typedef struct {
+    rw_create_sim_req_t req;
+    int line;          // manifest line, for messages
+    int failed;
+    double secs;
+} job_t;
+
+// Work queue shared by the worker threads.
+typedef struct {
+    job_t *jobs;
+    size_t njobs;
+    size_t next;
+    pthread_mutex_t lock;
+} batch_t;
+
+//Prints command-line help, including the manifest format.
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "Usage: %s [-j THREADS] MANIFEST\n"
+            "       %s --bench-tail-memo | --bench-numa\n"
+            "  Runs every simulation of MANIFEST to completion, THREADS at a time (default: all cores).\n"
+            "  Manifest: one simulation per line as key=value pairs (see common/sim_config.h); '#' starts a comment.\n"
+            "    required: w h reps K out\n"
+            "    optional: p_up p_down p_left p_right (default 250000 each), seed (0 = random),\n"
+            "              engine=mc|spectral, vr=none|antithetic|control_variate, tail=N,\n"
+            "              split=F split_step=S, sweep=u,d,l,r (repeatable)\n"
+            "  Example: w=20 h=10 reps=100 K=200 seed=7 out=data/results/a.shard\n",
+            prog, prog);
+}
+
+//Returns a monotonic timestamp in seconds.
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+//Reads the manifest into a job array. Every line is validated with the engine's own rules before anything runs.
+//Returns 0 on success, -1 on error (a message naming the line has been printed).
+static int read_manifest(const char *path, job_t **jobs_out, size_t *njobs_out) {
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        fprintf(stderr, "rwbatch: cannot open %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    job_t *jobs = NULL;
+    size_t n = 0, cap = 0;
+    char line[MANIFEST_LINE_MAX];
+    int lineno = 0, ok = 1;
+
+    while (ok && fgets(line, sizeof(line), f)) {
+        lineno++;
+        char *hash = strchr(line, '#');
+        if (hash) *hash = '\0';
+
+        char *tokens[MANIFEST_TOKENS_MAX];
+        int ntokens = 0;
+        char *save = NULL;
+        for (char *tok = strtok_r(line, " \t\r\n", &save); tok; tok = strtok_r(NULL, " \t\r\n", &save)) {
+            if (ntokens == MANIFEST_TOKENS_MAX) {
+                fprintf(stderr, "rwbatch: %s:%d: too many fields\n", path, lineno);
+                ok = 0;
+                break;
+            }
+            tokens[ntokens++] = tok;
+        }
+        if (!ok || ntokens == 0) continue;
+
+        rw_create_sim_req_t req;
+        char err[128];
+        if (rw_sim_config_parse(&req, tokens, ntokens, err, sizeof(err)) < 0) {
+            fprintf(stderr, "rwbatch: %s:%d: %s\n", path, lineno, err);
+            ok = 0;
+        } else if (!rw_sim_validate(&req)) {
+            fprintf(stderr, "rwbatch: %s:%d: invalid simulation config\n", path, lineno);
+            ok = 0;
+        }
+        for (size_t i = 0; ok && i < n; i++) {
+            if (strcmp(jobs[i].req.out_file, req.out_file) == 0) {
+                fprintf(stderr, "rwbatch: %s:%d: out=%s already used on line %d\n", path, lineno, req.out_file, jobs[i].line);
+                ok = 0;
+            }
+        }
+        if (!ok) break;
+
+        if (n == cap) {
+            size_t ncap = cap ? cap * 2 : 16;
+            job_t *nj = realloc(jobs, ncap * sizeof(*nj));
+            if (!nj) {
+                fprintf(stderr, "rwbatch: out of memory\n");
+                ok = 0;
+                break;
+            }
+            jobs = nj;
+            cap = ncap;
+        }
+        memset(&jobs[n], 0, sizeof(jobs[n]));
+        jobs[n].req = req;
+        jobs[n].line = lineno;
+        n++;
+    }
+    fclose(f);
+
+    if (!ok) {
+        free(jobs);
+        return -1;
+    }
+    *jobs_out = jobs;
+    *njobs_out = n;
+    return 0;
+}
+
+//Runs one job to completion and exports its results.
+static void run_job(job_t *j) {
+    double t0 = now_sec();
+    rw_sim_t *sim = NULL;
+    if (rw_sim_create(&j->req, &sim) < 0) {
+        fprintf(stderr, "rwbatch: line %d: cannot create simulation: %s\n", j->line, strerror(errno));
+        j->failed = 1;
+        return;
+    }
+    rw_sim_run(sim, RW_SIM_RUN_TO_END);
+    if (rw_sim_export(sim, j->req.out_file) < 0) {
+        fprintf(stderr, "rwbatch: line %d: cannot write %s: %s\n", j->line, j->req.out_file, strerror(errno));
+        j->failed = 1;
+    }
+    rw_sim_info_t info;
+    rw_sim_get_info(sim, &info);
+    rw_sim_destroy(sim);
+    j->secs = now_sec() - t0;
+
+    if (!j->failed) {
+        printf("rwbatch: line %d: %ux%u rep_done=%u seed=%u %.3fs -> %s\n",
+               j->line, info.w, info.h, info.rep_done, info.seed_used, j->secs, j->req.out_file);
+        fflush(stdout);
+    }
+}
+
+//Worker thread: takes the next unclaimed job until the queue is empty.
+static void *worker(void *arg) {
+    batch_t *b = (batch_t *)arg;
+    for (;;) {
+        pthread_mutex_lock(&b->lock);
+        size_t i = b->next < b->njobs ? b->next++ : b->njobs;
+        pthread_mutex_unlock(&b->lock);
+        if (i >= b->njobs) break;
+        run_job(&b->jobs[i]);
+    }
+    return NULL;
+}
+
+// Tail-memo benchmark scenario (rwbatch --bench-tail-memo): uniform walk on the obstacle-free torus, fixed seed
+#define BENCH_W 30
+#define BENCH_H 15
+#define BENCH_REPS 100
+#define BENCH_SEED 1u
+
+//Runs the benchmark scenario for every reservoir size (0 = exact walks) and prints, per size, the run time,
+//the steps actually simulated, the speedup over plain walks and the relative error of AVG_STEPS against the
+//spectral solution. Plain walks show the Monte Carlo noise floor; any error beyond it is the bias of the memo.
+static int bench_tail_memo(void) {
+    static const uint32_t caps[] = { 0, 4, 8, 16, 32, 64 };
+    static double exact[RW_MAX_W * RW_MAX_H];
+    const uint32_t q = RW_PROB_SCALE / 4;
+    if (rw_spectral_hitting_times(BENCH_W, BENCH_H, q, q, q, q, exact, RW_MAX_W) < 0) {
+        perror("rwbatch: rw_spectral_hitting_times");
+        return 1;
+    }
+
+    printf("tail-memo benchmark: %ux%u wrap, uniform walk, %u replications, seed %u\n",
+           BENCH_W, BENCH_H, BENCH_REPS, BENCH_SEED);
+    printf("%9s %9s %14s %8s %8s %13s %12s %12s\n", "reservoir", "seconds", "walked_steps",
+           "speedup", "time_x", "memo_finishes", "mean_rel_err", "max_rel_err");
+
+    double base_secs = 0.0;
+    uint64_t base_steps = 0;
+    for (size_t k = 0; k < sizeof(caps) / sizeof(caps[0]); k++) {
+        rw_create_sim_req_t req;
+        memset(&req, 0, sizeof(req));
+        req.w = BENCH_W; req.h = BENCH_H; req.rep_total = BENCH_REPS; req.K = 1000;
+        req.p_up = q; req.p_down = q; req.p_left = q; req.p_right = q;
+        req.world_type = RW_WORLD_WRAP;
+        req.initial_mode = RW_MODE_SUMMARY;
+        req.seed = BENCH_SEED;
+        req.engine = RW_ENGINE_MONTE_CARLO;
+        req.tail_reservoir = caps[k];
+
+        rw_sim_t *sim = NULL;
+        if (rw_sim_create(&req, &sim) < 0) {
+            perror("rwbatch: rw_sim_create");
+            return 1;
+        }
+        double t0 = now_sec();
+        rw_sim_run(sim, RW_SIM_RUN_TO_END);
+        double secs = now_sec() - t0;
+
+        rw_sim_info_t info;
+        rw_sim_get_info(sim, &info);
+        rw_accum_ref_t acc = rw_sim_accumulators(sim);
+
+        double err_sum = 0.0, err_max = 0.0;
+        uint32_t n = 0;
+        for (uint32_t y = 0; y < BENCH_H; y++) {
+            for (uint32_t x = 0; x < BENCH_W; x++) {
+                size_t i = (size_t)y * acc.stride + x;
+                if ((x == 0 && y == 0) || exact[(size_t)y * RW_MAX_W + x] <= 0.0) continue;
+                double ex = exact[(size_t)y * RW_MAX_W + x];
+                double avg = (double)acc.steps_sum[i] / acc.samples[i];
+                double err = fabs(avg - ex) / ex;
+                err_sum += err;
+                if (err > err_max) err_max = err;
+                n++;
+            }
+        }
+        rw_sim_destroy(sim);
+        if (k == 0) { base_secs = secs; base_steps = info.walk_steps; }
+
+        printf("%9u %9.3f %14" PRIu64 " %8.2f %8.2f %13" PRIu64 " %12.4f %12.4f\n",
+               caps[k], secs, info.walk_steps,
+               info.walk_steps ? (double)base_steps / (double)info.walk_steps : 0.0,
+               secs > 0.0 ? base_secs / secs : 0.0,
+               info.tail_memo_finishes, n ? err_sum / n : 0.0, err_max);
+    }
+    return 0;
+}
+
+// NUMA scaling benchmark (rwbatch --bench-numa): the tail-memo scenario without the memo, run as one simulation
+// split into per-thread shards; every thread does the same work, merged after each round like a server tick
+#define BENCH_NUMA_ROUNDS 20
+#define BENCH_NUMA_ROUND_STEPS 1000000u  // steps per thread and round
+
+//Runs the scenario with 1, 2, 4, ... threads up to the usable CPUs, pinned across the NUMA nodes and floating,
+//and prints the throughput and the parallel efficiency against one pinned thread.
+static int bench_numa(void) {
+    rw_numa_topo_t topo;
+    rw_numa_detect(&topo);
+    printf("NUMA benchmark: %u CPU(s) in %u node(s); %ux%u wrap, uniform walk, %u x %u steps per thread\n",
+           topo.ncpus, topo.nnodes, BENCH_W, BENCH_H, BENCH_NUMA_ROUNDS, BENCH_NUMA_ROUND_STEPS);
+    printf("%7s %6s %6s %9s %10s %8s %10s\n", "threads", "nodes", "pinned", "seconds", "Msteps/s", "speedup", "efficiency");
+
+    const uint32_t q = RW_PROB_SCALE / 4;
+    rw_create_sim_req_t req;
+    memset(&req, 0, sizeof(req));
+    req.w = BENCH_W; req.h = BENCH_H; req.rep_total = 1000000; req.K = 1000;
+    req.p_up = q; req.p_down = q; req.p_left = q; req.p_right = q;
+    req.world_type = RW_WORLD_WRAP;
+    req.initial_mode = RW_MODE_SUMMARY;
+    req.seed = BENCH_SEED;
+    req.engine = RW_ENGINE_MONTE_CARLO;
+    snprintf(req.out_file, sizeof(req.out_file), "bench-numa.txt");
+
+    double base_rate = 0.0;
+    for (uint32_t n = 1;; n = n * 2 < topo.ncpus ? n * 2 : topo.ncpus) {
+        for (int pinned = 1; pinned >= 0; pinned--) {
+            rw_par_sim_t *P = NULL;
+            if (rw_par_sim_create(&req, n, pinned ? &topo : NULL, &P) < 0) {
+                perror("rwbatch: rw_par_sim_create");
+                return 1;
+            }
+            uint32_t used[RW_NUMA_MAX_NODES] = {0}, nodes = 0;
+            for (uint32_t i = 0; pinned && i < n; i++) {
+                uint32_t node = rw_numa_node_of_cpu(&topo, rw_par_sim_cpu(P, i));
+                if (!used[node]++) nodes++;
+            }
+
+            double t0 = now_sec();
+            uint64_t steps = 0;
+            for (int r = 0; r < BENCH_NUMA_ROUNDS; r++) {
+                steps += rw_par_sim_run(P, (uint64_t)n * BENCH_NUMA_ROUND_STEPS);
+                (void)rw_par_sim_merged(P);
+            }
+            double secs = now_sec() - t0;
+            rw_par_sim_destroy(P);
+
+            double rate = secs > 0.0 ? (double)steps / secs : 0.0;
+            if (n == 1 && pinned) base_rate = rate;
+            double speedup = base_rate > 0.0 ? rate / base_rate : 0.0;
+            char nodes_str[16];
+            if (pinned) snprintf(nodes_str, sizeof(nodes_str), "%u", nodes);
+            else snprintf(nodes_str, sizeof(nodes_str), "-");
+            printf("%7u %6s %6s %9.3f %10.2f %8.2f %10.2f\n", n, nodes_str, pinned ? "yes" : "no",
+                   secs, rate / 1e6, speedup, speedup / n);
+        }
+        if (n == topo.ncpus) break;
+    }
+    return 0;
+}
+
+//Reads the manifest, gives every seed-0 job its own seed, runs all jobs on a pool of threads
+//and reports the total time. Exits non-zero if any job failed.
+int main(int argc, char **argv) {
+    long threads = 0;
+    int bench_tail = 0;
+    int bench_numa_run = 0;
+
+    static struct option long_opts[] = {
+        {"jobs", required_argument, 0, 'j'},
+        {"bench-tail-memo", no_argument, 0, 'b'},
+        {"bench-numa", no_argument, 0, 'N'},
+        {0, 0, 0, 0}
+    };
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "j:", long_opts, NULL)) != -1) {
+        switch (opt) {
+            case 'j':
+                threads = strtol(optarg, NULL, 10);
+                if (threads <= 0) {
+                    fprintf(stderr, "rwbatch: invalid thread count: %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'b':
+                bench_tail = 1;
+                break;
+            case 'N':
+                bench_numa_run = 1;
+                break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+    if (bench_tail) return bench_tail_memo();
+    if (bench_numa_run) return bench_numa();
+    if (optind + 1 != argc) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    batch_t b;
+    memset(&b, 0, sizeof(b));
+    if (read_manifest(argv[optind], &b.jobs, &b.njobs) < 0) return 1;
+    if (b.njobs == 0) {
+        fprintf(stderr, "rwbatch: %s lists no simulations\n", argv[optind]);
+        free(b.jobs);
+        return 1;
+    }
+
+    // jobs started in the same second would share the engine's time-based seed; spread them instead
+    uint32_t base = (uint32_t)time(NULL) ^ (uint32_t)getpid();
+    for (size_t i = 0; i < b.njobs; i++) {
+        if (b.jobs[i].req.seed != 0) continue;
+        uint32_t s = base + (uint32_t)i * 0x9e3779b9u;
+        b.jobs[i].req.seed = s ? s : 1u;
+    }
+
+    if (threads == 0) threads = sysconf(_SC_NPROCESSORS_ONLN);
+    if (threads <= 0) threads = 1;
+    if ((size_t)threads > b.njobs) threads = (long)b.njobs;
+
+    pthread_t *tids = calloc((size_t)threads, sizeof(*tids));
+    if (!tids) {
+        fprintf(stderr, "rwbatch: out of memory\n");
+        free(b.jobs);
+        return 1;
+    }
+    pthread_mutex_init(&b.lock, NULL);
+
+    double t0 = now_sec();
+    long started = 0;
+    for (; started < threads; started++) {
+        if (pthread_create(&tids[started], NULL, worker, &b) != 0) break;
+    }
+    if (started == 0) worker(&b);   // no threads available: run everything on the main thread
+    for (long t = 0; t < started; t++) pthread_join(tids[t], NULL);
+    double secs = now_sec() - t0;
+
+    size_t failed = 0;
+    for (size_t i = 0; i < b.njobs; i++) failed += b.jobs[i].failed ? 1 : 0;
+    printf("rwbatch: %zu simulation(s), %zu failed, %ld thread(s), %.3fs\n",
+           b.njobs, failed, started ? started : 1, secs);
+
+    pthread_mutex_destroy(&b.lock);
+    free(tids);
+    free(b.jobs);
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,48 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#ifndef CONN_H
+#define CONN_H
+
+// Buffered message connection over a stream socket. Reads take whatever the socket holds in one recv() and hand out
+// the complete messages in it; writes gather queued messages, and a message's header and payload, into one sendmsg().
+// Every call follows the socket's blocking mode: on a non-blocking socket nothing waits, what the kernel does not
+// take stays queued. The receive side and the send side share no state, so one thread may read while another writes.
+typedef struct {
+    int fd;
+    unsigned char *in;                  // receive buffer: bytes [in_pos, in_len) are not handed out yet
+    size_t in_cap, in_pos, in_len;
+    unsigned char *out;                 // send ring, allocated on first use: out_len bytes from out_head on
+    size_t out_cap, out_head, out_len;
+} rw_conn_t;
+
+// Sets up a connection on fd. in_cap bounds the longest message that can be received (header included), out_cap
+// the bytes that may wait to be sent. Turns off Nagle's algorithm, since every write is a whole batch of messages.
+// Returns 0 on success, -1 on error (errno is set).
+int rw_conn_init(rw_conn_t *c, int fd, size_t in_cap, size_t out_cap);
+// Releases the buffers (the socket stays open).
+void rw_conn_free(rw_conn_t *c);
+
+// Reads once into the receive buffer. Returns the bytes read, 0 if a non-blocking socket had nothing,
+// -1 on error or when the peer closed the connection (errno = ECONNRESET).
+ssize_t rw_conn_fill(rw_conn_t *c);
+// Takes the next complete message from the receive buffer; *payload points into it and stays valid until the next
+// rw_conn_fill(). Returns 1 if a message was taken, 0 if more input is needed, -1 if the peer announced a message
+// longer than the buffer (errno = EMSGSIZE).
+int rw_conn_next(rw_conn_t *c, uint16_t *type_out, const unsigned char **payload, uint16_t *len_out);
+// Returns the next message, reading as needed (for blocking sockets). Returns 0 on success, -1 on error.
+int rw_conn_recv(rw_conn_t *c, uint16_t *type_out, const unsigned char **payload, uint16_t *len_out);
+
+// Appends a message (or bytes already framed) to the send queue without writing anything.
+// Returns 0 on success, -1 if it does not fit (errno = ENOBUFS) or on allocation failure.
+int rw_conn_queue(rw_conn_t *c, uint16_t type, const void *payload, uint16_t len);
+int rw_conn_queue_bytes(rw_conn_t *c, const void *p, size_t n);
+// Writes the send queue followed by extra_len bytes of extra (may be NULL) with as few sendmsg() calls as the socket
+// allows. Returns how many bytes of extra were sent (extra starts only once the queue is empty), -1 on a socket error.
+ssize_t rw_conn_flush(rw_conn_t *c, const void *extra, size_t extra_len);
+// Sends a message together with everything queued before it; on a non-blocking socket the unsent rest is queued.
+// Returns 0 on success, -1 on error (errno is set).
+int rw_conn_send(rw_conn_t *c, uint16_t type, const void *payload, uint16_t len);
+
+#endif
@@ -22,7 +22,37 @@ typedef enum {
 
     RW_MSG_STATE,           // server -> client (state_msg_t) streamed periodically
 
-    RW_MSG_ERROR            // either direction (error_msg_t)
+    RW_MSG_ERROR,           // either direction (error_msg_t)
+
+    RW_MSG_EXTEND_SIM,      // client -> server (extend_req_t)   [creator only]
+
+    // Job queue: batch simulations next to the interactive one, no JOIN/STATE streaming
+    RW_MSG_SUBMIT_JOB,      // client -> server (submit_job_req_t)
+    RW_MSG_SUBMIT_ACK,      // server -> client (submit_ack_t)
+    RW_MSG_JOB_STATUS_REQ,  // client -> server (job_ref_t)
+    RW_MSG_JOB_SUBSCRIBE,   // client -> server (job_ref_t): JOB_STATUS now and again when the job ends
+    RW_MSG_JOB_STATUS,      // server -> client (job_status_t)
+
+    // STATE encoding options per client (see STATE_DELTA)
+    RW_MSG_SET_STATE_OPTS,  // client -> server (state_opts_req_t); the next state is sent as a full STATE
+    RW_MSG_STATE_DELTA,     // server -> client (state_delta_hdr_t + variable part)
+    RW_MSG_STATE_COMPACT,   // server -> client (state_compact_hdr_t + variable part), instead of STATE
+
+    // Partial states: a viewport, chosen fields, at most a given rate
+    RW_MSG_SUBSCRIBE,       // client -> server (subscribe_req_t)
+    RW_MSG_STATE_RECT,      // server -> client (state_rect_hdr_t + variable part), instead of STATE
+    RW_MSG_STATE_TILES,     // server -> client (state_tiles_hdr_t + variable part), with RW_STATE_OPT_TILES
+    RW_MSG_WORLD,           // server -> client (world_hdr_t + obstacle bits), after CREATE_ACK / JOIN_ACK
+    RW_MSG_STATE_DYN,       // server -> client (state_dyn_hdr_t + variable part), with RW_STATE_OPT_WORLD
+
+    // Reconnecting after a dropped connection
+    RW_MSG_RESUME,          // client -> server (resume_req_t), instead of HELLO
+    RW_MSG_RESUME_ACK,      // server -> client (resume_ack_t)
+
+    // Per-cell statistics on request (any client, joined or not)
+    RW_MSG_QUERY_CELLS,     // client -> server (query_cells_req_t + cells)
+    RW_MSG_QUERY_RECT,      // client -> server (query_rect_req_t)
+    RW_MSG_QUERY_RESULT     // server -> client (query_result_hdr_t + cell_stats_t[count])
 } rw_msg_type_t;
 
 // ---- Common header ----
@@ -35,7 +65,27 @@ typedef struct {
 // ---- HELLO ----
 typedef struct {
     uint32_t client_id; // assigned by server, non-zero
-} rw_hello_ack_t;
+    uint32_t sim_running;      // 1 if a simulation can be joined
+    uint64_t session_token;    // names this client's session in a later RESUME (0 = not offered)
+} rw_hello_ack_t;             // older servers send only client_id
+
+// ---- RESUME ----
+// A client whose connection dropped connects again and sends RESUME instead of HELLO. Within a short time the
+// server takes it back with its id's rights (creator, job subscriptions), its view and its STATE options; a joined
+// client then gets only the STATE_DELTA messages it missed, if the server still has them and they are smaller
+// than a keyframe.
+typedef struct {
+    uint64_t session_token;    // from HELLO_ACK
+    uint32_t last_seq;         // last state the client applied (0 = none)
+    uint32_t reserved;
+} rw_resume_req_t;
+
+typedef struct {
+    uint32_t ok;               // 0 = unknown or expired token: start again with HELLO
+    uint32_t client_id;        // id of the new connection
+    uint32_t joined;           // 1 = back in the running simulation, states follow
+    rw_global_mode_t mode_now;
+} rw_resume_ack_t;
 
 // ---- CREATE SIM ----
 typedef struct {
@@ -56,6 +106,27 @@ typedef struct {
     // For simplicity: obstacles generated randomly on server (if world_type == OBSTACLES)
     uint32_t obstacle_density_permille; // 0..1000 (e.g., 200 = 20%)
 
+    // RNG seed; 0 = server picks one (such runs are never served from the result cache)
+    uint32_t seed;
+
+    rw_engine_t engine;
+    rw_vr_scheme_t vr_scheme;            // Monte Carlo only
+
+    // Sweep mode (Monte Carlo only): the walk is simulated with p_* above and every alternative vector
+    // is evaluated by likelihood-ratio reweighting of the same trajectories. Results go to out_file.
+    uint32_t sweep_count;                // 0..RW_MAX_SWEEP
+    uint32_t sweep_p[RW_MAX_SWEEP][4];   // p_up, p_down, p_left, p_right; each row sums to RW_PROB_SCALE
+
+    // Rare-event PROB_K (Monte Carlo only): 0/1 = plain estimate, 2..RW_MAX_SPLIT_FACTOR = multilevel splitting.
+    // A walker that gets split_level_step cells closer to [0,0] (torus Manhattan distance) than its last level
+    // is cloned split_factor times, each clone carrying 1/split_factor of its weight.
+    uint32_t split_factor;
+    uint32_t split_level_step;           // >= 1 when splitting
+
+    // Approximate tail-memo mode (Monte Carlo only): 0 = off, else the number of recent hit times kept per cell
+    // (<= RW_MAX_TAIL_RESERVOIR). A walker entering a cell whose reservoir is full finishes with one stored sample.
+    uint32_t tail_reservoir;
+
     // output file where server stores result after finish
     char out_file[RW_PATH_MAX];
 } rw_create_sim_req_t;
@@ -100,6 +171,13 @@ typedef struct {
     uint32_t reason; // 0=unspecified, 1=user_stop
 } rw_stop_req_t;
 
+// ---- EXTEND SIM ----
+// Raises rep_total of the live simulation (running or finished). Accumulators and RNG position are kept,
+// so the engine simply resumes with the extra replications.
+typedef struct {
+    uint32_t extra_reps; // replications to add, > 0
+} rw_extend_req_t;
+
 // ---- STATE (server -> client) ----
 // A single bounded message carrying everything client needs to render.
 typedef struct {
@@ -114,7 +192,7 @@ typedef struct {
     uint32_t w;
     uint32_t h;
 
-    // 0 = running, 1 = finished
+    // 0 = running, 1 = finished (can still be extended), 2 = stopped by creator (server shuts down)
     uint32_t finished;
 
     // INTERACTIVE: last path (up to RW_MAX_PATH)
@@ -123,17 +201,275 @@ typedef struct {
     int16_t  path_x[RW_MAX_PATH];
     int16_t  path_y[RW_MAX_PATH];
 
-    // WORLD: obstacles bitmap for rendering (0/1), only first w*h used
+    // WORLD: obstacles bitmap for rendering (0/1), cell (x, y) at [y * RW_MAX_W + x]
     uint8_t  obstacle[RW_MAX_W * RW_MAX_H];
 
-    // SUMMARY: cell values, only first w*h used.
+    // SUMMARY: cell values, same indexing as obstacle.
     // Meaning depends on the client's local view (AVG_STEPS or PROB_K).
     // Convention:
     // - AVG_STEPS: value = avg_steps * 1000 (fixed-point)
     // - PROB_K:    value = probability * RW_PROB_SCALE (0..RW_PROB_SCALE)
     uint32_t cell_value[RW_MAX_W * RW_MAX_H];
+
+    // number of this state; STATE_DELTA messages build on it (last, so the fields above keep their offsets)
+    uint32_t seq;
 } rw_state_msg_t;
 
+// ---- STATE OPTIONS ----
+#define RW_STATE_OPT_DELTA   0x1u   // send STATE_DELTA instead of STATE while the client is up to date
+#define RW_STATE_OPT_COMPACT 0x2u   // send full states as STATE_COMPACT where that is smaller
+#define RW_STATE_OPT_Q16     0x4u   // with COMPACT: cell values may be quantized to 16 bits (see STATE_COMPACT)
+#define RW_STATE_OPT_SHM     0x8u   // the client reads states from the server's shared memory (shm_state.h): send none;
+                                    // a server that does not publish there ignores it
+#define RW_STATE_OPT_TILES   0x10u  // send the grid as STATE_TILES, only the tiles the client does not hold yet
+                                    // (DELTA, COMPACT and Q16 are then ignored)
+#define RW_STATE_OPT_WORLD   0x20u  // the client keeps the WORLD: full states may come as STATE_DYN
+
+typedef struct {
+    uint32_t flags;   // RW_STATE_OPT_*; unknown bits are ignored
+} rw_state_opts_req_t;
+
+// ---- STATE_DELTA (server -> client) ----
+// Changes from the state numbered base_seq to the one numbered seq. Payload layout:
+//   rw_state_delta_hdr_t
+//   int16_t path_x[path_len], int16_t path_y[path_len]
+//   nruns times: rw_delta_run_t, then uint32_t value[count] for cell_value[start .. start+count)
+// Everything else (w, h, obstacles, cells outside the runs) is unchanged. A full STATE (keyframe) is sent on
+// SET_STATE_OPTS, after SET_VIEW, to clients that missed a state, and periodically; a client that cannot apply
+// a delta (base_seq is not its last state) drops it and waits for the next keyframe.
+typedef struct {
+    uint32_t seq;
+    uint32_t base_seq;
+    uint32_t rep_done;
+    uint32_t rep_total;
+    rw_global_mode_t mode;
+    uint32_t finished;
+    uint32_t path_len;
+    uint32_t nruns;
+} rw_state_delta_hdr_t;
+
+typedef struct {
+    uint16_t start;   // index into cell_value
+    uint16_t count;
+} rw_delta_run_t;
+
+// A delta is never larger than the full STATE (the server sends the keyframe instead).
+#define RW_STATE_DELTA_MAX sizeof(rw_state_msg_t)
+
+// ---- STATE_COMPACT (server -> client) ----
+// A full state with only the w x h region and variable-length values. Payload layout:
+//   rw_state_compact_hdr_t
+//   int16_t path_x[path_len], int16_t path_y[path_len]
+//   if flags & RW_STATE_ENC_OBSTACLES: obstacle bits, ceil(w*h / 8) bytes, LSB first
+//   cell values up to the end of the payload (see common/state_codec.h)
+// Cells are taken row by row, x < w in each row y < h.
+// Everything not sent is 0. With q_shift > 0 the values were sent as value >> q_shift and come back as the
+// middle of their bucket (0 stays 0); later STATE_DELTA runs carry exact values.
+#define RW_STATE_ENC_OBSTACLES 0x1u   // obstacle bits present (else there are none)
+
+typedef struct {
+    uint32_t seq;
+    uint32_t rep_done;
+    uint32_t rep_total;
+    rw_global_mode_t mode;
+    uint32_t w;
+    uint32_t h;
+    uint32_t finished;
+    uint32_t path_len;
+    uint32_t flags;     // RW_STATE_ENC_*
+    uint32_t q_shift;   // 0..16
+} rw_state_compact_hdr_t;
+
+// A compact state is never larger than the full STATE (the server sends STATE instead).
+#define RW_STATE_COMPACT_MAX sizeof(rw_state_msg_t)
+
+// ---- SUBSCRIBE (client -> server) ----
+// Replaces the client's STATE stream (whatever its STATE options) by STATE_RECT messages that carry only the
+// requested fields of a viewport. One is sent when the state changed, at most one per min_interval_ms
+// (0 = every tick). A viewport with w or h 0 is the whole grid; it is clipped to the grid of the running simulation.
+// fields = 0 ends the subscription: the client gets STATE again, starting with a keyframe.
+#define RW_FIELD_PATH      0x1u   // path_x / path_y (INTERACTIVE)
+#define RW_FIELD_OBSTACLES 0x2u
+#define RW_FIELD_VALUES    0x4u   // cell_value of the client's view
+#define RW_FIELD_ALL       (RW_FIELD_PATH | RW_FIELD_OBSTACLES | RW_FIELD_VALUES)
+
+typedef struct {
+    uint16_t x, y;             // viewport origin, x < RW_MAX_W and y < RW_MAX_H
+    uint16_t w, h;             // viewport size in cells
+    uint32_t min_interval_ms;  // at least this long between two STATE_RECT messages
+    uint32_t fields;           // RW_FIELD_*; unknown bits are ignored
+} rw_subscribe_req_t;
+
+// ---- STATE_RECT (server -> client) ----
+// Part of a state. Payload layout:
+//   rw_state_rect_hdr_t
+//   if fields & RW_FIELD_PATH: int16_t path_x[path_len], int16_t path_y[path_len] (whole path, grid coordinates)
+//   if fields & RW_FIELD_OBSTACLES: obstacle bits of the rectangle, ceil(w*h / 8) bytes, LSB first
+//   if fields & RW_FIELD_VALUES: uint32_t cell_value[w*h]
+// Rectangle cells are taken row by row, grid cell (x + i, y + j) is number j * w + i.
+typedef struct {
+    uint32_t seq;
+    uint32_t rep_done;
+    uint32_t rep_total;
+    rw_global_mode_t mode;
+    uint32_t finished;
+    uint32_t grid_w;           // size of the whole grid
+    uint32_t grid_h;
+    uint16_t x, y;             // the rectangle carried: the viewport clipped to the grid
+    uint16_t w, h;
+    uint32_t fields;           // RW_FIELD_* present
+    uint32_t path_len;         // 0 without RW_FIELD_PATH
+} rw_state_rect_hdr_t;
+
+#define RW_STATE_RECT_MAX (sizeof(rw_state_rect_hdr_t) + 2 * RW_MAX_PATH * sizeof(int16_t) + \
+                           (RW_MAX_W * RW_MAX_H + 7) / 8 + RW_MAX_W * RW_MAX_H * sizeof(uint32_t))
+
+// ---- STATE_TILES (server -> client) ----
+// A state with some tiles of its grid. The grid is cut into RW_STATE_TILE x RW_STATE_TILE tiles (the last column and
+// row may be narrower), numbered row by row. Every tile is sent whole and on its own, so the client applies it to
+// whatever it holds: no base state is needed, and a large grid may arrive over several messages. Payload layout:
+//   rw_state_tiles_hdr_t
+//   int16_t path_x[path_len], int16_t path_y[path_len]
+//   ntiles times: rw_state_tile_hdr_t, obstacle bits of the tile (ceil(tw*th / 8) bytes, LSB first),
+//                 uint32_t cell_value[tw*th], both row by row within the tile
+#define RW_STATE_TILE 16u
+#define RW_STATE_TILES_MAX (((RW_MAX_W + RW_STATE_TILE - 1) / RW_STATE_TILE) * \
+                            ((RW_MAX_H + RW_STATE_TILE - 1) / RW_STATE_TILE))
+
+typedef struct {
+    uint32_t seq;
+    uint32_t rep_done;
+    uint32_t rep_total;
+    rw_global_mode_t mode;
+    uint32_t finished;
+    uint32_t grid_w;           // size of the whole grid
+    uint32_t grid_h;
+    uint16_t tile;             // tile edge in cells (RW_STATE_TILE)
+    uint16_t ntiles;           // tiles in this message
+    uint32_t pending;          // tiles that differ from state seq still to come (0 = the client now holds all of it)
+    uint32_t path_len;
+} rw_state_tiles_hdr_t;
+
+typedef struct {
+    uint16_t tx, ty;           // tile column and row
+    uint32_t tile_seq;         // state in which the tile last changed
+} rw_state_tile_hdr_t;
+
+// ---- WORLD (server -> client) ----
+// The part of a simulation that never changes while it runs: grid size, world type and obstacles. Sent once to
+// every client after its CREATE_ACK or JOIN_ACK. Payload layout:
+//   rw_world_hdr_t
+//   obstacle bits of the grid, ceil(w*h / 8) bytes, row by row, LSB first
+typedef struct {
+    uint64_t world_hash;       // FNV-1a over w, h, world_type and the obstacle bits; STATE_DYN names its world by it
+    uint32_t w;
+    uint32_t h;
+    rw_world_type_t world_type;
+    uint32_t reserved;
+} rw_world_hdr_t;
+
+#define RW_WORLD_MAX (sizeof(rw_world_hdr_t) + (RW_MAX_W * RW_MAX_H + 7) / 8)
+
+// ---- STATE_DYN (server -> client) ----
+// A full state without its world, for RW_STATE_OPT_WORLD clients: sent instead of STATE where it is smaller (any
+// grid below the largest). Payload layout:
+//   rw_state_dyn_hdr_t
+//   int16_t path_x[path_len], int16_t path_y[path_len]
+//   uint32_t cell_value[w*h], row by row, with w and h of the world
+typedef struct {
+    uint64_t world_hash;       // WORLD the state belongs to
+    uint32_t seq;
+    uint32_t rep_done;
+    uint32_t rep_total;
+    rw_global_mode_t mode;
+    uint32_t finished;
+    uint32_t path_len;
+} rw_state_dyn_hdr_t;
+
+#define RW_STATE_DYN_MAX (sizeof(rw_state_dyn_hdr_t) + 2 * RW_MAX_PATH * sizeof(int16_t) + \
+                          RW_MAX_W * RW_MAX_H * sizeof(uint32_t))
+
+// ---- QUERY_CELLS / QUERY_RECT (client -> server), QUERY_RESULT (server -> client) ----
+// Statistics of single cells, read from the running simulation as it was at the end of the last tick (what the
+// next STATE shows), so a client can poll a few cells at its own rate instead of taking every state. Every query is
+// answered by a QUERY_RESULT with the same query_id: the cells in the order asked (a rectangle row by row), or
+// ok = 0 and no cells if there is no simulation, a cell lies outside the grid or more than RW_QUERY_CELLS_MAX
+// cells were asked for (an ERROR message says which).
+#define RW_QUERY_CELLS_MAX 256u
+
+typedef struct {
+    uint32_t query_id;         // chosen by the client, echoed in the result
+    uint32_t count;            // cells that follow: uint16_t x, y each
+} rw_query_cells_req_t;
+
+typedef struct {
+    uint32_t query_id;
+    uint16_t x, y;             // rectangle inside the grid, w * h <= RW_QUERY_CELLS_MAX
+    uint16_t w, h;
+} rw_query_rect_req_t;
+
+// Per-cell statistics. Means are in the AVG_STEPS scale (steps * 1000), probabilities in the PROB_K scale
+// (RW_PROB_SCALE); the intervals are 95% confidence intervals: for the mean from the sample variance of the
+// walks, for P(hit within K) the Wilson interval (the splitting estimator's own variance in rare-event runs).
+#define RW_CELL_EXACT     0x1u    // spectral engine: avg_steps is exact (a zero-width interval), no PROB_K
+#define RW_CELL_NO_SPREAD 0x2u    // too few walks with known steps for the mean's interval (avg_lo = avg_hi = 0)
+
+typedef struct {
+    uint16_t x, y;
+    uint32_t samples;          // walks started from the cell
+    uint64_t steps_sum;        // their steps to [0,0]
+    uint32_t hit_k_count;      // walks that reached [0,0] within K steps
+    uint32_t flags;            // RW_CELL_*
+    uint64_t avg_steps, avg_lo, avg_hi;
+    uint32_t prob_k, prob_lo, prob_hi;
+    uint32_t reserved;
+} rw_cell_stats_t;
+
+typedef struct {
+    uint32_t query_id;
+    uint32_t ok;
+    uint32_t rep_done;
+    uint32_t rep_total;
+    uint32_t K;
+    uint32_t count;            // rw_cell_stats_t that follow
+} rw_query_result_hdr_t;
+
+#define RW_QUERY_RESULT_MAX (sizeof(rw_query_result_hdr_t) + RW_QUERY_CELLS_MAX * sizeof(rw_cell_stats_t))
+
+// ---- JOB QUEUE ----
+typedef enum {
+    RW_JOB_UNKNOWN = 0,     // no such job id
+    RW_JOB_QUEUED = 1,
+    RW_JOB_RUNNING = 2,
+    RW_JOB_DONE = 3,        // results written to out_file
+    RW_JOB_FAILED = 4       // rejected by the engine or results could not be written
+} rw_job_state_t;
+
+// Queued jobs start by priority (higher first), FIFO within a priority. initial_mode is ignored.
+typedef struct {
+    int32_t priority;
+    rw_create_sim_req_t req;
+} rw_submit_job_req_t;
+
+typedef struct {
+    uint32_t ok;       // 1 queued, 0 rejected (an ERROR message says why)
+    uint32_t job_id;
+} rw_submit_ack_t;
+
+typedef struct {
+    uint32_t job_id;
+} rw_job_ref_t;
+
+typedef struct {
+    uint32_t job_id;
+    rw_job_state_t state;
+    int32_t priority;
+    uint32_t queue_pos;    // jobs that start before this one (RW_JOB_QUEUED only)
+    uint32_t rep_done;
+    uint32_t rep_total;
+    char out_file[RW_PATH_MAX];
+} rw_job_status_t;
+
 // ---- ERROR ----
 typedef struct {
     int32_t code;          // your internal error codes
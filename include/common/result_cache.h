@@ -0,0 +1,28 @@
+#include <stdint.h>
+#include "types.h"
+#include "sim_key.h"
+
+#ifndef RESULT_CACHE_H
+#define RESULT_CACHE_H
+
+// Disk-backed result cache: one file per simulation key inside dir, evicted least-recently-used
+// first once the total size exceeds max_bytes.
+typedef struct {
+    char dir[RW_PATH_MAX];
+    uint64_t max_bytes;
+} rw_cache_t;
+
+// Prepares the cache directory (created if missing). Returns 0 on success, -1 on error (errno is set).
+int rw_cache_init(rw_cache_t *c, const char *dir, uint64_t max_bytes);
+
+// Looks up the accumulators stored for key.
+// Returns 1 on hit (acc, *rep_done_out and *rng_state_out are filled), 0 on miss, -1 on error.
+int rw_cache_load(const rw_cache_t *c, const rw_sim_key_t *key, const rw_accum_ref_t *acc,
+                  uint32_t *rep_done_out, uint32_t *rng_state_out);
+
+// Stores accumulators after rep_done full-grid replications together with the RNG state that
+// continues the run, then enforces the size cap. Returns 0 on success, -1 on error (errno is set).
+int rw_cache_store(const rw_cache_t *c, const rw_sim_key_t *key, const rw_accum_ref_t *acc,
+                   uint32_t rep_done, uint32_t rng_state);
+
+#endif
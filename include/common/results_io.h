@@ -0,0 +1,57 @@
+#include <stdint.h>
+#include "types.h"
+#include "sim_key.h"
+
+#ifndef RESULTS_IO_H
+#define RESULTS_IO_H
+
+// Result files come in two formats, chosen by the file extension:
+// - results text (default): rounded AVG_STEPS / PROB_K tables for humans
+// - shard (*.shard): raw steps_sum / samples / hit_k_count plus config and seeds, so
+//   independent runs of the same configuration can be merged exactly (see rw_merge)
+#define RW_SHARD_SUFFIX ".shard"
+
+// A shard in memory. key.seed is the seed of the first contributing run; seeds lists all of them.
+typedef struct {
+    rw_sim_key_t key;
+    uint32_t rep_done;
+
+    uint32_t nseeds;
+    uint32_t *seeds;
+
+    rw_accum_ref_t acc;  // owned by the shard after rw_shard_read/rw_shard_alloc (stride == key.w)
+} rw_shard_t;
+
+// Returns 1 if path names a shard file.
+int rw_path_is_shard(const char *path);
+
+// Writes the human-readable results table (average steps and probability to hit within K per cell).
+// extra_header (may be NULL) holds additional "# ..." lines for the header.
+// Returns 0 on success, -1 on error (errno is set).
+int rw_results_write_text(const char *path, const rw_sim_key_t *key, uint32_t rep_done, uint32_t rep_total,
+                          const rw_accum_ref_t *acc, const char *extra_header);
+
+// Writes the exact AVG_STEPS table of the spectral engine (values row-major with row stride `stride`).
+// Returns 0 on success, -1 on error (errno is set).
+int rw_results_write_exact(const char *path, const rw_sim_key_t *key, const double *avg, uint32_t stride);
+
+// Writes a shard for one run. Returns 0 on success, -1 on error (errno is set).
+int rw_shard_write(const char *path, const rw_sim_key_t *key, uint32_t rep_done,
+                   const uint32_t *seeds, uint32_t nseeds, const rw_accum_ref_t *acc);
+
+// Allocates an empty shard for key (zeroed accumulators, no seeds). Returns 0 on success, -1 on error.
+int rw_shard_alloc(rw_shard_t *sh, const rw_sim_key_t *key);
+
+// Parses a shard file into freshly allocated memory. Returns 0 on success, -1 on error (errno is set).
+int rw_shard_read(const char *path, rw_shard_t *out);
+
+// Adds src into dst. Fails with EINVAL if the configurations differ and with ERANGE if a counter would overflow.
+// Returns 0 on success, -1 on error; dst is unchanged on error.
+int rw_shard_merge(rw_shard_t *dst, const rw_shard_t *src);
+
+// Writes a shard in the format chosen by the extension of path (shard or results text).
+int rw_shard_write_any(const char *path, const rw_shard_t *sh);
+
+void rw_shard_free(rw_shard_t *sh);
+
+#endif
@@ -0,0 +1,64 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <stdatomic.h>
+#include "protocol.h"
+
+#ifndef SHM_STATE_H
+#define SHM_STATE_H
+
+// Latest STATE of each view, published by the server in a POSIX shared-memory object for viewers on the same host.
+// Every view has two slots: the server writes the one readers were not sent to, then points them at it, so a reader
+// can use the current slot in place for a whole tick. Each slot also carries a sequence lock (odd while written),
+// which tells a reader that was slower than that to throw away what it read.
+#define RW_SHM_MAGIC   0x48535752u   // "RWSH"
+#define RW_SHM_VERSION 1u
+
+typedef struct {
+    _Atomic uint32_t seq;            // even = stable, odd = being written; +2 per write
+    uint32_t reserved;
+    rw_state_msg_t st;
+} rw_shm_slot_t;
+
+typedef struct {
+    _Atomic uint32_t active;         // slot readers take (0 or 1)
+    _Atomic uint32_t published;      // states published to this view so far (0 = none yet)
+    rw_shm_slot_t slot[2];
+} rw_shm_view_t;
+
+typedef struct {
+    uint32_t magic;                  // RW_SHM_MAGIC, written last when the region is set up
+    uint32_t version;                // RW_SHM_VERSION
+    uint32_t size;                   // sizeof(rw_shm_region_t)
+    _Atomic uint32_t live;           // 1 while a simulation is published, 0 between sessions and after exit
+    rw_shm_view_t view[2];           // RW_VIEW_AVG_STEPS, RW_VIEW_PROB_K
+} rw_shm_region_t;
+
+typedef struct {
+    rw_shm_region_t *r;
+    char name[64];
+    int owner;                       // created the object: unlinks it on close
+} rw_shm_state_t;
+
+// Region name used by the server on a port, also the client's default.
+void rw_shm_state_name(char *out, size_t cap, uint16_t port);
+
+// Server side. Creates (or takes over) the region and maps it writable. Returns 0 on success, -1 on error (errno is set).
+int rw_shm_state_create(rw_shm_state_t *s, const char *name);
+// Publishes st as the newest state of a view.
+void rw_shm_state_publish(rw_shm_state_t *s, rw_local_view_t view, const rw_state_msg_t *st);
+// Marks whether a simulation is being published.
+void rw_shm_state_set_live(rw_shm_state_t *s, int live);
+
+// Viewer side. Maps an existing region read-only. Returns 0 on success, -1 on error: errno = ENOENT if the server
+// publishes nothing under that name, EPROTO if the region has another layout.
+int rw_shm_state_open(rw_shm_state_t *s, const char *name);
+// Returns the newest state of a view straight from the mapping (NULL if none is published yet or a write is under
+// way) and its ticket. Check the state with rw_shm_state_valid() once done with it.
+const rw_state_msg_t *rw_shm_state_begin(const rw_shm_state_t *s, rw_local_view_t view, uint32_t *ticket);
+// Returns 1 if the state from rw_shm_state_begin() was not overwritten while it was being read, 0 if it was.
+int rw_shm_state_valid(const rw_shm_state_t *s, const rw_state_msg_t *st, uint32_t ticket);
+
+// Unmaps the region; the server also removes it, after marking it not live.
+void rw_shm_state_close(rw_shm_state_t *s);
+
+#endif
@@ -0,0 +1,24 @@
+#include <stddef.h>
+#include "protocol.h"
+
+#ifndef SIM_CONFIG_H
+#define SIM_CONFIG_H
+
+// Text form of a CREATE_SIM request, shared by rwbatch manifests and the client's command-line job submission:
+// whitespace-separated key=value pairs.
+//   required: w h reps K out
+//   optional: p_up p_down p_left p_right (default 250000 each), seed (0 = random),
+//             engine=mc|spectral, vr=none|antithetic|control_variate, tail=N,
+//             split=F split_step=S, sweep=u,d,l,r (repeatable)
+
+// Fills req with the defaults (uniform walk, wrap world, summary mode, Monte Carlo, no estimator options).
+void rw_sim_config_defaults(rw_create_sim_req_t *req);
+
+// Applies one key=value pair. Returns 0 on success, -1 on an unknown key or a bad value.
+int rw_sim_config_set(rw_create_sim_req_t *req, const char *key, const char *val);
+
+// Parses a list of "key=value" tokens into req (defaults first). Returns 0 on success, -1 on error with a
+// message in err. Only the syntax and the required keys are checked; use rw_sim_validate for the rest.
+int rw_sim_config_parse(rw_create_sim_req_t *req, char *const *tokens, int ntokens, char *err, size_t err_size);
+
+#endif
@@ -0,0 +1,33 @@
+#include <stdint.h>
+
+#ifndef SIM_KEY_H
+#define SIM_KEY_H
+
+// Everything that determines the outcome of a simulation (given the same number of replications).
+// Two runs with equal keys produce identical accumulators, so results can be reused or merged.
+typedef struct {
+    uint32_t w;
+    uint32_t h;
+    uint32_t K;
+
+    uint32_t p_up;
+    uint32_t p_down;
+    uint32_t p_left;
+    uint32_t p_right;
+
+    uint32_t world_type;
+    uint32_t obstacle_density_permille;
+
+    uint32_t seed;
+} rw_sim_key_t;
+
+// Canonical 64-bit hash of the key (FNV-1a over little-endian fields), independent of host byte order.
+uint64_t rw_sim_key_hash(const rw_sim_key_t *k);
+
+// Returns 1 if both keys describe the same simulation.
+int rw_sim_key_equal(const rw_sim_key_t *a, const rw_sim_key_t *b);
+
+// Returns 1 if both keys describe the same simulation up to the seed, i.e. their samples can be pooled.
+int rw_sim_key_compatible(const rw_sim_key_t *a, const rw_sim_key_t *b);
+
+#endif
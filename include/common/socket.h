@@ -4,12 +4,18 @@
 #ifndef SOCKET_H
 #define SOCKET_H
 
+#define RW_MSG_HDR_SIZE 4
+
 // Returns 0 on success, -1 on error (errno is set).
 int rw_send_all(int fd, const void *buf, size_t len);
 int rw_recv_all(int fd, void *buf, size_t len);
 
 // Convenience helpers
 int rw_send_msg(int fd, uint16_t type, const void *payload, uint16_t payload_len);
+// Writes the wire header of a message (RW_MSG_HDR_SIZE bytes) to out, for messages framed once and sent many times.
+void rw_pack_hdr(void *out, uint16_t type, uint16_t payload_len);
+// Reads a wire header from a receive buffer (the counterpart of rw_pack_hdr, for callers that do their own reads).
+void rw_unpack_hdr(const void *in, uint16_t *type_out, uint16_t *len_out);
 int rw_recv_hdr(int fd, uint16_t *type_out, uint16_t *len_out);
 
 // TCP helpers
@@ -0,0 +1,22 @@
+#include <stdint.h>
+
+#ifndef SPECTRAL_H
+#define SPECTRAL_H
+
+// Exact expected hitting times of [0,0] on the obstacle-free w x h torus (RW_WORLD_WRAP).
+//
+// With step distribution mu and Fourier symbol phi(k) = sum_z mu(z) e^{2 pi i k.z}, the expected
+// number of steps from x to the origin is
+//     E_x[T] = sum_{k != 0} (1 - e^{2 pi i k.x}) / (1 - phi(k)),
+// which is evaluated for the whole grid with one 2D FFT in O(wh log wh). Biased probability vectors
+// are supported; any w, h >= 1 work (non power-of-two sizes use Bluestein's algorithm).
+//
+// Probabilities are fixed-point (sum RW_PROB_SCALE). out receives E_x[T] for every cell,
+// row-major with row stride `stride` (>= w). Returns 0 on success, -1 on error:
+// errno = EDOM if some cell can never reach the origin (the walk is not irreducible on the torus),
+// EINVAL for bad arguments, ENOMEM if the work buffers cannot be allocated.
+int rw_spectral_hitting_times(uint32_t w, uint32_t h,
+                              uint32_t p_up, uint32_t p_down, uint32_t p_left, uint32_t p_right,
+                              double *out, uint32_t stride);
+
+#endif
@@ -0,0 +1,67 @@
+#include <stddef.h>
+#include "protocol.h"
+
+#ifndef STATE_CODEC_H
+#define STATE_CODEC_H
+
+// STATE_COMPACT encoding of a full state (layout in protocol.h). Cell values are coded as the difference to the
+// previous cell (the first to 0), zigzag-mapped to unsigned and written as a little-endian base-128 varint.
+// A 0 token is followed by a varint n and stands for n + 1 more cells equal to the previous one, so empty and
+// flat regions cost a few bytes.
+
+// Encodes st into out (at most cap bytes). With q16 the values are shifted right just enough for the largest one to
+// fit in 16 bits. Returns the payload size, or 0 if it would not fit in cap.
+size_t rw_state_encode_compact(const rw_state_msg_t *st, int q16, unsigned char *out, size_t cap);
+
+// Decodes a STATE_COMPACT payload straight into st, clearing everything the message does not carry.
+// Returns 0 on success, -1 if the payload is malformed (errno = EINVAL); st is then left partly written.
+int rw_state_decode_compact(const unsigned char *p, size_t len, rw_state_msg_t *st);
+
+// STATE_RECT (layout in protocol.h): the fields and rectangle of sub taken from st, with the viewport clipped to
+// st's grid. Returns the payload size, or 0 if it would not fit in cap.
+size_t rw_state_encode_rect(const rw_state_msg_t *st, const rw_subscribe_req_t *sub, unsigned char *out, size_t cap);
+
+// Decodes a STATE_RECT payload into st in grid coordinates: what the message does not carry is 0. The header goes
+// to hdr_out (may be NULL). Returns 0 on success, -1 if the payload is malformed (errno = EINVAL).
+int rw_state_decode_rect(const unsigned char *p, size_t len, rw_state_msg_t *st, rw_state_rect_hdr_t *hdr_out);
+
+// STATE_TILES (layout in protocol.h): tiles are numbered row by row over st's grid.
+
+// Number of tiles of st's grid (at most RW_STATE_TILES_MAX).
+uint32_t rw_state_tile_count(const rw_state_msg_t *st);
+// Bytes one tile takes in a STATE_TILES payload.
+size_t rw_state_tile_bytes(const rw_state_msg_t *st, uint32_t tile);
+// Returns 1 if the obstacles or values of a tile differ between a and b (two states of the same grid), 0 if not.
+int rw_state_tile_changed(const rw_state_msg_t *a, const rw_state_msg_t *b, uint32_t tile);
+// Encodes the header and path of st and the n tiles listed in tiles, each tagged with tile_seq[tile]; pending goes
+// into the header as is. Returns the payload size, or 0 if it would not fit in cap.
+size_t rw_state_encode_tiles(const rw_state_msg_t *st, const uint32_t *tiles, uint32_t n, const uint32_t *tile_seq,
+                             uint32_t pending, unsigned char *out, size_t cap);
+// Applies a STATE_TILES payload to st: header and path are replaced, the tiles carried overwrite their cells and the
+// other cells keep what st held (st is cleared first if its grid has another size). The header goes to hdr_out
+// (may be NULL). Returns 0 on success, -1 if the payload is malformed (errno = EINVAL); st is then unchanged.
+int rw_state_decode_tiles(const unsigned char *p, size_t len, rw_state_msg_t *st, rw_state_tiles_hdr_t *hdr_out);
+
+// WORLD and STATE_DYN (layouts in protocol.h): the static part of a simulation, sent once, and the rest of each state.
+typedef struct {
+    uint64_t hash;                          // 0 = no world yet
+    uint32_t w, h;
+    rw_world_type_t world_type;
+    uint8_t obstacle[RW_MAX_W * RW_MAX_H];  // cell (x, y) at [y * RW_MAX_W + x], as in rw_state_msg_t
+} rw_world_t;
+
+// Encodes the world of st (grid size and obstacles) with world_type; its hash also goes to hash_out (may be NULL).
+// Returns the payload size, or 0 if it would not fit in cap.
+size_t rw_world_encode(const rw_state_msg_t *st, rw_world_type_t world_type, uint64_t *hash_out, unsigned char *out,
+                       size_t cap);
+// Decodes a WORLD payload. Returns 0 on success, -1 if the payload is malformed or does not match its hash
+// (errno = EINVAL).
+int rw_world_decode(const unsigned char *p, size_t len, rw_world_t *world);
+// Encodes st as STATE_DYN: everything but its world, which world_hash names. Returns the payload size, or 0 if it
+// would not fit in cap.
+size_t rw_state_encode_dyn(const rw_state_msg_t *st, uint64_t world_hash, unsigned char *out, size_t cap);
+// Decodes a STATE_DYN payload into a full st, with size and obstacles taken from world. Returns 0 on success, -1 if
+// the payload is malformed (errno = EINVAL) or belongs to another world (errno = ESTALE); st is then unchanged.
+int rw_state_decode_dyn(const unsigned char *p, size_t len, const rw_world_t *world, rw_state_msg_t *st);
+
+#endif
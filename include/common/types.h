@@ -8,6 +8,9 @@
 #define RW_MAX_H     30
 #define RW_MAX_PATH  128
 #define RW_PATH_MAX  128
+#define RW_MAX_SWEEP 20   // alternative probability vectors per sweep
+#define RW_MAX_SPLIT_FACTOR 8  // clones per level crossing in multilevel splitting
+#define RW_MAX_TAIL_RESERVOIR 64  // stored hit-time samples per cell in tail-memo mode
 
 // Probabilities are fixed-point in [0 .. RW_PROB_SCALE], sum must be RW_PROB_SCALE
 #define RW_PROB_SCALE 1000000u
@@ -17,6 +20,15 @@ typedef struct {
     int32_t y;
 } rw_pos_t;
 
+// Raw per-cell accumulators of a simulation. Arrays are row-major with the given row stride
+// (the server uses RW_MAX_W); only the w x h cells of the simulation are meaningful.
+typedef struct {
+    uint64_t *steps_sum;
+    uint32_t *samples;
+    uint32_t *hit_k_count;
+    uint32_t stride;
+} rw_accum_ref_t;
+
 typedef enum {
     RW_WORLD_WRAP      = 1, // no obstacles (or obstacles ignored), wrap-around edges
     RW_WORLD_OBSTACLES = 2  // obstacles present, no wrap unless you decide otherwise
@@ -27,6 +39,19 @@ typedef enum {
     RW_MODE_SUMMARY     = 2
 } rw_global_mode_t;
 
+// Engine that fills the accumulators / results
+typedef enum {
+    RW_ENGINE_MONTE_CARLO = 0, // replications of random walks (default)
+    RW_ENGINE_SPECTRAL    = 1  // exact AVG_STEPS via the torus Fourier solver; RW_WORLD_WRAP only, no PROB_K
+} rw_engine_t;
+
+// Variance-reduction scheme of the Monte Carlo engine
+typedef enum {
+    RW_VR_NONE             = 0, // plain sampling
+    RW_VR_ANTITHETIC       = 1, // each walk is paired with one driven by the mirrored random draws
+    RW_VR_CONTROL_VARIATE  = 2  // coupled unbiased reference walk with exactly known mean (RW_WORLD_WRAP only)
+} rw_vr_scheme_t;
+
 typedef enum {
     RW_VIEW_AVG_STEPS = 1,  // average steps to reach [0,0]
     RW_VIEW_PROB_K    = 2   // probability to reach [0,0] within K steps
@@ -0,0 +1,87 @@
+#include <stdint.h>
+#include "common/types.h"
+#include "common/protocol.h"
+#include "common/result_cache.h"
+
+#ifndef ENGINE_H
+#define ENGINE_H
+
+// Random-walk simulation engine: one configured simulation (Monte Carlo or exact spectral) with its accumulators.
+// The engine does no I/O besides the result cache and the exported results file, and holds no global state,
+// so independent simulations can run in parallel threads (one thread per rw_sim_t).
+typedef struct rw_sim rw_sim_t;
+
+// Pass to rw_sim_run to run until rep_total replications are complete.
+#define RW_SIM_RUN_TO_END UINT64_MAX
+
+// Progress and configuration summary of a simulation.
+typedef struct {
+    uint32_t w, h, K;
+    uint32_t rep_done, rep_total;
+    rw_world_type_t world_type;
+    rw_engine_t engine;
+    uint32_t seed_used;          // seed the RNG started from (the requested one, or a random one for seed 0)
+    int finished;                // rep_done >= rep_total
+    uint64_t walk_steps;         // steps simulated by the plain step loop
+    uint64_t tail_memo_finishes; // walks ended by a stored tail sample (tail-memo mode)
+} rw_sim_info_t;
+
+// Returns 1 if req describes a simulation the engine can run (bounds, probabilities, engine/option combinations).
+int rw_sim_validate(const rw_create_sim_req_t *req);
+
+// Creates a simulation from a CREATE_SIM request. initial_mode and out_file are only validated; display mode and
+// the output path are up to the caller (see rw_sim_display_step, rw_sim_export).
+// Returns 0 on success, -1 on error: errno = EINVAL if rw_sim_validate rejects req, EDOM if the spectral engine
+// or the control variate has no finite solution, ENOMEM if out of memory.
+int rw_sim_create(const rw_create_sim_req_t *req, rw_sim_t **out);
+
+void rw_sim_destroy(rw_sim_t *S);
+
+// Warm-starts a fresh simulation from the result cache. Only an entry with at most rep_total replications is used,
+// so a seeded run gives the same results whatever earlier runs left in the cache. Returns the number of cached
+// replications that were restored (0 on a miss or for runs that are never cached), -1 on error (errno is set).
+int rw_sim_load_cached(rw_sim_t *S, const rw_cache_t *cache);
+
+// Stores the accumulators of a run that ended on a replication boundary. Returns 1 if an entry was written,
+// 0 if there was nothing new to store, -1 on error (errno is set).
+int rw_sim_store_cached(rw_sim_t *S, const rw_cache_t *cache);
+
+// Advances the statistics by up to max_steps random-walk steps across as many trajectories as fit,
+// or until the run is complete. Returns the number of steps taken.
+uint64_t rw_sim_run(rw_sim_t *S, uint64_t max_steps);
+
+// Advances the display-only walker by one step (interactive animation; never changes the statistics).
+void rw_sim_display_step(rw_sim_t *S);
+
+// Raises rep_total by extra_reps, continuing from the current accumulators and RNG position.
+// Returns 0 on success, -1 on error: errno = ENOTSUP for exact results, ERANGE if the count is 0 or overflows.
+int rw_sim_extend(rw_sim_t *S, uint32_t extra_reps);
+
+void rw_sim_get_info(const rw_sim_t *S, rw_sim_info_t *out);
+
+// Sets dst's accumulators, replication counts and step count to the sums over parts: independent runs of the same
+// configuration (e.g. the per-thread shards of rw_par_sim). dst keeps its display walker. Only plain Monte Carlo runs
+// (no sweep, splitting, tail memo or variance reduction) can be merged. A merged simulation is never cached.
+// Returns 0 on success, -1 on error (errno = EINVAL if a run cannot be merged or the configurations differ).
+int rw_sim_merge(rw_sim_t *dst, rw_sim_t *const *parts, uint32_t nparts);
+
+// Change counter: differs from an earlier value whenever a snapshot could differ (statistics, display path,
+// replication count), so callers can reuse a snapshot while it stays the same.
+uint64_t rw_sim_version(const rw_sim_t *S);
+
+// Read-only view of the raw accumulators (row stride RW_MAX_W). All zero for the spectral engine.
+rw_accum_ref_t rw_sim_accumulators(rw_sim_t *S);
+
+// Fills a STATE snapshot for the given view: progress, dimensions, per-cell values and, if with_path is set,
+// the display walker's path. mode is left 0 and finished is 0/1; both are the caller's to adjust.
+void rw_sim_snapshot(const rw_sim_t *S, rw_local_view_t view, int with_path, rw_state_msg_t *out);
+
+// Fills the statistics of the walks started from cell (x, y), which must lie inside the grid: raw counts, the mean
+// steps and P(hit within K) with their confidence intervals (see rw_cell_stats_t).
+void rw_sim_cell_stats(const rw_sim_t *S, uint32_t x, uint32_t y, rw_cell_stats_t *out);
+
+// Writes the results to path: a raw shard if the name ends in .shard, otherwise the text tables.
+// Returns 0 on success, -1 on error (errno is set).
+int rw_sim_export(rw_sim_t *S, const char *path);
+
+#endif
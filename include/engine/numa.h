@@ -0,0 +1,43 @@
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef NUMA_H
+#define NUMA_H
+
+// Memory and CPU placement for multi-threaded runs: NUMA topology, thread pinning and huge-page backed buffers.
+// Uses the Linux sysfs node layout and scheduler affinity API; without NUMA information there is a single node.
+
+#define RW_NUMA_MAX_NODES 64
+#define RW_NUMA_MAX_CPUS 1024
+
+// CPUs usable by this process, grouped by NUMA node.
+typedef struct {
+    uint32_t nnodes;
+    uint32_t ncpus;                          // total over all nodes
+    uint32_t node_first[RW_NUMA_MAX_NODES];  // index of the node's first CPU in cpu[]
+    uint32_t node_ncpus[RW_NUMA_MAX_NODES];
+    uint16_t cpu[RW_NUMA_MAX_CPUS];          // CPU ids, node by node
+} rw_numa_topo_t;
+
+// Reads the node layout from /sys/devices/system/node, restricted to the CPUs this process may run on.
+// Without NUMA information all usable CPUs form node 0. Never fails; ncpus is at least 1.
+void rw_numa_detect(rw_numa_topo_t *t);
+
+// CPU for worker thread i: threads are spread round-robin over the nodes, then over the CPUs of each node.
+int rw_numa_cpu_for_thread(const rw_numa_topo_t *t, uint32_t i);
+
+// Node of a CPU returned by rw_numa_cpu_for_thread.
+uint32_t rw_numa_node_of_cpu(const rw_numa_topo_t *t, int cpu);
+
+// Pins the calling thread to one CPU. Returns 0 on success, -1 on error (errno is set).
+int rw_numa_pin_self(int cpu);
+
+// Allocates size bytes of zeroed, page-aligned memory; buffers of 2 MB and more are backed by transparent huge pages
+// where the kernel allows it. Pages are placed on the node of the thread that first writes them.
+// Returns NULL on error (errno = ENOMEM).
+void *rw_huge_alloc(size_t size);
+
+// Releases a buffer from rw_huge_alloc (size as passed there).
+void rw_huge_free(void *p, size_t size);
+
+#endif
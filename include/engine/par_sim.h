@@ -0,0 +1,42 @@
+#include <stdint.h>
+#include "common/protocol.h"
+#include "engine/engine.h"
+#include "engine/numa.h"
+
+#ifndef PAR_SIM_H
+#define PAR_SIM_H
+
+// One simulation run by several worker threads. Each thread owns a full accumulator shard (its own rw_sim_t with its
+// own seed and share of the replications), allocated by the thread itself after it has been pinned, so the shard's
+// pages live on the thread's NUMA node and no cache line is written by two threads. The shards are summed into one
+// rw_sim_t only when it is asked for (snapshot, results file).
+typedef struct rw_par_sim rw_par_sim_t;
+
+// Returns 1 if req can be split into shards: plain Monte Carlo (see rw_sim_merge) written to a text results file.
+int rw_par_sim_supported(const rw_create_sim_req_t *req);
+
+// Starts nthreads workers (at most one per replication) and creates their shards. With topo, worker i is pinned to
+// rw_numa_cpu_for_thread(topo, i); with NULL the threads float. Shard 0 uses the requested seed, shard i that seed
+// plus i * 0x9e3779b9 (a random base for seed 0), so a run with one thread equals the serial run.
+// Returns 0 on success, -1 on error: errno = EINVAL if the request is not supported, ENOMEM or a thread error.
+int rw_par_sim_create(const rw_create_sim_req_t *req, uint32_t nthreads, const rw_numa_topo_t *topo, rw_par_sim_t **out);
+
+void rw_par_sim_destroy(rw_par_sim_t *P);
+
+uint32_t rw_par_sim_threads(const rw_par_sim_t *P);
+
+// CPU worker i is pinned to, -1 if it floats.
+int rw_par_sim_cpu(const rw_par_sim_t *P, uint32_t i);
+
+// Runs all shards in parallel for up to max_steps steps in total (split evenly) and waits for them.
+// Returns the number of steps taken.
+uint64_t rw_par_sim_run(rw_par_sim_t *P, uint64_t max_steps);
+
+// Raises the replication count by extra_reps, spread over the shards. Same errors as rw_sim_extend.
+int rw_par_sim_extend(rw_par_sim_t *P, uint32_t extra_reps);
+
+// Merges the shards and returns the combined simulation for rw_sim_get_info, rw_sim_snapshot, rw_sim_export and
+// rw_sim_display_step. It is owned by P and reflects the shards as of this call.
+rw_sim_t *rw_par_sim_merged(rw_par_sim_t *P);
+
+#endif
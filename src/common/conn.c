@@ -0,0 +1,151 @@
+// src/common/conn.c
+#include "common/conn.h"
+#include "common/socket.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+//Allocates the receive buffer (the send ring waits until something is queued) and disables Nagle's algorithm.
+int rw_conn_init(rw_conn_t *c, int fd, size_t in_cap, size_t out_cap) {
+    memset(c, 0, sizeof(*c));
+    if (in_cap < RW_MSG_HDR_SIZE) { errno = EINVAL; return -1; }
+    c->in = malloc(in_cap);
+    if (!c->in) { errno = ENOMEM; return -1; }
+    c->fd = fd;
+    c->in_cap = in_cap;
+    c->out_cap = out_cap;
+
+    // not a TCP socket (e.g. a socketpair): nothing to turn off
+    int one = 1;
+    (void)setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    return 0;
+}
+
+//Frees both buffers; the socket is the caller's to close.
+void rw_conn_free(rw_conn_t *c) {
+    free(c->in);
+    free(c->out);
+    c->in = c->out = NULL;
+    c->in_pos = c->in_len = c->out_head = c->out_len = 0;
+}
+
+//Moves the unread bytes to the front of the receive buffer and reads once into the free space behind them.
+ssize_t rw_conn_fill(rw_conn_t *c) {
+    // keep the unread bytes at the front, so a partial message always has room to complete
+    if (c->in_pos > 0) {
+        memmove(c->in, c->in + c->in_pos, c->in_len - c->in_pos);
+        c->in_len -= c->in_pos;
+        c->in_pos = 0;
+    }
+    if (c->in_len == c->in_cap) { errno = ENOBUFS; return -1; }
+
+    for (;;) {
+        ssize_t n = recv(c->fd, c->in + c->in_len, c->in_cap - c->in_len, 0);
+        if (n > 0) {
+            c->in_len += (size_t)n;
+            return n;
+        }
+        if (n == 0) { errno = ECONNRESET; return -1; }
+        if (errno == EINTR) continue;
+        return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+    }
+}
+
+//Hands out the next complete message in the receive buffer without copying it.
+int rw_conn_next(rw_conn_t *c, uint16_t *type_out, const unsigned char **payload, uint16_t *len_out) {
+    size_t avail = c->in_len - c->in_pos;
+    if (avail < RW_MSG_HDR_SIZE) return 0;
+    uint16_t type = 0, len = 0;
+    rw_unpack_hdr(c->in + c->in_pos, &type, &len);
+    if ((size_t)len > c->in_cap - RW_MSG_HDR_SIZE) { errno = EMSGSIZE; return -1; }
+    if (avail - RW_MSG_HDR_SIZE < len) return 0;
+
+    *type_out = type;
+    *len_out = len;
+    *payload = c->in + c->in_pos + RW_MSG_HDR_SIZE;
+    c->in_pos += RW_MSG_HDR_SIZE + (size_t)len;
+    return 1;
+}
+
+//Returns the next message, reading whenever the buffer holds only part of one.
+int rw_conn_recv(rw_conn_t *c, uint16_t *type_out, const unsigned char **payload, uint16_t *len_out) {
+    for (;;) {
+        int rc = rw_conn_next(c, type_out, payload, len_out);
+        if (rc != 0) return rc > 0 ? 0 : -1;
+        ssize_t n = rw_conn_fill(c);
+        if (n < 0) return -1;
+        if (n == 0) { errno = EAGAIN; return -1; }   // a non-blocking socket with nothing buffered
+    }
+}
+
+//Appends n bytes to the send ring, wrapping around its end.
+int rw_conn_queue_bytes(rw_conn_t *c, const void *p, size_t n) {
+    if (c->out_cap - c->out_len < n) { errno = ENOBUFS; return -1; }
+    if (!c->out && !(c->out = malloc(c->out_cap))) { errno = ENOMEM; return -1; }
+    size_t tail = (c->out_head + c->out_len) % c->out_cap;
+    size_t first = c->out_cap - tail < n ? c->out_cap - tail : n;
+    memcpy(c->out + tail, p, first);
+    memcpy(c->out, (const unsigned char *)p + first, n - first);
+    c->out_len += n;
+    return 0;
+}
+
+//Appends a framed message (header, then payload) to the send ring, or nothing if it does not fit whole.
+int rw_conn_queue(rw_conn_t *c, uint16_t type, const void *payload, uint16_t len) {
+    if (c->out_cap - c->out_len < RW_MSG_HDR_SIZE + (size_t)len) { errno = ENOBUFS; return -1; }
+    unsigned char hdr[RW_MSG_HDR_SIZE];
+    rw_pack_hdr(hdr, type, len);
+    if (rw_conn_queue_bytes(c, hdr, sizeof(hdr)) < 0) return -1;
+    return len ? rw_conn_queue_bytes(c, payload, len) : 0;
+}
+
+//Writes the send ring and then the caller's extra bytes with one sendmsg() per pass, until all is sent or the socket is full.
+ssize_t rw_conn_flush(rw_conn_t *c, const void *extra, size_t extra_len) {
+    const unsigned char *x = (const unsigned char *)extra;
+    size_t sent = 0;
+    for (;;) {
+        // the ring is at most two pieces (it may wrap), then the extra bytes
+        struct iovec iov[3];
+        int n = 0;
+        if (c->out_len > 0) {
+            size_t run = c->out_cap - c->out_head;
+            if (run > c->out_len) run = c->out_len;
+            iov[n++] = (struct iovec){ .iov_base = c->out + c->out_head, .iov_len = run };
+            if (c->out_len > run) iov[n++] = (struct iovec){ .iov_base = c->out, .iov_len = c->out_len - run };
+        }
+        if (sent < extra_len) iov[n++] = (struct iovec){ .iov_base = (void *)(x + sent), .iov_len = extra_len - sent };
+        if (n == 0) return (ssize_t)sent;
+
+        struct msghdr mh = { .msg_iov = iov, .msg_iovlen = (size_t)n };
+        ssize_t k = sendmsg(c->fd, &mh, MSG_NOSIGNAL);
+        if (k < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return (ssize_t)sent;
+            return -1;
+        }
+        size_t from_ring = (size_t)k < c->out_len ? (size_t)k : c->out_len;
+        c->out_head = (c->out_head + from_ring) % c->out_cap;
+        c->out_len -= from_ring;
+        sent += (size_t)k - from_ring;
+    }
+}
+
+//Queues the header and sends ring, header and payload in one go; only an unsent rest of the payload is copied.
+int rw_conn_send(rw_conn_t *c, uint16_t type, const void *payload, uint16_t len) {
+    if (len > 0 && payload == NULL) { errno = EINVAL; return -1; }
+    if (c->out_cap - c->out_len < RW_MSG_HDR_SIZE + (size_t)len) { errno = ENOBUFS; return -1; }
+    // the header joins the queue, the payload goes out from the caller's buffer behind it
+    unsigned char hdr[RW_MSG_HDR_SIZE];
+    rw_pack_hdr(hdr, type, len);
+    if (rw_conn_queue_bytes(c, hdr, sizeof(hdr)) < 0) return -1;
+    ssize_t k = rw_conn_flush(c, payload, len);
+    if (k < 0) return -1;
+    if ((size_t)k == len) return 0;
+    return rw_conn_queue_bytes(c, (const unsigned char *)payload + k, len - (size_t)k);
+}
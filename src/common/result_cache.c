@@ -0,0 +1,220 @@
+// src/common/result_cache.c
+#include "common/result_cache.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <time.h>
+#include <utime.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#define CACHE_MAGIC   "RWC1"
+#define CACHE_VERSION 1u
+#define CACHE_SUFFIX  ".rwc"
+
+// On-disk header, followed by w*h steps_sum (uint64), w*h samples and w*h hit_k_count (uint32),
+// all in host byte order (the cache is local to one machine).
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint64_t hash;
+    rw_sim_key_t key;
+    uint32_t rep_done;
+    uint32_t rng_state;
+} cache_file_hdr_t;
+
+//Creates a directory and all missing parents (like mkdir -p). Existing directories are not an error.
+static int mkdir_p(const char *path) {
+    char tmp[RW_PATH_MAX];
+    size_t n = strlen(path);
+    if (n == 0 || n >= sizeof(tmp)) { errno = EINVAL; return -1; }
+    memcpy(tmp, path, n + 1);
+
+    for (char *p = tmp + 1; *p; p++) {
+        if (*p != '/') continue;
+        *p = '\0';
+        if (mkdir(tmp, 0755) < 0 && errno != EEXIST) return -1;
+        *p = '/';
+    }
+    if (mkdir(tmp, 0755) < 0 && errno != EEXIST) return -1;
+    return 0;
+}
+
+//Builds the file name of the cache entry for a key hash.
+static int entry_path(const rw_cache_t *c, uint64_t hash, const char *suffix, char *out, size_t out_size) {
+    int n = snprintf(out, out_size, "%s/%016llx%s%s", c->dir, (unsigned long long)hash, CACHE_SUFFIX, suffix);
+    if (n < 0 || (size_t)n >= out_size) { errno = ENAMETOOLONG; return -1; }
+    return 0;
+}
+
+int rw_cache_init(rw_cache_t *c, const char *dir, uint64_t max_bytes) {
+    memset(c, 0, sizeof(*c));
+    if (dir == NULL || dir[0] == '\0') { errno = EINVAL; return -1; }
+    snprintf(c->dir, sizeof(c->dir), "%s", dir);
+    c->max_bytes = max_bytes;
+    return mkdir_p(c->dir);
+}
+
+//Reads (or writes) the w x h region of one accumulator array row by row, honoring the caller's row stride.
+static int io_rows(FILE *f, void *base, size_t elem, uint32_t w, uint32_t h, uint32_t stride, int writing) {
+    unsigned char *p = (unsigned char *)base;
+    for (uint32_t y = 0; y < h; y++) {
+        unsigned char *row = p + (size_t)y * stride * elem;
+        size_t n = writing ? fwrite(row, elem, w, f) : fread(row, elem, w, f);
+        if (n != w) return -1;
+    }
+    return 0;
+}
+
+//Clears the w x h region of the accumulators, used when an entry turns out to be unreadable half-way through.
+static void clear_rows(const rw_accum_ref_t *acc, uint32_t w, uint32_t h) {
+    for (uint32_t y = 0; y < h; y++) {
+        size_t off = (size_t)y * acc->stride;
+        memset(acc->steps_sum + off, 0, w * sizeof(uint64_t));
+        memset(acc->samples + off, 0, w * sizeof(uint32_t));
+        memset(acc->hit_k_count + off, 0, w * sizeof(uint32_t));
+    }
+}
+
+int rw_cache_load(const rw_cache_t *c, const rw_sim_key_t *key, const rw_accum_ref_t *acc,
+                  uint32_t *rep_done_out, uint32_t *rng_state_out) {
+    uint64_t hash = rw_sim_key_hash(key);
+    char path[RW_PATH_MAX + 32];
+    if (entry_path(c, hash, "", path, sizeof(path)) < 0) return -1;
+
+    FILE *f = fopen(path, "rb");
+    if (!f) return (errno == ENOENT) ? 0 : -1;
+
+    cache_file_hdr_t hdr;
+    int ok = fread(&hdr, sizeof(hdr), 1, f) == 1 &&
+             memcmp(hdr.magic, CACHE_MAGIC, 4) == 0 &&
+             hdr.version == CACHE_VERSION &&
+             hdr.hash == hash &&
+             rw_sim_key_equal(&hdr.key, key);    // guards against hash collisions
+
+    if (ok) {
+        ok = io_rows(f, acc->steps_sum,   sizeof(uint64_t), key->w, key->h, acc->stride, 0) == 0 &&
+             io_rows(f, acc->samples,     sizeof(uint32_t), key->w, key->h, acc->stride, 0) == 0 &&
+             io_rows(f, acc->hit_k_count, sizeof(uint32_t), key->w, key->h, acc->stride, 0) == 0;
+    }
+    fclose(f);
+    if (!ok) {
+        // stale or foreign file: treat as a miss, the next store replaces it
+        clear_rows(acc, key->w, key->h);
+        return 0;
+    }
+
+    // bump mtime so eviction treats the entry as recently used
+    (void)utime(path, NULL);
+
+    if (rep_done_out) *rep_done_out = hdr.rep_done;
+    if (rng_state_out) *rng_state_out = hdr.rng_state;
+    return 1;
+}
+
+typedef struct {
+    char name[64];
+    off_t size;
+    time_t mtime;
+} cache_entry_info_t;
+
+//Orders cache entries from least to most recently used.
+static int cmp_mtime(const void *a, const void *b) {
+    const cache_entry_info_t *x = (const cache_entry_info_t *)a;
+    const cache_entry_info_t *y = (const cache_entry_info_t *)b;
+    if (x->mtime < y->mtime) return -1;
+    if (x->mtime > y->mtime) return 1;
+    return strcmp(x->name, y->name);
+}
+
+//Deletes least-recently-used entries until the directory fits into max_bytes. The entry named keep is never removed.
+static void enforce_cap(const rw_cache_t *c, const char *keep) {
+    if (c->max_bytes == 0) return;
+
+    DIR *d = opendir(c->dir);
+    if (!d) return;
+
+    cache_entry_info_t *list = NULL;
+    size_t n = 0, cap = 0;
+    uint64_t total = 0;
+
+    struct dirent *de;
+    while ((de = readdir(d)) != NULL) {
+        size_t len = strlen(de->d_name);
+        size_t sl = strlen(CACHE_SUFFIX);
+        if (len <= sl || len >= sizeof(list[0].name)) continue;
+        if (strcmp(de->d_name + len - sl, CACHE_SUFFIX) != 0) continue;
+
+        char path[RW_PATH_MAX + sizeof(de->d_name) + 2];
+        snprintf(path, sizeof(path), "%s/%s", c->dir, de->d_name);
+        struct stat st;
+        if (stat(path, &st) < 0) continue;
+
+        if (n == cap) {
+            size_t ncap = cap ? cap * 2 : 32;
+            cache_entry_info_t *nl = realloc(list, ncap * sizeof(*nl));
+            if (!nl) break;
+            list = nl;
+            cap = ncap;
+        }
+        memcpy(list[n].name, de->d_name, len + 1);
+        list[n].size = st.st_size;
+        list[n].mtime = st.st_mtime;
+        total += (uint64_t)st.st_size;
+        n++;
+    }
+    closedir(d);
+
+    if (total > c->max_bytes) {
+        qsort(list, n, sizeof(*list), cmp_mtime);
+        for (size_t i = 0; i < n && total > c->max_bytes; i++) {
+            if (strcmp(list[i].name, keep) == 0) continue;
+            char path[RW_PATH_MAX + sizeof(list[i].name) + 2];
+            snprintf(path, sizeof(path), "%s/%s", c->dir, list[i].name);
+            if (unlink(path) == 0) total -= (uint64_t)list[i].size;
+        }
+    }
+    free(list);
+}
+
+int rw_cache_store(const rw_cache_t *c, const rw_sim_key_t *key, const rw_accum_ref_t *acc,
+                   uint32_t rep_done, uint32_t rng_state) {
+    uint64_t hash = rw_sim_key_hash(key);
+    char path[RW_PATH_MAX + 32], tmp_path[RW_PATH_MAX + 32];
+    if (entry_path(c, hash, "", path, sizeof(path)) < 0) return -1;
+    if (entry_path(c, hash, ".tmp", tmp_path, sizeof(tmp_path)) < 0) return -1;
+
+    FILE *f = fopen(tmp_path, "wb");
+    if (!f) return -1;
+
+    cache_file_hdr_t hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, CACHE_MAGIC, 4);
+    hdr.version = CACHE_VERSION;
+    hdr.hash = hash;
+    hdr.key = *key;
+    hdr.rep_done = rep_done;
+    hdr.rng_state = rng_state;
+
+    int ok = fwrite(&hdr, sizeof(hdr), 1, f) == 1 &&
+             io_rows(f, acc->steps_sum,   sizeof(uint64_t), key->w, key->h, acc->stride, 1) == 0 &&
+             io_rows(f, acc->samples,     sizeof(uint32_t), key->w, key->h, acc->stride, 1) == 0 &&
+             io_rows(f, acc->hit_k_count, sizeof(uint32_t), key->w, key->h, acc->stride, 1) == 0;
+    if (fclose(f) != 0) ok = 0;
+
+    // write-then-rename so a crash never leaves a half-written entry behind
+    if (!ok || rename(tmp_path, path) < 0) {
+        int saved = errno;
+        remove(tmp_path);
+        errno = saved ? saved : EIO;
+        return -1;
+    }
+
+    const char *base = strrchr(path, '/');
+    enforce_cap(c, base ? base + 1 : path);
+    return 0;
+}
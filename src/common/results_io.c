@@ -0,0 +1,354 @@
+// src/common/results_io.c
+#include "common/results_io.h"
+#include "common/spectral.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#define SHARD_VERSION 1u
+
+int rw_path_is_shard(const char *path) {
+    size_t n = strlen(path), sl = strlen(RW_SHARD_SUFFIX);
+    return n > sl && strcmp(path + n - sl, RW_SHARD_SUFFIX) == 0;
+}
+
+//For Monte Carlo results on the obstacle-free torus, compares the sampled averages with the exact spectral solution
+//and writes the relative deviation as a header line. Silently skipped when no exact solution exists.
+static void write_exact_check(FILE *f, const rw_sim_key_t *key, const rw_accum_ref_t *acc) {
+    if (key->world_type != RW_WORLD_WRAP) return;
+
+    double *exact = malloc((size_t)key->w * key->h * sizeof(double));
+    if (!exact) return;
+    if (rw_spectral_hitting_times(key->w, key->h, key->p_up, key->p_down, key->p_left, key->p_right,
+                                  exact, key->w) == 0) {
+        double max_rel = 0.0, sum_rel = 0.0;
+        uint32_t n = 0;
+        for (uint32_t y = 0; y < key->h; y++) {
+            for (uint32_t x = 0; x < key->w; x++) {
+                size_t i = (size_t)y * acc->stride + x;
+                double e = exact[(size_t)y * key->w + x];
+                if (acc->samples[i] == 0 || e <= 0.0) continue;
+                double rel = fabs((double)acc->steps_sum[i] / (double)acc->samples[i] - e) / e;
+                if (rel > max_rel) max_rel = rel;
+                sum_rel += rel;
+                n++;
+            }
+        }
+        if (n > 0) {
+            fprintf(f, "# Exact check (spectral): max_rel_err=%.4f mean_rel_err=%.4f\n", max_rel, sum_rel / n);
+        }
+    }
+    free(exact);
+}
+
+//Writes the final results in two sections: average steps per cell and probability-to-hit-within-K per cell.
+int rw_results_write_text(const char *path, const rw_sim_key_t *key, uint32_t rep_done, uint32_t rep_total,
+                          const rw_accum_ref_t *acc, const char *extra_header) {
+    FILE *f = fopen(path, "w");
+    if (!f) return -1;
+
+    // Header
+    fprintf(f, "# Random Walk results\n");
+    fprintf(f, "# w=%u h=%u K=%u rep_done=%u rep_total=%u\n",
+            key->w, key->h, key->K, rep_done, rep_total);
+    write_exact_check(f, key, acc);
+    if (extra_header) fputs(extra_header, f);
+    fprintf(f, "# Prob scale: %u\n\n", (unsigned)RW_PROB_SCALE);
+
+    // AVG_STEPS
+    fprintf(f, "[AVG_STEPS]\n");
+    for (uint32_t y = 0; y < key->h; y++) {
+        for (uint32_t x = 0; x < key->w; x++) {
+            size_t i = (size_t)y * acc->stride + x;
+            double avg = 0.0;
+            uint32_t s = acc->samples[i];
+            if (s > 0) {
+                avg = (double)acc->steps_sum[i] / (double)s;
+            }
+            fprintf(f, "%.3f%s", avg, (x + 1 == key->w) ? "" : " ");
+        }
+        fprintf(f, "\n");
+    }
+
+    // PROB_K
+    fprintf(f, "\n[PROB_K]\n");
+    for (uint32_t y = 0; y < key->h; y++) {
+        for (uint32_t x = 0; x < key->w; x++) {
+            size_t i = (size_t)y * acc->stride + x;
+            double p = 0.0;
+            uint32_t s = acc->samples[i];
+            if (s > 0) {
+                p = (double)acc->hit_k_count[i] / (double)s;
+            }
+            fprintf(f, "%.6f%s", p, (x + 1 == key->w) ? "" : " ");
+        }
+        fprintf(f, "\n");
+    }
+
+    if (fclose(f) != 0) return -1;
+    return 0;
+}
+
+int rw_results_write_exact(const char *path, const rw_sim_key_t *key, const double *avg, uint32_t stride) {
+    FILE *f = fopen(path, "w");
+    if (!f) return -1;
+
+    fprintf(f, "# Random Walk results (exact, spectral solver)\n");
+    fprintf(f, "# w=%u h=%u p_up=%u p_down=%u p_left=%u p_right=%u\n",
+            key->w, key->h, key->p_up, key->p_down, key->p_left, key->p_right);
+    fprintf(f, "# PROB_K is not computed by the spectral engine\n\n");
+
+    fprintf(f, "[AVG_STEPS]\n");
+    for (uint32_t y = 0; y < key->h; y++) {
+        for (uint32_t x = 0; x < key->w; x++) {
+            fprintf(f, "%.3f%s", avg[(size_t)y * stride + x], (x + 1 == key->w) ? "" : " ");
+        }
+        fprintf(f, "\n");
+    }
+
+    if (fclose(f) != 0) return -1;
+    return 0;
+}
+
+int rw_shard_write(const char *path, const rw_sim_key_t *key, uint32_t rep_done,
+                   const uint32_t *seeds, uint32_t nseeds, const rw_accum_ref_t *acc) {
+    FILE *f = fopen(path, "w");
+    if (!f) return -1;
+
+    fprintf(f, "# Random Walk shard\n");
+    fprintf(f, "# version=%u\n", SHARD_VERSION);
+    fprintf(f, "# w=%u h=%u K=%u p_up=%u p_down=%u p_left=%u p_right=%u world_type=%u obstacles=%u rep_done=%u\n",
+            key->w, key->h, key->K, key->p_up, key->p_down, key->p_left, key->p_right,
+            key->world_type, key->obstacle_density_permille, rep_done);
+    fprintf(f, "# seeds=");
+    for (uint32_t i = 0; i < nseeds; i++) fprintf(f, "%s%u", i ? " " : "", seeds[i]);
+    fprintf(f, "\n");
+
+    fprintf(f, "\n[STEPS_SUM]\n");
+    for (uint32_t y = 0; y < key->h; y++) {
+        for (uint32_t x = 0; x < key->w; x++) {
+            fprintf(f, "%llu%s", (unsigned long long)acc->steps_sum[(size_t)y * acc->stride + x],
+                    (x + 1 == key->w) ? "" : " ");
+        }
+        fprintf(f, "\n");
+    }
+
+    fprintf(f, "\n[SAMPLES]\n");
+    for (uint32_t y = 0; y < key->h; y++) {
+        for (uint32_t x = 0; x < key->w; x++) {
+            fprintf(f, "%u%s", acc->samples[(size_t)y * acc->stride + x], (x + 1 == key->w) ? "" : " ");
+        }
+        fprintf(f, "\n");
+    }
+
+    fprintf(f, "\n[HIT_K_COUNT]\n");
+    for (uint32_t y = 0; y < key->h; y++) {
+        for (uint32_t x = 0; x < key->w; x++) {
+            fprintf(f, "%u%s", acc->hit_k_count[(size_t)y * acc->stride + x], (x + 1 == key->w) ? "" : " ");
+        }
+        fprintf(f, "\n");
+    }
+
+    if (fclose(f) != 0) return -1;
+    return 0;
+}
+
+int rw_shard_alloc(rw_shard_t *sh, const rw_sim_key_t *key) {
+    memset(sh, 0, sizeof(*sh));
+    if (key->w == 0 || key->h == 0) { errno = EINVAL; return -1; }
+
+    size_t cells = (size_t)key->w * key->h;
+    sh->key = *key;
+    sh->acc.stride = key->w;
+    sh->acc.steps_sum = calloc(cells, sizeof(uint64_t));
+    sh->acc.samples = calloc(cells, sizeof(uint32_t));
+    sh->acc.hit_k_count = calloc(cells, sizeof(uint32_t));
+    if (!sh->acc.steps_sum || !sh->acc.samples || !sh->acc.hit_k_count) {
+        rw_shard_free(sh);
+        errno = ENOMEM;
+        return -1;
+    }
+    return 0;
+}
+
+void rw_shard_free(rw_shard_t *sh) {
+    free(sh->seeds);
+    free(sh->acc.steps_sum);
+    free(sh->acc.samples);
+    free(sh->acc.hit_k_count);
+    memset(sh, 0, sizeof(*sh));
+}
+
+//Appends seeds to a shard's seed list.
+static int append_seeds(rw_shard_t *sh, const uint32_t *seeds, uint32_t n) {
+    if (n == 0) return 0;
+    if (n > UINT32_MAX - sh->nseeds) { errno = ERANGE; return -1; }
+    uint32_t *ns = realloc(sh->seeds, ((size_t)sh->nseeds + n) * sizeof(uint32_t));
+    if (!ns) { errno = ENOMEM; return -1; }
+    memcpy(ns + sh->nseeds, seeds, (size_t)n * sizeof(uint32_t));
+    sh->seeds = ns;
+    sh->nseeds += n;
+    return 0;
+}
+
+//Finds "name=" in a header line and parses the unsigned value after it.
+static int header_u32(const char *line, const char *name, uint32_t *out) {
+    char pat[32];
+    snprintf(pat, sizeof(pat), " %s=", name);
+    const char *p = strstr(line, pat);
+    if (!p) return -1;
+    p += strlen(pat);
+
+    char *end = NULL;
+    errno = 0;
+    unsigned long v = strtoul(p, &end, 10);
+    if (errno != 0 || end == p || v > UINT32_MAX) return -1;
+    *out = (uint32_t)v;
+    return 0;
+}
+
+//Reads the next line that is not empty, returns NULL at end of file.
+static char *next_line(FILE *f, char **buf, size_t *cap) {
+    while (getline(buf, cap, f) >= 0) {
+        if ((*buf)[0] != '\n' && (*buf)[0] != '\r' && (*buf)[0] != '\0') return *buf;
+    }
+    return NULL;
+}
+
+//Parses one [SECTION] of h rows with w numbers each. Values must fit into max.
+static int read_section(FILE *f, char **buf, size_t *cap, const char *title, uint32_t w, uint32_t h,
+                        uint64_t max, uint64_t *out64, uint32_t *out32) {
+    char *line = next_line(f, buf, cap);
+    if (!line || strncmp(line, title, strlen(title)) != 0) return -1;
+
+    for (uint32_t y = 0; y < h; y++) {
+        line = next_line(f, buf, cap);
+        if (!line) return -1;
+        char *p = line;
+        for (uint32_t x = 0; x < w; x++) {
+            char *end = NULL;
+            errno = 0;
+            unsigned long long v = strtoull(p, &end, 10);
+            if (errno != 0 || end == p || v > max) return -1;
+            size_t i = (size_t)y * w + x;
+            if (out64) out64[i] = (uint64_t)v;
+            else out32[i] = (uint32_t)v;
+            p = end;
+        }
+    }
+    return 0;
+}
+
+int rw_shard_read(const char *path, rw_shard_t *out) {
+    memset(out, 0, sizeof(*out));
+
+    FILE *f = fopen(path, "r");
+    if (!f) return -1;
+
+    char *buf = NULL;
+    size_t cap = 0;
+    int ok = 0;
+
+    rw_sim_key_t key;
+    memset(&key, 0, sizeof(key));
+    uint32_t version = 0, rep_done = 0;
+
+    do {
+        char *line = next_line(f, &buf, &cap);
+        if (!line || strncmp(line, "# Random Walk shard", 19) != 0) break;
+
+        line = next_line(f, &buf, &cap);
+        if (!line || header_u32(line, "version", &version) < 0 || version != SHARD_VERSION) break;
+
+        line = next_line(f, &buf, &cap);
+        if (!line ||
+            header_u32(line, "w", &key.w) < 0 || header_u32(line, "h", &key.h) < 0 ||
+            header_u32(line, "K", &key.K) < 0 ||
+            header_u32(line, "p_up", &key.p_up) < 0 || header_u32(line, "p_down", &key.p_down) < 0 ||
+            header_u32(line, "p_left", &key.p_left) < 0 || header_u32(line, "p_right", &key.p_right) < 0 ||
+            header_u32(line, "world_type", &key.world_type) < 0 ||
+            header_u32(line, "obstacles", &key.obstacle_density_permille) < 0 ||
+            header_u32(line, "rep_done", &rep_done) < 0) break;
+        if (key.w == 0 || key.h == 0 || (uint64_t)key.w * key.h > (1ULL << 28)) break;
+
+        if (rw_shard_alloc(out, &key) < 0) break;
+        out->rep_done = rep_done;
+
+        line = next_line(f, &buf, &cap);
+        if (!line || strncmp(line, "# seeds=", 8) != 0) break;
+        char *p = line + 8;
+        int seeds_ok = 1;
+        while (1) {
+            while (*p == ' ') p++;
+            if (*p == '\n' || *p == '\r' || *p == '\0') break;
+            char *end = NULL;
+            errno = 0;
+            unsigned long v = strtoul(p, &end, 10);
+            if (errno != 0 || end == p || v > UINT32_MAX) { seeds_ok = 0; break; }
+            uint32_t s32 = (uint32_t)v;
+            if (append_seeds(out, &s32, 1) < 0) { seeds_ok = 0; break; }
+            p = end;
+        }
+        if (!seeds_ok) break;
+        if (out->nseeds > 0) out->key.seed = out->seeds[0];
+
+        if (read_section(f, &buf, &cap, "[STEPS_SUM]", key.w, key.h, UINT64_MAX, out->acc.steps_sum, NULL) < 0) break;
+        if (read_section(f, &buf, &cap, "[SAMPLES]", key.w, key.h, UINT32_MAX, NULL, out->acc.samples) < 0) break;
+        if (read_section(f, &buf, &cap, "[HIT_K_COUNT]", key.w, key.h, UINT32_MAX, NULL, out->acc.hit_k_count) < 0) break;
+        ok = 1;
+    } while (0);
+
+    free(buf);
+    fclose(f);
+    if (!ok) {
+        rw_shard_free(out);
+        errno = EINVAL;
+        return -1;
+    }
+    return 0;
+}
+
+int rw_shard_merge(rw_shard_t *dst, const rw_shard_t *src) {
+    if (!rw_sim_key_compatible(&dst->key, &src->key)) { errno = EINVAL; return -1; }
+    if (src->rep_done > UINT32_MAX - dst->rep_done) { errno = ERANGE; return -1; }
+
+    const uint32_t w = dst->key.w, h = dst->key.h;
+
+    // check first so a failed merge leaves dst untouched
+    for (uint32_t y = 0; y < h; y++) {
+        for (uint32_t x = 0; x < w; x++) {
+            size_t di = (size_t)y * dst->acc.stride + x;
+            size_t si = (size_t)y * src->acc.stride + x;
+            if (src->acc.steps_sum[si] > UINT64_MAX - dst->acc.steps_sum[di] ||
+                src->acc.samples[si] > UINT32_MAX - dst->acc.samples[di] ||
+                src->acc.hit_k_count[si] > UINT32_MAX - dst->acc.hit_k_count[di]) {
+                errno = ERANGE;
+                return -1;
+            }
+        }
+    }
+    if (append_seeds(dst, src->seeds, src->nseeds) < 0) return -1;
+
+    for (uint32_t y = 0; y < h; y++) {
+        for (uint32_t x = 0; x < w; x++) {
+            size_t di = (size_t)y * dst->acc.stride + x;
+            size_t si = (size_t)y * src->acc.stride + x;
+            dst->acc.steps_sum[di] += src->acc.steps_sum[si];
+            dst->acc.samples[di] += src->acc.samples[si];
+            dst->acc.hit_k_count[di] += src->acc.hit_k_count[si];
+        }
+    }
+    dst->rep_done += src->rep_done;
+    if (dst->nseeds > 0) dst->key.seed = dst->seeds[0];
+    return 0;
+}
+
+int rw_shard_write_any(const char *path, const rw_shard_t *sh) {
+    if (rw_path_is_shard(path)) {
+        return rw_shard_write(path, &sh->key, sh->rep_done, sh->seeds, sh->nseeds, &sh->acc);
+    }
+    return rw_results_write_text(path, &sh->key, sh->rep_done, sh->rep_done, &sh->acc, NULL);
+}
@@ -0,0 +1,141 @@
+// src/common/shm_state.c (shared-memory STATE publication)
+#include "common/shm_state.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+_Static_assert(sizeof(_Atomic uint32_t) == sizeof(uint32_t), "shared layout");
+
+//Returns the view's part of the region.
+static rw_shm_view_t *shm_view(rw_shm_region_t *r, rw_local_view_t view) {
+    return &r->view[view == RW_VIEW_PROB_K ? 1 : 0];
+}
+
+//Formats the region name of a port.
+void rw_shm_state_name(char *out, size_t cap, uint16_t port) {
+    snprintf(out, cap, "/rw_state.%u", (unsigned)port);
+}
+
+//Creates (or reopens) the region, sizes it and maps it writable; the magic goes in last, once the layout is set.
+int rw_shm_state_create(rw_shm_state_t *s, const char *name) {
+    memset(s, 0, sizeof(*s));
+    if (strlen(name) >= sizeof(s->name)) { errno = ENAMETOOLONG; return -1; }
+
+    int fd = shm_open(name, O_CREAT | O_RDWR, 0644);
+    if (fd < 0) return -1;
+    if (ftruncate(fd, (off_t)sizeof(rw_shm_region_t)) < 0) {
+        int e = errno;
+        close(fd);
+        errno = e;
+        return -1;
+    }
+    void *p = mmap(NULL, sizeof(rw_shm_region_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    int e = errno;
+    close(fd);
+    if (p == MAP_FAILED) { errno = e; return -1; }
+
+    // a region left behind by an earlier server on this port is taken over from scratch
+    rw_shm_region_t *r = p;
+    memset(r, 0, sizeof(*r));
+    r->version = RW_SHM_VERSION;
+    r->size = (uint32_t)sizeof(*r);
+    atomic_thread_fence(memory_order_release);
+    r->magic = RW_SHM_MAGIC;
+
+    s->r = r;
+    snprintf(s->name, sizeof(s->name), "%s", name);
+    s->owner = 1;
+    return 0;
+}
+
+//Writes the slot readers are not using, then moves them to it. The slot's sequence is odd while its bytes change.
+void rw_shm_state_publish(rw_shm_state_t *s, rw_local_view_t view, const rw_state_msg_t *st) {
+    rw_shm_view_t *v = shm_view(s->r, view);
+    const uint32_t next = 1u - atomic_load_explicit(&v->active, memory_order_relaxed);
+    rw_shm_slot_t *slot = &v->slot[next];
+
+    const uint32_t q = atomic_load_explicit(&slot->seq, memory_order_relaxed);
+    atomic_store_explicit(&slot->seq, q + 1u, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);   // the odd sequence is visible before any new byte
+    memcpy(&slot->st, st, sizeof(*st));
+    atomic_store_explicit(&slot->seq, q + 2u, memory_order_release);
+
+    atomic_store_explicit(&v->active, next, memory_order_release);
+    atomic_fetch_add_explicit(&v->published, 1u, memory_order_release);
+}
+
+//Publishes whether a simulation is running, for viewers that wait for one.
+void rw_shm_state_set_live(rw_shm_state_t *s, int live) {
+    atomic_store_explicit(&s->r->live, live ? 1u : 0u, memory_order_release);
+}
+
+//Maps an existing region read-only after checking that its size and header match this build's layout.
+int rw_shm_state_open(rw_shm_state_t *s, const char *name) {
+    memset(s, 0, sizeof(*s));
+    if (strlen(name) >= sizeof(s->name)) { errno = ENAMETOOLONG; return -1; }
+
+    int fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0) return -1;
+    struct stat sb;
+    if (fstat(fd, &sb) < 0) {
+        int e = errno;
+        close(fd);
+        errno = e;
+        return -1;
+    }
+    if ((size_t)sb.st_size != sizeof(rw_shm_region_t)) {
+        close(fd);
+        errno = EPROTO;
+        return -1;
+    }
+    void *p = mmap(NULL, sizeof(rw_shm_region_t), PROT_READ, MAP_SHARED, fd, 0);
+    int e = errno;
+    close(fd);
+    if (p == MAP_FAILED) { errno = e; return -1; }
+
+    rw_shm_region_t *r = p;
+    if (r->magic != RW_SHM_MAGIC || r->version != RW_SHM_VERSION || r->size != sizeof(*r)) {
+        munmap(p, sizeof(*r));
+        errno = EPROTO;
+        return -1;
+    }
+    atomic_thread_fence(memory_order_acquire);
+    s->r = r;
+    snprintf(s->name, sizeof(s->name), "%s", name);
+    return 0;
+}
+
+//Takes the active slot of a view, unless nothing is published yet or that slot is being written.
+const rw_state_msg_t *rw_shm_state_begin(const rw_shm_state_t *s, rw_local_view_t view, uint32_t *ticket) {
+    rw_shm_view_t *v = shm_view(s->r, view);
+    if (atomic_load_explicit(&v->published, memory_order_acquire) == 0) return NULL;
+    rw_shm_slot_t *slot = &v->slot[atomic_load_explicit(&v->active, memory_order_acquire) & 1u];
+    uint32_t q = atomic_load_explicit(&slot->seq, memory_order_acquire);
+    if (q & 1u) return NULL;
+    *ticket = q;
+    return &slot->st;
+}
+
+//Compares the slot's sequence with the one seen when the state was taken.
+int rw_shm_state_valid(const rw_shm_state_t *s, const rw_state_msg_t *st, uint32_t ticket) {
+    (void)s;
+    rw_shm_slot_t *slot = (rw_shm_slot_t *)((unsigned char *)(uintptr_t)st - offsetof(rw_shm_slot_t, st));
+    atomic_thread_fence(memory_order_acquire);   // every read of the state happens before the check
+    return atomic_load_explicit(&slot->seq, memory_order_relaxed) == ticket;
+}
+
+//Unmaps the region; the owner marks it not live and removes the name first (mapped viewers keep their copy).
+void rw_shm_state_close(rw_shm_state_t *s) {
+    if (!s->r) return;
+    if (s->owner) {
+        rw_shm_state_set_live(s, 0);
+        shm_unlink(s->name);
+    }
+    munmap(s->r, sizeof(*s->r));
+    s->r = NULL;
+}
@@ -0,0 +1,104 @@
+// src/common/sim_config.c
+#include "common/sim_config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <inttypes.h>
+
+//Parses a decimal uint32. Returns 0 on success, -1 if the text is not a number in range.
+static int parse_u32(const char *s, uint32_t *out) {
+    char *end = NULL;
+    errno = 0;
+    unsigned long v = strtoul(s, &end, 10);
+    if (errno != 0 || end == s || *end != '\0' || s[0] == '-' || v > UINT32_MAX) return -1;
+    *out = (uint32_t)v;
+    return 0;
+}
+
+void rw_sim_config_defaults(rw_create_sim_req_t *req) {
+    memset(req, 0, sizeof(*req));
+    req->p_up = req->p_down = req->p_left = req->p_right = RW_PROB_SCALE / 4;
+    req->world_type = RW_WORLD_WRAP;
+    req->initial_mode = RW_MODE_SUMMARY;
+    req->engine = RW_ENGINE_MONTE_CARLO;
+    req->vr_scheme = RW_VR_NONE;
+}
+
+int rw_sim_config_set(rw_create_sim_req_t *req, const char *key, const char *val) {
+    struct { const char *name; uint32_t *dst; } nums[] = {
+        { "w", &req->w }, { "h", &req->h }, { "reps", &req->rep_total }, { "K", &req->K },
+        { "p_up", &req->p_up }, { "p_down", &req->p_down },
+        { "p_left", &req->p_left }, { "p_right", &req->p_right },
+        { "seed", &req->seed }, { "tail", &req->tail_reservoir },
+        { "split", &req->split_factor }, { "split_step", &req->split_level_step },
+    };
+    for (size_t i = 0; i < sizeof(nums) / sizeof(nums[0]); i++) {
+        if (strcmp(key, nums[i].name) == 0) return parse_u32(val, nums[i].dst);
+    }
+
+    if (strcmp(key, "out") == 0) {
+        if (val[0] == '\0' || strlen(val) >= sizeof(req->out_file)) return -1;
+        snprintf(req->out_file, sizeof(req->out_file), "%s", val);
+        return 0;
+    }
+    if (strcmp(key, "engine") == 0) {
+        if (strcasecmp(val, "mc") == 0) req->engine = RW_ENGINE_MONTE_CARLO;
+        else if (strcasecmp(val, "spectral") == 0) req->engine = RW_ENGINE_SPECTRAL;
+        else return -1;
+        return 0;
+    }
+    if (strcmp(key, "vr") == 0) {
+        if (strcasecmp(val, "none") == 0) req->vr_scheme = RW_VR_NONE;
+        else if (strcasecmp(val, "antithetic") == 0) req->vr_scheme = RW_VR_ANTITHETIC;
+        else if (strcasecmp(val, "control_variate") == 0) req->vr_scheme = RW_VR_CONTROL_VARIATE;
+        else return -1;
+        return 0;
+    }
+    if (strcmp(key, "sweep") == 0) {
+        if (req->sweep_count >= RW_MAX_SWEEP) return -1;
+        uint32_t *q = req->sweep_p[req->sweep_count];
+        char extra;
+        if (sscanf(val, "%" SCNu32 ",%" SCNu32 ",%" SCNu32 ",%" SCNu32 "%c", &q[0], &q[1], &q[2], &q[3], &extra) != 4) return -1;
+        req->sweep_count++;
+        return 0;
+    }
+    return -1;
+}
+
+int rw_sim_config_parse(rw_create_sim_req_t *req, char *const *tokens, int ntokens, char *err, size_t err_size) {
+    static const char *required[] = { "w", "h", "reps", "K", "out" };
+    unsigned seen = 0;
+
+    rw_sim_config_defaults(req);
+    for (int t = 0; t < ntokens; t++) {
+        const char *eq = strchr(tokens[t], '=');
+        if (!eq) {
+            snprintf(err, err_size, "expected key=value, got '%s'", tokens[t]);
+            return -1;
+        }
+        char key[32];
+        size_t klen = (size_t)(eq - tokens[t]);
+        if (klen == 0 || klen >= sizeof(key)) {
+            snprintf(err, err_size, "bad key in '%s'", tokens[t]);
+            return -1;
+        }
+        memcpy(key, tokens[t], klen);
+        key[klen] = '\0';
+
+        if (rw_sim_config_set(req, key, eq + 1) < 0) {
+            snprintf(err, err_size, "bad field %s", tokens[t]);
+            return -1;
+        }
+        for (unsigned r = 0; r < sizeof(required) / sizeof(required[0]); r++) {
+            if (strcmp(key, required[r]) == 0) seen |= 1u << r;
+        }
+    }
+    if (seen != (1u << (sizeof(required) / sizeof(required[0]))) - 1u) {
+        snprintf(err, err_size, "w, h, reps, K and out are required");
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,44 @@
+// src/common/sim_key.c
+#include "common/sim_key.h"
+
+#define FNV64_OFFSET 0xcbf29ce484222325ULL
+#define FNV64_PRIME  0x100000001b3ULL
+
+//Feeds one 32-bit value into an FNV-1a hash byte by byte (least significant first), so the hash does not depend on host endianness.
+static uint64_t fnv_u32(uint64_t h, uint32_t v) {
+    for (int b = 0; b < 4; b++) {
+        h ^= (uint64_t)((v >> (8 * b)) & 0xFFu);
+        h *= FNV64_PRIME;
+    }
+    return h;
+}
+
+//Hashes every field of the key in a fixed order. Struct padding is never touched, so equal keys always hash equally.
+uint64_t rw_sim_key_hash(const rw_sim_key_t *k) {
+    uint64_t h = FNV64_OFFSET;
+    h = fnv_u32(h, k->w);
+    h = fnv_u32(h, k->h);
+    h = fnv_u32(h, k->K);
+    h = fnv_u32(h, k->p_up);
+    h = fnv_u32(h, k->p_down);
+    h = fnv_u32(h, k->p_left);
+    h = fnv_u32(h, k->p_right);
+    h = fnv_u32(h, k->world_type);
+    h = fnv_u32(h, k->obstacle_density_permille);
+    h = fnv_u32(h, k->seed);
+    return h;
+}
+
+//Compares two keys field by field, ignoring the seed.
+int rw_sim_key_compatible(const rw_sim_key_t *a, const rw_sim_key_t *b) {
+    return a->w == b->w && a->h == b->h && a->K == b->K &&
+           a->p_up == b->p_up && a->p_down == b->p_down &&
+           a->p_left == b->p_left && a->p_right == b->p_right &&
+           a->world_type == b->world_type &&
+           a->obstacle_density_permille == b->obstacle_density_permille;
+}
+
+//Compares two keys field by field.
+int rw_sim_key_equal(const rw_sim_key_t *a, const rw_sim_key_t *b) {
+    return rw_sim_key_compatible(a, b) && a->seed == b->seed;
+}
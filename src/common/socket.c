@@ -9,6 +9,7 @@
 
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 
 #include <netdb.h>
 #include <arpa/inet.h>
@@ -23,12 +24,13 @@ static int set_reuseaddr(int fd) {
 }
 
 // Sends the entire buffer over a socket, retrying as needed until all bytes are written or an error occurs.
+// A peer that has gone away yields -1 (EPIPE) instead of SIGPIPE, so a long-running server survives it.
 int rw_send_all(int fd, const void *buf, size_t len) {
     const unsigned char *p = (const unsigned char *)buf;
     size_t sent = 0;
 
     while (sent < len) {
-        ssize_t n = send(fd, p + sent, len - sent, 0);
+        ssize_t n = send(fd, p + sent, len - sent, MSG_NOSIGNAL);
         if (n < 0) {
             if (errno == EINTR) continue;
             return -1;
@@ -62,35 +64,66 @@ int rw_recv_all(int fd, void *buf, size_t len) {
     return 0;
 }
 
-//Sends a protocol message consisting of a fixed-size header followed by an optional payload, converting fields to network byte order for portability.
-int rw_send_msg(int fd, uint16_t type, const void *payload, uint16_t payload_len) {
+_Static_assert(sizeof(rw_msg_hdr_t) == RW_MSG_HDR_SIZE, "wire header size");
+
+//Writes a message header in network byte order.
+void rw_pack_hdr(void *out, uint16_t type, uint16_t payload_len) {
     rw_msg_hdr_t hdr;
     // Put header into network byte order so it works across machines too
     hdr.type = htons(type);
     hdr.length = htons(payload_len);
+    memcpy(out, &hdr, sizeof(hdr));
+}
 
-    if (rw_send_all(fd, &hdr, sizeof(hdr)) < 0) return -1;
-
-    if (payload_len > 0) {
-        if (payload == NULL) {
-            errno = EINVAL;
+//Sends a protocol message consisting of a fixed-size header followed by an optional payload, converting fields to network byte order for portability.
+//Header and payload leave in one sendmsg(), so a small message is one segment and never waits on Nagle's algorithm.
+int rw_send_msg(int fd, uint16_t type, const void *payload, uint16_t payload_len) {
+    if (payload_len > 0 && payload == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+    rw_msg_hdr_t hdr;
+    rw_pack_hdr(&hdr, type, payload_len);
+
+    struct iovec iov[2] = {
+        { .iov_base = &hdr, .iov_len = sizeof(hdr) },
+        { .iov_base = (void *)payload, .iov_len = payload_len },
+    };
+    struct msghdr mh = { .msg_iov = iov, .msg_iovlen = payload_len > 0 ? 2 : 1 };
+    size_t left = sizeof(hdr) + payload_len;
+    while (left > 0) {
+        ssize_t n = sendmsg(fd, &mh, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
             return -1;
         }
-        if (rw_send_all(fd, payload, payload_len) < 0) return -1;
+        left -= (size_t)n;
+        // skip what went out: whole iovecs, then part of the next one
+        while (mh.msg_iovlen > 0 && (size_t)n >= mh.msg_iov->iov_len) {
+            n -= (ssize_t)mh.msg_iov->iov_len;
+            mh.msg_iov++;
+            mh.msg_iovlen--;
+        }
+        if (mh.msg_iovlen > 0) {
+            mh.msg_iov->iov_base = (unsigned char *)mh.msg_iov->iov_base + n;
+            mh.msg_iov->iov_len -= (size_t)n;
+        }
     }
     return 0;
 }
 
 //Receives and decodes a message header from the socket, converting fields from network byte order into host format.
-int rw_recv_hdr(int fd, uint16_t *type_out, uint16_t *len_out) {
+void rw_unpack_hdr(const void *in, uint16_t *type_out, uint16_t *len_out) {
     rw_msg_hdr_t hdr;
-    if (rw_recv_all(fd, &hdr, sizeof(hdr)) < 0) return -1;
-
-    uint16_t type = ntohs(hdr.type);
-    uint16_t len  = ntohs(hdr.length);
+    memcpy(&hdr, in, sizeof(hdr));
+    if (type_out) *type_out = ntohs(hdr.type);
+    if (len_out)  *len_out  = ntohs(hdr.length);
+}
 
-    if (type_out) *type_out = type;
-    if (len_out)  *len_out  = len;
+int rw_recv_hdr(int fd, uint16_t *type_out, uint16_t *len_out) {
+    unsigned char hdr[RW_MSG_HDR_SIZE];
+    if (rw_recv_all(fd, hdr, sizeof(hdr)) < 0) return -1;
+    rw_unpack_hdr(hdr, type_out, len_out);
     return 0;
 }
 
@@ -0,0 +1,174 @@
+// src/common/spectral.c
+#include "common/spectral.h"
+#include "common/types.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <complex.h>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+// Below this |1 - phi(k)| the walk cannot leave the corresponding sub-lattice: the hitting time is infinite.
+#define SYMBOL_EPS 1e-12
+
+// FFT plan for one length: radix-2 for powers of two, Bluestein (chirp-z through a padded radix-2 FFT) otherwise.
+typedef struct {
+    size_t n;
+    size_t m;                  // padded radix-2 length (== n for powers of two)
+    double complex *chirp;     // e^{+i pi k^2 / n}, k < n           (Bluestein only)
+    double complex *kernel;    // FFT of the conjugate chirp, length m (Bluestein only)
+    double complex *work;      // length m                           (Bluestein only)
+} fft_plan_t;
+
+static int is_pow2(size_t n) { return n && (n & (n - 1)) == 0; }
+
+//In-place iterative radix-2 FFT. sign = +1 computes sum_j a_j e^{+2 pi i jk/n}, sign = -1 the forward transform.
+static void fft_pow2(double complex *a, size_t n, int sign) {
+    for (size_t i = 1, j = 0; i < n; i++) {
+        size_t bit = n >> 1;
+        for (; j & bit; bit >>= 1) j ^= bit;
+        j ^= bit;
+        if (i < j) { double complex t = a[i]; a[i] = a[j]; a[j] = t; }
+    }
+    for (size_t len = 2; len <= n; len <<= 1) {
+        double ang = sign * 2.0 * M_PI / (double)len;
+        double complex wl = cos(ang) + I * sin(ang);
+        for (size_t i = 0; i < n; i += len) {
+            double complex wk = 1.0;
+            for (size_t k = 0; k < len / 2; k++) {
+                double complex u = a[i + k];
+                double complex v = a[i + k + len / 2] * wk;
+                a[i + k] = u + v;
+                a[i + k + len / 2] = u - v;
+                wk *= wl;
+            }
+        }
+    }
+}
+
+static void plan_free(fft_plan_t *p) {
+    free(p->chirp);
+    free(p->kernel);
+    free(p->work);
+    memset(p, 0, sizeof(*p));
+}
+
+//Prepares a plan for the unnormalized inverse transform (sign +1) of length n.
+static int plan_init(fft_plan_t *p, size_t n) {
+    memset(p, 0, sizeof(*p));
+    p->n = n;
+    p->m = n;
+    if (is_pow2(n)) return 0;
+
+    size_t m = 1;
+    while (m < 2 * n - 1) m <<= 1;
+    p->m = m;
+    p->chirp = malloc(n * sizeof(double complex));
+    p->kernel = calloc(m, sizeof(double complex));
+    p->work = malloc(m * sizeof(double complex));
+    if (!p->chirp || !p->kernel || !p->work) { plan_free(p); return -1; }
+
+    for (size_t k = 0; k < n; k++) {
+        // k^2 mod 2n keeps the angle small, so large n do not lose precision
+        uint64_t k2 = ((uint64_t)k * k) % (2 * (uint64_t)n);
+        double ang = M_PI * (double)k2 / (double)n;
+        p->chirp[k] = cos(ang) + I * sin(ang);
+    }
+    p->kernel[0] = conj(p->chirp[0]);
+    for (size_t k = 1; k < n; k++) {
+        p->kernel[k] = conj(p->chirp[k]);
+        p->kernel[m - k] = conj(p->chirp[k]);
+    }
+    fft_pow2(p->kernel, m, -1);
+    return 0;
+}
+
+//Computes X_k = sum_j a_j e^{+2 pi i jk/n} in place using the plan.
+static void plan_exec(fft_plan_t *p, double complex *a) {
+    if (!p->chirp) {
+        fft_pow2(a, p->n, +1);
+        return;
+    }
+    // jk = (j^2 + k^2 - (k-j)^2) / 2  ->  X_k = c_k * sum_j (a_j c_j) conj(c_{k-j})
+    size_t n = p->n, m = p->m;
+    for (size_t j = 0; j < n; j++) p->work[j] = a[j] * p->chirp[j];
+    for (size_t j = n; j < m; j++) p->work[j] = 0;
+    fft_pow2(p->work, m, -1);
+    for (size_t j = 0; j < m; j++) p->work[j] *= p->kernel[j];
+    fft_pow2(p->work, m, +1);
+    for (size_t k = 0; k < n; k++) a[k] = p->work[k] * p->chirp[k] / (double)m;
+}
+
+int rw_spectral_hitting_times(uint32_t w, uint32_t h,
+                              uint32_t p_up, uint32_t p_down, uint32_t p_left, uint32_t p_right,
+                              double *out, uint32_t stride) {
+    if (w == 0 || h == 0 || stride < w || out == NULL) { errno = EINVAL; return -1; }
+    uint64_t sum = (uint64_t)p_up + p_down + p_left + p_right;
+    if (sum != RW_PROB_SCALE) { errno = EINVAL; return -1; }
+
+    const double pu = (double)p_up / RW_PROB_SCALE, pd = (double)p_down / RW_PROB_SCALE;
+    const double pl = (double)p_left / RW_PROB_SCALE, pr = (double)p_right / RW_PROB_SCALE;
+    const size_t cells = (size_t)w * h;
+
+    double complex *g = malloc(cells * sizeof(double complex));
+    double complex *col = malloc((size_t)h * sizeof(double complex));
+    fft_plan_t px, py;
+    int px_ok = plan_init(&px, w) == 0;
+    int py_ok = plan_init(&py, h) == 0;
+    if (!g || !col || !px_ok || !py_ok) {
+        free(g); free(col);
+        if (px_ok) plan_free(&px);
+        if (py_ok) plan_free(&py);
+        errno = ENOMEM;
+        return -1;
+    }
+
+    // g(k) = 1 / (1 - phi(k)) for k != 0, g(0) = 0.
+    // Steps: up = (0,-1), down = (0,+1), left = (-1,0), right = (+1,0); phi(k) = sum_z mu(z) e^{2 pi i k.z}.
+    int reducible = 0;
+    for (uint32_t ky = 0; ky < h; ky++) {
+        double ay = 2.0 * M_PI * (double)ky / (double)h;
+        double complex ey = cos(ay) + I * sin(ay);
+        for (uint32_t kx = 0; kx < w; kx++) {
+            size_t i = (size_t)ky * w + kx;
+            if (kx == 0 && ky == 0) { g[i] = 0; continue; }
+            double ax = 2.0 * M_PI * (double)kx / (double)w;
+            double complex ex = cos(ax) + I * sin(ax);
+            double complex phi = pu * conj(ey) + pd * ey + pl * conj(ex) + pr * ex;
+            double complex d = 1.0 - phi;
+            if (cabs(d) < SYMBOL_EPS) { reducible = 1; g[i] = 0; continue; }
+            g[i] = 1.0 / d;
+        }
+    }
+
+    if (!reducible) {
+        // S(x) = sum_k g(k) e^{2 pi i k.x}: rows, then columns
+        for (uint32_t ky = 0; ky < h; ky++) plan_exec(&px, g + (size_t)ky * w);
+        for (uint32_t x = 0; x < w; x++) {
+            for (uint32_t y = 0; y < h; y++) col[y] = g[(size_t)y * w + x];
+            plan_exec(&py, col);
+            for (uint32_t y = 0; y < h; y++) g[(size_t)y * w + x] = col[y];
+        }
+
+        // E_x[T] = S(0) - S(x); the imaginary parts cancel because g(-k) = conj(g(k))
+        double s0 = creal(g[0]);
+        for (uint32_t y = 0; y < h; y++) {
+            for (uint32_t x = 0; x < w; x++) {
+                double v = s0 - creal(g[(size_t)y * w + x]);
+                out[(size_t)y * stride + x] = (x == 0 && y == 0) ? 0.0 : v;
+            }
+        }
+    }
+
+    free(g);
+    free(col);
+    plan_free(&px);
+    plan_free(&py);
+
+    if (reducible) { errno = EDOM; return -1; }
+    return 0;
+}
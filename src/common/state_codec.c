@@ -0,0 +1,490 @@
+// src/common/state_codec.c (STATE_COMPACT, STATE_RECT, STATE_TILES, WORLD and STATE_DYN encodings)
+#include "common/state_codec.h"
+
+#include <string.h>
+#include <errno.h>
+
+// Output buffer that turns full instead of overflowing.
+typedef struct {
+    unsigned char *p;
+    size_t n, cap;
+    int full;
+} wbuf_t;
+
+typedef struct {
+    const unsigned char *p;
+    size_t n, len;
+} rbuf_t;
+
+//Appends bytes to b, or marks it full if they do not fit.
+static void put_bytes(wbuf_t *b, const void *src, size_t len) {
+    if (b->full || b->cap - b->n < len) { b->full = 1; return; }
+    memcpy(b->p + b->n, src, len);
+    b->n += len;
+}
+
+//Appends v as a varint: 7 bits per byte, low bits first, high bit set on all but the last byte.
+static void put_varint(wbuf_t *b, uint32_t v) {
+    unsigned char tmp[5];
+    size_t k = 0;
+    do {
+        unsigned char c = (unsigned char)(v & 0x7fu);
+        v >>= 7;
+        tmp[k++] = v ? (unsigned char)(c | 0x80u) : c;
+    } while (v);
+    put_bytes(b, tmp, k);
+}
+
+//Reads a varint of at most 32 bits. Returns 0 on success, -1 if it is truncated or too long.
+static int get_varint(rbuf_t *b, uint32_t *out) {
+    uint32_t v = 0;
+    for (unsigned shift = 0; shift < 35; shift += 7) {
+        if (b->n >= b->len) return -1;
+        unsigned char c = b->p[b->n++];
+        if (shift == 28 && (c & 0x70u)) return -1;   // bits beyond 32
+        v |= (uint32_t)(c & 0x7fu) << shift;
+        if (!(c & 0x80u)) { *out = v; return 0; }
+    }
+    return -1;
+}
+
+#define FNV64_OFFSET 0xcbf29ce484222325ULL
+#define FNV64_PRIME  0x100000001b3ULL
+
+//Feeds bytes into an FNV-1a hash.
+static uint64_t fnv_bytes(uint64_t h, const unsigned char *p, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        h ^= p[i];
+        h *= FNV64_PRIME;
+    }
+    return h;
+}
+
+//Hashes a world: its size and type (little-endian, whatever the host) and then its obstacle bits.
+static uint64_t world_hash(uint32_t w, uint32_t h, uint32_t world_type, const unsigned char *bits, size_t n) {
+    unsigned char le[12];
+    const uint32_t v[3] = { w, h, world_type };
+    for (int i = 0; i < 12; i++) le[i] = (unsigned char)(v[i / 4] >> (8 * (i % 4)));
+    return fnv_bytes(fnv_bytes(FNV64_OFFSET, le, sizeof(le)), bits, n);
+}
+
+//Maps a difference to unsigned so that small magnitudes of either sign give small numbers (0, -1, 1, -2 -> 0, 1, 2, 3).
+static inline uint32_t zigzag(uint32_t d) {
+    return (d >> 31) ? ~(d << 1) : (d << 1);
+}
+
+static inline uint32_t unzigzag(uint32_t z) {
+    return (z & 1u) ? ~(z >> 1) : (z >> 1);
+}
+
+//Value a client shows for a quantized one: the middle of its bucket, except that 0 (no data) stays 0.
+static inline uint32_t dequantize(uint32_t q, uint32_t shift) {
+    if (shift == 0 || q == 0) return q;
+    return (q << shift) | (1u << (shift - 1));
+}
+
+size_t rw_state_encode_compact(const rw_state_msg_t *st, int q16, unsigned char *out, size_t cap) {
+    const uint32_t w = st->w, h = st->h;
+    wbuf_t b = { .p = out, .n = 0, .cap = cap, .full = 0 };
+
+    rw_state_compact_hdr_t ch = {
+        .seq = st->seq, .rep_done = st->rep_done, .rep_total = st->rep_total, .mode = st->mode,
+        .w = w, .h = h, .finished = st->finished, .path_len = st->path_len, .flags = 0, .q_shift = 0
+    };
+    uint32_t maxv = 0;
+    for (uint32_t y = 0; y < h; y++) {
+        for (uint32_t x = 0; x < w; x++) {
+            uint32_t i = y * RW_MAX_W + x;
+            if (st->obstacle[i]) ch.flags |= RW_STATE_ENC_OBSTACLES;
+            if (st->cell_value[i] > maxv) maxv = st->cell_value[i];
+        }
+    }
+    if (q16) while ((maxv >> ch.q_shift) > 0xffffu) ch.q_shift++;
+
+    put_bytes(&b, &ch, sizeof(ch));
+    put_bytes(&b, st->path_x, st->path_len * sizeof(int16_t));
+    put_bytes(&b, st->path_y, st->path_len * sizeof(int16_t));
+
+    if (ch.flags & RW_STATE_ENC_OBSTACLES) {
+        unsigned char bits = 0;
+        uint32_t k = 0;
+        for (uint32_t y = 0; y < h; y++) {
+            for (uint32_t x = 0; x < w; x++, k++) {
+                if (st->obstacle[y * RW_MAX_W + x]) bits |= (unsigned char)(1u << (k & 7u));
+                if ((k & 7u) == 7u) { put_bytes(&b, &bits, 1); bits = 0; }
+            }
+        }
+        if (k & 7u) put_bytes(&b, &bits, 1);
+    }
+
+    uint32_t prev = 0, repeat = 0;
+    for (uint32_t y = 0; y < h && !b.full; y++) {
+        for (uint32_t x = 0; x < w; x++) {
+            uint32_t v = st->cell_value[y * RW_MAX_W + x] >> ch.q_shift;
+            if (v == prev) { repeat++; continue; }
+            if (repeat) {
+                put_varint(&b, 0);
+                put_varint(&b, repeat - 1);
+                repeat = 0;
+            }
+            put_varint(&b, zigzag(v - prev));
+            prev = v;
+        }
+    }
+    if (repeat) {
+        put_varint(&b, 0);
+        put_varint(&b, repeat - 1);
+    }
+    return b.full ? 0 : b.n;
+}
+
+int rw_state_decode_compact(const unsigned char *p, size_t len, rw_state_msg_t *st) {
+    rw_state_compact_hdr_t ch;
+    if (len < sizeof(ch)) { errno = EINVAL; return -1; }
+    memcpy(&ch, p, sizeof(ch));
+    if (ch.w > RW_MAX_W || ch.h > RW_MAX_H || ch.path_len > RW_MAX_PATH || ch.q_shift > 16 ||
+        (ch.flags & ~RW_STATE_ENC_OBSTACLES)) {
+        errno = EINVAL;
+        return -1;
+    }
+    const size_t path_bytes = ch.path_len * sizeof(int16_t);
+    const uint32_t cells = ch.w * ch.h;
+    const size_t obstacle_bytes = (ch.flags & RW_STATE_ENC_OBSTACLES) ? (cells + 7u) / 8u : 0;
+    if (len - sizeof(ch) < 2 * path_bytes + obstacle_bytes) { errno = EINVAL; return -1; }
+
+    memset(st, 0, sizeof(*st));
+    st->seq = ch.seq;
+    st->rep_done = ch.rep_done;
+    st->rep_total = ch.rep_total;
+    st->mode = ch.mode;
+    st->w = ch.w;
+    st->h = ch.h;
+    st->finished = ch.finished;
+    st->path_len = ch.path_len;
+    const unsigned char *q = p + sizeof(ch);
+    memcpy(st->path_x, q, path_bytes);
+    memcpy(st->path_y, q + path_bytes, path_bytes);
+    q += 2 * path_bytes;
+
+    if (obstacle_bytes) {
+        uint32_t k = 0;
+        for (uint32_t y = 0; y < ch.h; y++)
+            for (uint32_t x = 0; x < ch.w; x++, k++)
+                st->obstacle[y * RW_MAX_W + x] = (uint8_t)((q[k >> 3] >> (k & 7u)) & 1u);
+        q += obstacle_bytes;
+    }
+
+    rbuf_t b = { .p = q, .n = 0, .len = len - (size_t)(q - p) };
+    uint32_t prev = 0, k = 0;
+    while (k < cells) {
+        uint32_t t;
+        if (get_varint(&b, &t) < 0) { errno = EINVAL; return -1; }
+        uint32_t n = 1;
+        if (t == 0) {
+            if (get_varint(&b, &n) < 0 || n >= cells - k) { errno = EINVAL; return -1; }
+            n++;
+        } else {
+            prev += unzigzag(t);
+        }
+        uint32_t v = dequantize(prev, ch.q_shift);
+        for (; n > 0; n--, k++) st->cell_value[(k / ch.w) * RW_MAX_W + k % ch.w] = v;
+    }
+    if (b.n != b.len) { errno = EINVAL; return -1; }
+    return 0;
+}
+
+//Appends the obstacle bits of the w x h cells from (x, y), row by row, 8 to a byte with the first cell in the LSB.
+static void put_obstacle_bits(wbuf_t *b, const rw_state_msg_t *st, uint32_t x, uint32_t y, uint32_t w, uint32_t h) {
+    unsigned char bits = 0;
+    uint32_t k = 0;
+    for (uint32_t j = 0; j < h; j++) {
+        for (uint32_t i = 0; i < w; i++, k++) {
+            if (st->obstacle[(y + j) * RW_MAX_W + x + i]) bits |= (unsigned char)(1u << (k & 7u));
+            if ((k & 7u) == 7u) { put_bytes(b, &bits, 1); bits = 0; }
+        }
+    }
+    if (k & 7u) put_bytes(b, &bits, 1);
+}
+
+//Sets the obstacles of the w x h cells from (x, y) from bits written by put_obstacle_bits().
+static void get_obstacle_bits(const unsigned char *q, rw_state_msg_t *st, uint32_t x, uint32_t y, uint32_t w, uint32_t h) {
+    uint32_t k = 0;
+    for (uint32_t j = 0; j < h; j++)
+        for (uint32_t i = 0; i < w; i++, k++)
+            st->obstacle[(y + j) * RW_MAX_W + x + i] = (uint8_t)((q[k >> 3] >> (k & 7u)) & 1u);
+}
+
+size_t rw_state_encode_rect(const rw_state_msg_t *st, const rw_subscribe_req_t *sub, unsigned char *out, size_t cap) {
+    wbuf_t b = { .p = out, .n = 0, .cap = cap, .full = 0 };
+
+    // the viewport clipped to the grid; w or h 0 means all of it
+    const uint32_t x = sub->x < st->w ? sub->x : st->w;
+    const uint32_t y = sub->y < st->h ? sub->y : st->h;
+    uint32_t w = sub->w ? sub->w : st->w, h = sub->h ? sub->h : st->h;
+    if (w > st->w - x) w = st->w - x;
+    if (h > st->h - y) h = st->h - y;
+    const uint32_t fields = sub->fields & RW_FIELD_ALL;
+
+    rw_state_rect_hdr_t rh = {
+        .seq = st->seq, .rep_done = st->rep_done, .rep_total = st->rep_total, .mode = st->mode,
+        .finished = st->finished, .grid_w = st->w, .grid_h = st->h,
+        .x = (uint16_t)x, .y = (uint16_t)y, .w = (uint16_t)w, .h = (uint16_t)h,
+        .fields = fields, .path_len = (fields & RW_FIELD_PATH) ? st->path_len : 0
+    };
+    put_bytes(&b, &rh, sizeof(rh));
+    put_bytes(&b, st->path_x, rh.path_len * sizeof(int16_t));
+    put_bytes(&b, st->path_y, rh.path_len * sizeof(int16_t));
+
+    if (fields & RW_FIELD_OBSTACLES) put_obstacle_bits(&b, st, x, y, w, h);
+    if (fields & RW_FIELD_VALUES) {
+        for (uint32_t j = 0; j < h; j++) put_bytes(&b, &st->cell_value[(y + j) * RW_MAX_W + x], w * sizeof(uint32_t));
+    }
+    return b.full ? 0 : b.n;
+}
+
+int rw_state_decode_rect(const unsigned char *p, size_t len, rw_state_msg_t *st, rw_state_rect_hdr_t *hdr_out) {
+    rw_state_rect_hdr_t rh;
+    if (len < sizeof(rh)) { errno = EINVAL; return -1; }
+    memcpy(&rh, p, sizeof(rh));
+    if (rh.grid_w > RW_MAX_W || rh.grid_h > RW_MAX_H || (uint32_t)rh.x + rh.w > rh.grid_w ||
+        (uint32_t)rh.y + rh.h > rh.grid_h || rh.path_len > RW_MAX_PATH || (rh.fields & ~RW_FIELD_ALL) ||
+        (rh.path_len && !(rh.fields & RW_FIELD_PATH))) {
+        errno = EINVAL;
+        return -1;
+    }
+    const size_t path_bytes = rh.path_len * sizeof(int16_t);
+    const uint32_t cells = (uint32_t)rh.w * rh.h;
+    const size_t obstacle_bytes = (rh.fields & RW_FIELD_OBSTACLES) ? (cells + 7u) / 8u : 0;
+    const size_t value_bytes = (rh.fields & RW_FIELD_VALUES) ? cells * sizeof(uint32_t) : 0;
+    if (len - sizeof(rh) != 2 * path_bytes + obstacle_bytes + value_bytes) { errno = EINVAL; return -1; }
+
+    memset(st, 0, sizeof(*st));
+    st->seq = rh.seq;
+    st->rep_done = rh.rep_done;
+    st->rep_total = rh.rep_total;
+    st->mode = rh.mode;
+    st->w = rh.grid_w;
+    st->h = rh.grid_h;
+    st->finished = rh.finished;
+    st->path_len = rh.path_len;
+    const unsigned char *q = p + sizeof(rh);
+    memcpy(st->path_x, q, path_bytes);
+    memcpy(st->path_y, q + path_bytes, path_bytes);
+    q += 2 * path_bytes;
+
+    if (obstacle_bytes) {
+        get_obstacle_bits(q, st, rh.x, rh.y, rh.w, rh.h);
+        q += obstacle_bytes;
+    }
+    if (value_bytes) {
+        for (uint32_t j = 0; j < rh.h; j++) {
+            memcpy(&st->cell_value[(rh.y + j) * RW_MAX_W + rh.x], q, rh.w * sizeof(uint32_t));
+            q += rh.w * sizeof(uint32_t);
+        }
+    }
+    if (hdr_out) *hdr_out = rh;
+    return 0;
+}
+
+//Finds the cells of a tile of a w x h grid: the tile's column and row, its top-left cell and its size.
+static void tile_rect(uint32_t w, uint32_t h, uint32_t tile, uint32_t *tx, uint32_t *ty, uint32_t *x, uint32_t *y,
+                      uint32_t *tw, uint32_t *th) {
+    const uint32_t cols = (w + RW_STATE_TILE - 1) / RW_STATE_TILE;
+    *tx = tile % cols;
+    *ty = tile / cols;
+    *x = *tx * RW_STATE_TILE;
+    *y = *ty * RW_STATE_TILE;
+    *tw = w - *x < RW_STATE_TILE ? w - *x : RW_STATE_TILE;
+    *th = h - *y < RW_STATE_TILE ? h - *y : RW_STATE_TILE;
+}
+
+uint32_t rw_state_tile_count(const rw_state_msg_t *st) {
+    return ((st->w + RW_STATE_TILE - 1) / RW_STATE_TILE) * ((st->h + RW_STATE_TILE - 1) / RW_STATE_TILE);
+}
+
+size_t rw_state_tile_bytes(const rw_state_msg_t *st, uint32_t tile) {
+    uint32_t tx, ty, x, y, tw, th;
+    tile_rect(st->w, st->h, tile, &tx, &ty, &x, &y, &tw, &th);
+    return sizeof(rw_state_tile_hdr_t) + (tw * th + 7u) / 8u + tw * th * sizeof(uint32_t);
+}
+
+int rw_state_tile_changed(const rw_state_msg_t *a, const rw_state_msg_t *b, uint32_t tile) {
+    uint32_t tx, ty, x, y, tw, th;
+    tile_rect(b->w, b->h, tile, &tx, &ty, &x, &y, &tw, &th);
+    for (uint32_t j = 0; j < th; j++) {
+        const uint32_t i = (y + j) * RW_MAX_W + x;
+        if (memcmp(&a->cell_value[i], &b->cell_value[i], tw * sizeof(uint32_t)) != 0 ||
+            memcmp(&a->obstacle[i], &b->obstacle[i], tw) != 0) return 1;
+    }
+    return 0;
+}
+
+size_t rw_state_encode_tiles(const rw_state_msg_t *st, const uint32_t *tiles, uint32_t n, const uint32_t *tile_seq,
+                             uint32_t pending, unsigned char *out, size_t cap) {
+    wbuf_t b = { .p = out, .n = 0, .cap = cap, .full = 0 };
+    if (n > UINT16_MAX) return 0;
+
+    rw_state_tiles_hdr_t th = {
+        .seq = st->seq, .rep_done = st->rep_done, .rep_total = st->rep_total, .mode = st->mode,
+        .finished = st->finished, .grid_w = st->w, .grid_h = st->h, .tile = RW_STATE_TILE,
+        .ntiles = (uint16_t)n, .pending = pending, .path_len = st->path_len
+    };
+    put_bytes(&b, &th, sizeof(th));
+    put_bytes(&b, st->path_x, st->path_len * sizeof(int16_t));
+    put_bytes(&b, st->path_y, st->path_len * sizeof(int16_t));
+
+    for (uint32_t k = 0; k < n; k++) {
+        uint32_t tx, ty, x, y, tw, tht;
+        tile_rect(st->w, st->h, tiles[k], &tx, &ty, &x, &y, &tw, &tht);
+        rw_state_tile_hdr_t h = { .tx = (uint16_t)tx, .ty = (uint16_t)ty, .tile_seq = tile_seq[tiles[k]] };
+        put_bytes(&b, &h, sizeof(h));
+        put_obstacle_bits(&b, st, x, y, tw, tht);
+        for (uint32_t j = 0; j < tht; j++) put_bytes(&b, &st->cell_value[(y + j) * RW_MAX_W + x], tw * sizeof(uint32_t));
+    }
+    return b.full ? 0 : b.n;
+}
+
+int rw_state_decode_tiles(const unsigned char *p, size_t len, rw_state_msg_t *st, rw_state_tiles_hdr_t *hdr_out) {
+    rw_state_tiles_hdr_t th;
+    if (len < sizeof(th)) { errno = EINVAL; return -1; }
+    memcpy(&th, p, sizeof(th));
+    const size_t path_bytes = th.path_len * sizeof(int16_t);
+    if (th.grid_w == 0 || th.grid_h == 0 || th.grid_w > RW_MAX_W || th.grid_h > RW_MAX_H || th.tile != RW_STATE_TILE ||
+        th.path_len > RW_MAX_PATH || len - sizeof(th) < 2 * path_bytes) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    // check the whole message before touching st
+    const uint32_t cols = (th.grid_w + RW_STATE_TILE - 1) / RW_STATE_TILE;
+    const uint32_t rows = (th.grid_h + RW_STATE_TILE - 1) / RW_STATE_TILE;
+    const unsigned char *end = p + len;
+    const unsigned char *q = p + sizeof(th) + 2 * path_bytes;
+    for (uint32_t k = 0; k < th.ntiles; k++) {
+        rw_state_tile_hdr_t h;
+        if ((size_t)(end - q) < sizeof(h)) { errno = EINVAL; return -1; }
+        memcpy(&h, q, sizeof(h));
+        if (h.tx >= cols || h.ty >= rows) { errno = EINVAL; return -1; }
+        uint32_t tx, ty, x, y, tw, tht;
+        tile_rect(th.grid_w, th.grid_h, h.ty * cols + h.tx, &tx, &ty, &x, &y, &tw, &tht);
+        const size_t bytes = sizeof(h) + (tw * tht + 7u) / 8u + tw * tht * sizeof(uint32_t);
+        if ((size_t)(end - q) < bytes) { errno = EINVAL; return -1; }
+        q += bytes;
+    }
+    if (q != end) { errno = EINVAL; return -1; }
+
+    // tiles of another grid are no use: start from an empty one
+    if (st->w != th.grid_w || st->h != th.grid_h) memset(st, 0, sizeof(*st));
+    st->seq = th.seq;
+    st->rep_done = th.rep_done;
+    st->rep_total = th.rep_total;
+    st->mode = th.mode;
+    st->w = th.grid_w;
+    st->h = th.grid_h;
+    st->finished = th.finished;
+    st->path_len = th.path_len;
+    q = p + sizeof(th);
+    memcpy(st->path_x, q, path_bytes);
+    memcpy(st->path_y, q + path_bytes, path_bytes);
+    q += 2 * path_bytes;
+
+    for (uint32_t k = 0; k < th.ntiles; k++) {
+        rw_state_tile_hdr_t h;
+        memcpy(&h, q, sizeof(h));
+        q += sizeof(h);
+        uint32_t tx, ty, x, y, tw, tht;
+        tile_rect(th.grid_w, th.grid_h, h.ty * cols + h.tx, &tx, &ty, &x, &y, &tw, &tht);
+        get_obstacle_bits(q, st, x, y, tw, tht);
+        q += (tw * tht + 7u) / 8u;
+        for (uint32_t j = 0; j < tht; j++) {
+            memcpy(&st->cell_value[(y + j) * RW_MAX_W + x], q, tw * sizeof(uint32_t));
+            q += tw * sizeof(uint32_t);
+        }
+    }
+    if (hdr_out) *hdr_out = th;
+    return 0;
+}
+
+size_t rw_world_encode(const rw_state_msg_t *st, rw_world_type_t world_type, uint64_t *hash_out, unsigned char *out,
+                       size_t cap) {
+    wbuf_t b = { .p = out, .n = 0, .cap = cap, .full = 0 };
+    rw_world_hdr_t wh = { .world_hash = 0, .w = st->w, .h = st->h, .world_type = world_type, .reserved = 0 };
+    put_bytes(&b, &wh, sizeof(wh));
+    put_obstacle_bits(&b, st, 0, 0, st->w, st->h);
+    if (b.full) return 0;
+
+    // the hash covers the bits just written, so it goes in last
+    wh.world_hash = world_hash(wh.w, wh.h, (uint32_t)wh.world_type, out + sizeof(wh), b.n - sizeof(wh));
+    memcpy(out, &wh, sizeof(wh));
+    if (hash_out) *hash_out = wh.world_hash;
+    return b.n;
+}
+
+int rw_world_decode(const unsigned char *p, size_t len, rw_world_t *world) {
+    rw_world_hdr_t wh;
+    if (len < sizeof(wh)) { errno = EINVAL; return -1; }
+    memcpy(&wh, p, sizeof(wh));
+    if (wh.w == 0 || wh.h == 0 || wh.w > RW_MAX_W || wh.h > RW_MAX_H ||
+        len - sizeof(wh) != (wh.w * wh.h + 7u) / 8u ||
+        world_hash(wh.w, wh.h, (uint32_t)wh.world_type, p + sizeof(wh), len - sizeof(wh)) != wh.world_hash) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    memset(world, 0, sizeof(*world));
+    world->hash = wh.world_hash;
+    world->w = wh.w;
+    world->h = wh.h;
+    world->world_type = wh.world_type;
+    const unsigned char *q = p + sizeof(wh);
+    uint32_t k = 0;
+    for (uint32_t y = 0; y < wh.h; y++)
+        for (uint32_t x = 0; x < wh.w; x++, k++)
+            world->obstacle[y * RW_MAX_W + x] = (uint8_t)((q[k >> 3] >> (k & 7u)) & 1u);
+    return 0;
+}
+
+size_t rw_state_encode_dyn(const rw_state_msg_t *st, uint64_t world_hash, unsigned char *out, size_t cap) {
+    wbuf_t b = { .p = out, .n = 0, .cap = cap, .full = 0 };
+    rw_state_dyn_hdr_t dh = {
+        .world_hash = world_hash, .seq = st->seq, .rep_done = st->rep_done, .rep_total = st->rep_total,
+        .mode = st->mode, .finished = st->finished, .path_len = st->path_len
+    };
+    put_bytes(&b, &dh, sizeof(dh));
+    put_bytes(&b, st->path_x, st->path_len * sizeof(int16_t));
+    put_bytes(&b, st->path_y, st->path_len * sizeof(int16_t));
+    for (uint32_t y = 0; y < st->h; y++) put_bytes(&b, &st->cell_value[y * RW_MAX_W], st->w * sizeof(uint32_t));
+    return b.full ? 0 : b.n;
+}
+
+int rw_state_decode_dyn(const unsigned char *p, size_t len, const rw_world_t *world, rw_state_msg_t *st) {
+    rw_state_dyn_hdr_t dh;
+    if (len < sizeof(dh)) { errno = EINVAL; return -1; }
+    memcpy(&dh, p, sizeof(dh));
+    const size_t path_bytes = dh.path_len * sizeof(int16_t);
+    if (world->hash == 0 || dh.world_hash != world->hash) { errno = ESTALE; return -1; }
+    if (dh.path_len > RW_MAX_PATH || len - sizeof(dh) != 2 * path_bytes + world->w * world->h * sizeof(uint32_t)) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    memset(st, 0, sizeof(*st));
+    st->seq = dh.seq;
+    st->rep_done = dh.rep_done;
+    st->rep_total = dh.rep_total;
+    st->mode = dh.mode;
+    st->w = world->w;
+    st->h = world->h;
+    st->finished = dh.finished;
+    st->path_len = dh.path_len;
+    const unsigned char *q = p + sizeof(dh);
+    memcpy(st->path_x, q, path_bytes);
+    memcpy(st->path_y, q + path_bytes, path_bytes);
+    q += 2 * path_bytes;
+    memcpy(st->obstacle, world->obstacle, sizeof(st->obstacle));
+    for (uint32_t y = 0; y < world->h; y++) {
+        memcpy(&st->cell_value[y * RW_MAX_W], q, world->w * sizeof(uint32_t));
+        q += world->w * sizeof(uint32_t);
+    }
+    return 0;
+}
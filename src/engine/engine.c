@@ -0,0 +1,1121 @@
+// src/engine/engine.c (simulation engine shared by the server and rwbatch)
+#include "engine/engine.h"
+#include "engine/numa.h"
+#include "common/results_io.h"
+#include "common/spectral.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <inttypes.h>
+#include <math.h>
+
+//Converts 2D coordinates (x, y) into a 1D array index for the grid-based buffers (cell statistics, obstacles, etc.).
+static inline uint32_t idx(uint32_t x, uint32_t y) { return y * RW_MAX_W + x; }
+
+//Draws one uniform value in [0, RW_PROB_SCALE) from the per-simulation rand_r state.
+static inline uint32_t draw_u(unsigned int *seed) {
+    return (uint32_t)(rand_r(seed) % RW_PROB_SCALE);
+}
+
+//Maps a uniform draw to a direction (up/down/left/right) according to the given probabilities.
+static int dir_from_u(uint32_t r, uint32_t p_up, uint32_t p_down, uint32_t p_left, uint32_t p_right) {
+    uint32_t c = 0;
+    c += p_up;   if (r < c) return 0;
+    c += p_down; if (r < c) return 1;
+    c += p_left; if (r < c) return 2;
+    (void)p_right;
+    return 3;
+}
+
+//Randomly selects a movement direction (up/down/left/right) according to the configured probabilities.
+//Uses rand_r with a per-simulation seed so the simulation can run without global RNG state.
+static int pick_dir(uint32_t p_up, uint32_t p_down, uint32_t p_left, uint32_t p_right, unsigned int *seed) {
+    return dir_from_u(draw_u(seed), p_up, p_down, p_left, p_right);
+}
+
+//Applies one movement step in the chosen direction and wraps around the edges 
+//(“world without obstacles” wrap behavior: going off one side reappears on the opposite side).
+static void step_wrap(uint32_t w, uint32_t h, int *x, int *y, int dir) {
+    int nx = *x, ny = *y;
+    switch (dir) {
+        case 0: ny -= 1; break;
+        case 1: ny += 1; break;
+        case 2: nx -= 1; break;
+        case 3: nx += 1; break;
+        default: break;
+    }
+    if (w > 0) {
+        if (nx < 0) nx += (int)w;
+        if (nx >= (int)w) nx -= (int)w;
+    }
+    if (h > 0) {
+        if (ny < 0) ny += (int)h;
+        if (ny >= (int)h) ny -= (int)h;
+    }
+    *x = nx; *y = ny;
+}
+
+// Importance-weighted sums of one alternative probability vector for one start cell.
+// Weight of a trajectory: W = prod_d (q_d / p_d)^{n_d} for its direction counts n_d.
+typedef struct {
+    double sum_w;    // sum W
+    double sum_w2;   // sum W^2 (effective sample size)
+    double sum_wt;   // sum W * steps
+    double sum_wk;   // sum W * [hit within K]
+} sweep_acc_t;
+
+// One walker of a multilevel-splitting tree (PROB_K rare-event mode).
+typedef struct {
+    int x, y;
+    uint32_t steps;
+    uint32_t level;   // level crossings so far
+    double weight;
+} split_clone_t;
+
+// DFS keeps at most (split_factor - 1) pending siblings per level, plus the walker being advanced.
+#define SPLIT_STACK_MAX ((RW_MAX_W / 2 + RW_MAX_H / 2 + 1) * (RW_MAX_SPLIT_FACTOR - 1) + 1)
+
+// ---- Simulation state ----
+struct rw_sim {
+    // config
+    uint32_t w, h, K, rep_total;
+    uint32_t p_up, p_down, p_left, p_right;
+    rw_world_type_t world_type;
+    uint32_t obstacle_density_permille;
+    uint32_t seed;          // seed requested by the creator (0 = random, not cacheable)
+    uint32_t seed_used;     // seed the RNG actually started from (recorded in shards)
+    unsigned int rng_seed;  // current rand_r state
+
+    rw_engine_t engine;
+    rw_vr_scheme_t vr_scheme;
+
+    // progress in summary sense: completed full-grid replications
+    uint32_t rep_done;
+
+    // accumulators
+    uint64_t steps_sum[RW_MAX_W * RW_MAX_H];
+    uint32_t hit_k_count[RW_MAX_W * RW_MAX_H];
+
+    // current replication scanning
+    uint32_t cur_cell_x, cur_cell_y;
+    int tx, ty;
+    uint32_t t_steps;
+    uint32_t t_dir_count[4];  // moves per direction in the current trajectory (sweep weights)
+    int traj_active;
+
+    // sweep mode: log(q_d / p_d) per alternative vector and direction (-INFINITY if q_d == 0)
+    uint32_t sweep_count;
+    uint32_t sweep_p[RW_MAX_SWEEP][4];
+    double sweep_log_ratio[RW_MAX_SWEEP][4];
+    sweep_acc_t sweep_acc[RW_MAX_SWEEP][RW_MAX_W * RW_MAX_H];
+
+    // multilevel splitting for PROB_K: after each plain trajectory a splitting tree truncated at K steps
+    // is run from the same cell; its weighted hit count is one sample of the PROB_K estimator
+    uint32_t split_factor;      // 0 = off
+    uint32_t split_level_step;
+    int split_active;
+    uint32_t split_start_dist;
+    uint32_t split_sp;
+    split_clone_t split_stack[SPLIT_STACK_MAX];
+    double split_tree_sum;      // weight that reached [0,0] in the current tree
+    uint32_t split_n[RW_MAX_W * RW_MAX_H];
+    double split_sum_y[RW_MAX_W * RW_MAX_H];
+    double split_sum_y2[RW_MAX_W * RW_MAX_H];
+    uint64_t split_steps;       // steps spent in splitting trees
+
+    // approximate tail-memo mode: ring buffer of the most recent hit times per starting cell; once a cell's
+    // buffer is full, a walker entering it stops and adds a stored sample (strong Markov property)
+    uint32_t tail_cap;          // 0 = off
+    uint32_t tail_fill[RW_MAX_W * RW_MAX_H];
+    uint32_t tail_next[RW_MAX_W * RW_MAX_H];
+    uint32_t tail_res[RW_MAX_W * RW_MAX_H][RW_MAX_TAIL_RESERVOIR];
+    uint64_t tail_memo_finishes;  // walks ended by a stored sample
+    uint64_t walk_steps;          // steps actually simulated by the plain step loop
+
+    // exact expected steps per cell: the result of RW_ENGINE_SPECTRAL, or the known mean of the
+    // unbiased reference walk for RW_VR_CONTROL_VARIATE
+    double exact_avg[RW_MAX_W * RW_MAX_H];
+
+    // variance reduction: companion walk advanced in lockstep with the main walk on shared draws
+    // (mirrored draws for antithetic pairs, unbiased probabilities for the control variate)
+    int cx, cy;
+    uint32_t c_steps;
+    int main_done, comp_done;
+    // per-cell moments of main (a) and companion (b) hitting times
+    uint32_t vr_n[RW_MAX_W * RW_MAX_H];
+    double vr_sum_a[RW_MAX_W * RW_MAX_H], vr_sum_a2[RW_MAX_W * RW_MAX_H];
+    double vr_sum_b[RW_MAX_W * RW_MAX_H], vr_sum_b2[RW_MAX_W * RW_MAX_H];
+    double vr_sum_ab[RW_MAX_W * RW_MAX_H];
+
+    // display-only walker for interactive mode: one step per tick on its own RNG stream, so watching the
+    // animation neither slows the statistics down nor changes their random numbers
+    unsigned int disp_rng;
+    uint32_t disp_cell_x, disp_cell_y;
+    int disp_x, disp_y;
+    int disp_active;
+    uint32_t path_len;
+    int16_t path_x[RW_MAX_PATH];
+    int16_t path_y[RW_MAX_PATH];
+
+    // represents how many replications were started from specific cell
+    uint32_t samples[RW_MAX_H * RW_MAX_W];
+
+    // moments of the walks simulated here, for the confidence interval of the mean (cached replications bring
+    // only their sums, so these count the walks since the run started)
+    uint32_t var_n[RW_MAX_W * RW_MAX_H];
+    double var_sum[RW_MAX_W * RW_MAX_H], var_sum2[RW_MAX_W * RW_MAX_H];
+
+    // replications that came from the result cache (0 = computed from scratch)
+    uint32_t cache_rep_loaded;
+
+    // bumped on every change a snapshot can show (statistics, display path, rep_total)
+    uint64_t version;
+
+    // number of shards summed into this simulation by rw_sim_merge (0 = computed here); merged results come
+    // from several RNG streams, so they never go into the result cache under this simulation's seed
+    uint32_t merged_parts;
+};
+
+
+//Initializes a new simulation from the CREATE request: copies world size, probabilities, K, replication count
+//and the estimator options, and seeds the statistics and display RNG streams.
+static void sim_init(rw_sim_t *S, const rw_create_sim_req_t *req) {
+    memset(S, 0, sizeof(*S));
+
+    S->w = req->w; S->h = req->h; S->K = req->K; S->rep_total = req->rep_total;
+    S->p_up = req->p_up; S->p_down = req->p_down; S->p_left = req->p_left; S->p_right = req->p_right;
+    S->world_type = req->world_type;
+    S->obstacle_density_permille = req->obstacle_density_permille;
+    S->seed = req->seed;
+    S->rng_seed = req->seed ? (unsigned int)req->seed : ((unsigned int)time(NULL) ^ (unsigned int)getpid());
+    S->seed_used = (uint32_t)S->rng_seed;
+    S->disp_rng = S->rng_seed ^ 0x9e3779b9u;
+    S->engine = req->engine;
+    S->vr_scheme = req->vr_scheme;
+
+    S->split_factor = (req->split_factor > 1) ? req->split_factor : 0;
+    S->split_level_step = req->split_level_step;
+    S->tail_cap = req->tail_reservoir;
+
+    const double p[4] = { req->p_up, req->p_down, req->p_left, req->p_right };
+    S->sweep_count = req->sweep_count;
+    for (uint32_t v = 0; v < S->sweep_count; v++) {
+        for (int d = 0; d < 4; d++) {
+            S->sweep_p[v][d] = req->sweep_p[v][d];
+            // rw_sim_validate guarantees p_d > 0 wherever q_d > 0
+            S->sweep_log_ratio[v][d] = (req->sweep_p[v][d] == 0) ? -INFINITY : log((double)req->sweep_p[v][d] / p[d]);
+        }
+    }
+
+    S->rep_done = 0;
+    S->cur_cell_x = 0; S->cur_cell_y = 0;
+    S->traj_active = 0;
+    S->disp_active = 0;
+    S->path_len = 0;
+}
+
+//Builds the result-cache key of a simulation: everything that influences its accumulators except rep_total.
+static rw_sim_key_t sim_key(const rw_sim_t *S) {
+    rw_sim_key_t k;
+    memset(&k, 0, sizeof(k));
+    k.w = S->w; k.h = S->h; k.K = S->K;
+    k.p_up = S->p_up; k.p_down = S->p_down; k.p_left = S->p_left; k.p_right = S->p_right;
+    k.world_type = (uint32_t)S->world_type;
+    k.obstacle_density_permille = S->obstacle_density_permille;
+    k.seed = S->seed;
+    return k;
+}
+
+//Describes the simulation's accumulator arrays for the result cache.
+static rw_accum_ref_t sim_accum(rw_sim_t *S) {
+    rw_accum_ref_t a = {
+        .steps_sum = S->steps_sum, .samples = S->samples,
+        .hit_k_count = S->hit_k_count, .stride = RW_MAX_W
+    };
+    return a;
+}
+
+int rw_sim_load_cached(rw_sim_t *S, const rw_cache_t *cache) {
+    // sweep and splitting accumulators are not cached, so such runs always start from scratch
+    if (!cache || S->seed == 0 || S->engine != RW_ENGINE_MONTE_CARLO || S->merged_parts > 0) return 0;
+    if (S->sweep_count > 0 || S->split_factor > 0 || S->vr_scheme != RW_VR_NONE) return 0;
+    if (S->tail_cap > 0) return 0;   // approximate results must never be served as exact ones
+
+    rw_sim_key_t key = sim_key(S);
+    rw_accum_ref_t acc = sim_accum(S);
+    uint32_t rep_done = 0, rng = 0;
+    int rc = rw_cache_load(cache, &key, &acc, &rep_done, &rng);
+    if (rc <= 0 || rep_done == 0) return rc;
+    if (rep_done > S->rep_total) {
+        // an earlier run went further: its results would make this one depend on the cache history, not on the
+        // request, so it starts from scratch (and its own entry replaces that one)
+        memset(S->steps_sum, 0, sizeof(S->steps_sum));
+        memset(S->samples, 0, sizeof(S->samples));
+        memset(S->hit_k_count, 0, sizeof(S->hit_k_count));
+        return 0;
+    }
+
+    S->rep_done = rep_done;
+    S->rng_seed = rng;
+    S->cache_rep_loaded = rep_done;
+    S->version++;
+    return (rep_done > INT32_MAX) ? INT32_MAX : (int)rep_done;
+}
+
+int rw_sim_store_cached(rw_sim_t *S, const rw_cache_t *cache) {
+    if (!cache || S->seed == 0 || S->engine != RW_ENGINE_MONTE_CARLO || S->merged_parts > 0) return 0;
+    if (S->tail_cap > 0) return 0;
+    // splitting trees draw from the same RNG stream between the plain walks: neither the accumulators nor the
+    // RNG position match a plain run of the same key
+    if (S->split_factor > 0) return 0;
+    // variance-reduced runs step a companion walk on the same draws (antithetic pairs also count it as a sample)
+    if (S->vr_scheme != RW_VR_NONE) return 0;
+    // runs stopped mid-replication are not cached
+    if (S->traj_active || S->split_active || S->cur_cell_x != 0 || S->cur_cell_y != 0) return 0;
+    if (S->rep_done <= S->cache_rep_loaded) return 0;
+
+    rw_sim_key_t key = sim_key(S);
+    rw_accum_ref_t acc = sim_accum(S);
+    if (rw_cache_store(cache, &key, &acc, S->rep_done, S->rng_seed) < 0) return -1;
+    S->cache_rep_loaded = S->rep_done;
+    return 1;
+}
+
+//Fills exact_avg with the closed-form expected hitting times of the spectral engine and marks the run as complete.
+//Returns -1 (errno = EDOM) if some cell can never reach [0,0] with the given probabilities.
+static int sim_solve_exact(rw_sim_t *S) {
+    if (rw_spectral_hitting_times(S->w, S->h, S->p_up, S->p_down, S->p_left, S->p_right,
+                                  S->exact_avg, RW_MAX_W) < 0) return -1;
+    S->rep_done = S->rep_total;
+    return 0;
+}
+
+//Computes the exact mean hitting times of the unbiased reference walk used as control variate.
+static int sim_init_control_variate(rw_sim_t *S) {
+    const uint32_t q = RW_PROB_SCALE / 4;
+    return rw_spectral_hitting_times(S->w, S->h, q, q, q, q, S->exact_avg, RW_MAX_W);
+}
+
+//Starts a new walk from the current starting cell, resets the step counter, and begins recording the trajectory for interactive display.
+static void start_traj(rw_sim_t *S) {
+    S->tx = (int)S->cur_cell_x;
+    S->ty = (int)S->cur_cell_y;
+    S->t_steps = 0;
+    memset(S->t_dir_count, 0, sizeof(S->t_dir_count));
+    S->traj_active = 1;
+
+    S->cx = S->tx;
+    S->cy = S->ty;
+    S->c_steps = 0;
+    S->main_done = 0;
+    S->comp_done = 0;
+}
+
+//Moves to the next starting cell and tracks when a full-grid replication is complete.
+static void advance_cell(rw_sim_t *S) {
+    S->cur_cell_x++;
+    if (S->cur_cell_x >= S->w) {
+        S->cur_cell_x = 0;
+        S->cur_cell_y++;
+        if (S->cur_cell_y >= S->h) {
+            S->cur_cell_y = 0;
+            S->rep_done++; // one full-grid replication finished
+        }
+    }
+}
+
+//Minimal number of steps from (x, y) to [0,0] on the torus (Manhattan distance with wrap-around).
+static uint32_t torus_dist(const rw_sim_t *S, int x, int y) {
+    uint32_t dx = (uint32_t)x, dy = (uint32_t)y;
+    if (S->w - dx < dx) dx = S->w - dx;
+    if (S->h - dy < dy) dy = S->h - dy;
+    return dx + dy;
+}
+
+//Starts a multilevel-splitting tree from the current cell with a single walker of weight 1.
+static void split_start(rw_sim_t *S) {
+    S->split_active = 1;
+    S->split_tree_sum = 0.0;
+    S->split_start_dist = torus_dist(S, (int)S->cur_cell_x, (int)S->cur_cell_y);
+
+    split_clone_t root = { .x = (int)S->cur_cell_x, .y = (int)S->cur_cell_y, .steps = 0, .level = 0, .weight = 1.0 };
+    S->split_stack[0] = root;
+    S->split_sp = 1;
+}
+
+//Records the finished tree's weighted hit count as one PROB_K sample for the cell and moves on.
+static void split_finish_advance(rw_sim_t *S) {
+    uint32_t i = idx(S->cur_cell_x, S->cur_cell_y);
+    S->split_n[i]++;
+    S->split_sum_y[i] += S->split_tree_sum;
+    S->split_sum_y2[i] += S->split_tree_sum * S->split_tree_sum;
+    S->split_active = 0;
+    advance_cell(S);
+}
+
+//Advances the splitting tree depth-first by up to budget steps. Walkers that can no longer reach [0,0] within K
+//are dropped, walkers that reach it add their weight, and a walker crossing the next distance level is replaced
+//by split_factor clones of equal weight (unbiased: the expected total weight is unchanged). Returns the steps taken.
+static uint32_t split_do_steps(rw_sim_t *S, uint32_t budget) {
+    uint32_t n = 0;
+    while (S->split_sp > 0 && n < budget) {
+        split_clone_t *c = &S->split_stack[S->split_sp - 1];
+
+        uint32_t d = torus_dist(S, c->x, c->y);
+        if (d == 0) {
+            S->split_tree_sum += c->weight;
+            S->split_sp--;
+            continue;
+        }
+        if (c->steps + d > S->K) {
+            S->split_sp--;
+            continue;
+        }
+
+        int dir = pick_dir(S->p_up, S->p_down, S->p_left, S->p_right, &S->rng_seed);
+        step_wrap(S->w, S->h, &c->x, &c->y, dir);
+        c->steps++;
+        n++;
+
+        // next level boundary: split_level_step closer than the last crossing (the target itself is no level)
+        uint64_t gained = (uint64_t)(c->level + 1) * S->split_level_step;
+        d = torus_dist(S, c->x, c->y);
+        if (d > 0 && gained < S->split_start_dist && d <= S->split_start_dist - gained) {
+            c->level++;
+            // SPLIT_STACK_MAX covers the deepest tree; never drop weight if that ever changes
+            if (S->split_sp + S->split_factor - 1 <= SPLIT_STACK_MAX) {
+                c->weight /= (double)S->split_factor;
+                split_clone_t copy = *c;
+                for (uint32_t k = 1; k < S->split_factor; k++) S->split_stack[S->split_sp++] = copy;
+            }
+        }
+    }
+    S->split_steps += n;
+
+    if (S->split_sp == 0) split_finish_advance(S);
+    return n;
+}
+
+//Finalizes one walk result for the current starting cell (stores steps-to-center, updates hit-within-K stats),
+//then either starts the splitting tree for the same cell or advances to the next cell.
+static void finish_traj_advance(rw_sim_t *S, uint32_t steps_to_hit, int hit_within_k) {
+    uint32_t i = idx(S->cur_cell_x, S->cur_cell_y);
+    S->steps_sum[i] += steps_to_hit;
+    S->samples[i]++;
+    if (hit_within_k) S->hit_k_count[i]++;
+    S->var_n[i]++;
+    S->var_sum[i] += (double)steps_to_hit;
+    S->var_sum2[i] += (double)steps_to_hit * steps_to_hit;
+
+    // reweight the same trajectory for every alternative probability vector
+    for (uint32_t v = 0; v < S->sweep_count; v++) {
+        double log_w = 0.0;
+        for (int d = 0; d < 4; d++) {
+            if (S->t_dir_count[d] > 0) log_w += (double)S->t_dir_count[d] * S->sweep_log_ratio[v][d];
+        }
+        double wgt = exp(log_w);
+        sweep_acc_t *a = &S->sweep_acc[v][i];
+        a->sum_w += wgt;
+        a->sum_w2 += wgt * wgt;
+        a->sum_wt += wgt * (double)steps_to_hit;
+        if (hit_within_k) a->sum_wk += wgt;
+    }
+
+    S->traj_active = 0;
+
+    if (S->split_factor > 0) {
+        split_start(S);
+        return;
+    }
+    advance_cell(S);
+}
+
+//Finishes an antithetic / control-variate pair: the companion's hitting time goes into the variance-reduction
+//moments (and, for antithetic pairs, into the ordinary accumulators as a second sample), then the main walk is
+//finalized as usual.
+static void finish_pair_advance(rw_sim_t *S) {
+    uint32_t i = idx(S->cur_cell_x, S->cur_cell_y);
+    double a = (double)S->t_steps, b = (double)S->c_steps;
+    S->vr_n[i]++;
+    S->vr_sum_a[i] += a;  S->vr_sum_a2[i] += a * a;
+    S->vr_sum_b[i] += b;  S->vr_sum_b2[i] += b * b;
+    S->vr_sum_ab[i] += a * b;
+
+    if (S->vr_scheme == RW_VR_ANTITHETIC) {
+        S->steps_sum[i] += S->c_steps;
+        S->samples[i]++;
+        if (S->c_steps <= S->K) S->hit_k_count[i]++;
+        S->var_n[i]++;
+        S->var_sum[i] += b;
+        S->var_sum2[i] += b * b;
+    }
+    finish_traj_advance(S, S->t_steps, (S->t_steps <= S->K) ? 1 : 0);
+}
+
+//Lockstep version of the step loop for the variance-reduction schemes: every draw moves the main walk and its
+//companion until both have reached [0,0]. Returns the number of draws used.
+static uint32_t sim_do_steps_paired(rw_sim_t *S, uint32_t budget) {
+    const uint32_t q = RW_PROB_SCALE / 4;
+
+    if (!S->traj_active) start_traj(S);
+    if (S->tx == 0 && S->ty == 0) S->main_done = 1;
+    if (S->cx == 0 && S->cy == 0) S->comp_done = 1;
+
+    uint32_t n = 0;
+    for (; n < budget && !(S->main_done && S->comp_done); n++) {
+        uint32_t r = draw_u(&S->rng_seed);
+
+        if (!S->main_done) {
+            int dir = dir_from_u(r, S->p_up, S->p_down, S->p_left, S->p_right);
+            step_wrap(S->w, S->h, &S->tx, &S->ty, dir);
+            S->t_steps++;
+            S->t_dir_count[dir]++;
+            if (S->tx == 0 && S->ty == 0) S->main_done = 1;
+        }
+
+        if (!S->comp_done) {
+            int dir = (S->vr_scheme == RW_VR_ANTITHETIC)
+                ? dir_from_u(RW_PROB_SCALE - 1u - r, S->p_up, S->p_down, S->p_left, S->p_right)
+                : dir_from_u(r, q, q, q, q);
+            step_wrap(S->w, S->h, &S->cx, &S->cy, dir);
+            S->c_steps++;
+            if (S->cx == 0 && S->cy == 0) S->comp_done = 1;
+        }
+    }
+
+    if (S->main_done && S->comp_done) finish_pair_advance(S);
+    return n;
+}
+
+//Stores a finished walk's hit time in the reservoir of its starting cell, replacing the oldest sample once full.
+static void tail_record(rw_sim_t *S, uint32_t steps_to_hit) {
+    uint32_t i = idx(S->cur_cell_x, S->cur_cell_y);
+    S->tail_res[i][S->tail_next[i]] = steps_to_hit;
+    S->tail_next[i] = (S->tail_next[i] + 1) % S->tail_cap;
+    if (S->tail_fill[i] < S->tail_cap) S->tail_fill[i]++;
+}
+
+//Finishes the walk early if the cell it just entered has a full reservoir: the remaining steps are one stored
+//hit time of that cell, picked with the simulation's RNG so seeded runs stay reproducible. Returns 1 if it did.
+static int tail_try_finish(rw_sim_t *S) {
+    uint32_t c = idx((uint32_t)S->tx, (uint32_t)S->ty);
+    if (S->tail_fill[c] < S->tail_cap) return 0;
+
+    uint32_t tail = S->tail_res[c][(uint32_t)rand_r(&S->rng_seed) % S->tail_cap];
+    uint32_t total = (tail > UINT32_MAX - S->t_steps) ? UINT32_MAX : S->t_steps + tail;
+    S->tail_memo_finishes++;
+    tail_record(S, total);
+    finish_traj_advance(S, total, (total <= S->K) ? 1 : 0);
+    return 1;
+}
+
+//Advances the statistics by at most budget steps, stopping early when the current trajectory reaches the center [0,0].
+//Returns the number of steps taken.
+static uint32_t sim_do_steps(rw_sim_t *S, uint32_t budget) {
+    if (S->engine != RW_ENGINE_MONTE_CARLO) return 0;
+    if (S->rep_done >= S->rep_total) return 0;
+
+    if (S->split_active) return split_do_steps(S, budget);
+    if (S->vr_scheme != RW_VR_NONE) return sim_do_steps_paired(S, budget);
+
+    if (!S->traj_active) start_traj(S);
+
+    // if already at [0,0]
+    if (S->tx == 0 && S->ty == 0) {
+        finish_traj_advance(S, 0, 1);
+        return 0;
+    }
+
+    for (uint32_t n = 0; n < budget; n++) {
+        int dir = pick_dir(S->p_up, S->p_down, S->p_left, S->p_right, &S->rng_seed);
+        step_wrap(S->w, S->h, &S->tx, &S->ty, dir);
+        S->t_steps++;
+        S->t_dir_count[dir]++;
+        S->walk_steps++;
+
+        if (S->tx == 0 && S->ty == 0) {
+            int hitK = (S->t_steps <= S->K) ? 1 : 0;
+            if (S->tail_cap > 0) tail_record(S, S->t_steps);
+            finish_traj_advance(S, S->t_steps, hitK);
+            return n + 1;
+        }
+        if (S->tail_cap > 0 && tail_try_finish(S)) return n + 1;
+    }
+    return budget;
+}
+
+uint64_t rw_sim_run(rw_sim_t *S, uint64_t max_steps) {
+    uint64_t used = 0;
+    if (S->engine != RW_ENGINE_MONTE_CARLO) return 0;
+    while (used < max_steps && S->rep_done < S->rep_total) {
+        uint64_t left = max_steps - used;
+        uint32_t n = sim_do_steps(S, left > UINT32_MAX ? UINT32_MAX : (uint32_t)left);
+        used += n ? n : 1;   // walks that start on [0,0] take no step but must not stall the loop
+    }
+    if (used > 0) S->version++;
+    return used;
+}
+
+//The display walker scans the starting cells like the statistics do and records its path for the STATE messages.
+void rw_sim_display_step(rw_sim_t *S) {
+    if (S->engine != RW_ENGINE_MONTE_CARLO) return;
+    if (!S->disp_active) {
+        S->disp_x = (int)S->disp_cell_x;
+        S->disp_y = (int)S->disp_cell_y;
+        S->disp_active = 1;
+        S->path_len = 0;
+        S->path_x[S->path_len] = (int16_t)S->disp_x;
+        S->path_y[S->path_len] = (int16_t)S->disp_y;
+        S->path_len++;
+    }
+
+    if (S->disp_x != 0 || S->disp_y != 0) {
+        int dir = pick_dir(S->p_up, S->p_down, S->p_left, S->p_right, &S->disp_rng);
+        step_wrap(S->w, S->h, &S->disp_x, &S->disp_y, dir);
+        if (S->path_len < RW_MAX_PATH) {
+            S->path_x[S->path_len] = (int16_t)S->disp_x;
+            S->path_y[S->path_len] = (int16_t)S->disp_y;
+            S->path_len++;
+        }
+    }
+
+    if (S->disp_x == 0 && S->disp_y == 0) {
+        // the finished path stays visible until the next tick starts a walk from the next cell
+        S->disp_active = 0;
+        if (++S->disp_cell_x >= S->w) {
+            S->disp_cell_x = 0;
+            if (++S->disp_cell_y >= S->h) S->disp_cell_y = 0;
+        }
+    }
+    S->version++;
+}
+
+// Per-row conversions of the snapshot values. They avoid the 64-bit integer division per cell and have no branches,
+// so the compiler can vectorize them. A double quotient of integers below 2^52 truncates to the same value as the
+// integer division: if the quotient is not an integer, it stays at least 1/b below the next one, which is more than
+// the rounding error.
+#define SNAPSHOT_EXACT_LIMIT (1ULL << 52)
+
+//AVG_STEPS row: floor(steps_sum / samples) * 1000, wrapping to 32 bits like the integer formula.
+static void row_avg_steps(const uint64_t *restrict sum, const uint32_t *restrict n, uint32_t *restrict out, uint32_t w) {
+    for (uint32_t x = 0; x < w; x++) {
+        uint64_t avg = (uint64_t)((double)sum[x] / (double)n[x]);
+        out[x] = (uint32_t)(avg * 1000ULL);
+    }
+    // sums beyond 2^52 steps (weeks of simulation) take the exact integer path
+    for (uint32_t x = 0; x < w; x++) {
+        if (sum[x] >= SNAPSHOT_EXACT_LIMIT) out[x] = (uint32_t)(sum[x] / n[x] * 1000ULL);
+    }
+}
+
+//PROB_K row: floor(hit_k_count * RW_PROB_SCALE / samples); the numerator stays below 2^32 * 10^6 < 2^52.
+static void row_prob_k(const uint32_t *restrict hits, const uint32_t *restrict n, uint32_t *restrict out, uint32_t w) {
+    for (uint32_t x = 0; x < w; x++) {
+        out[x] = (uint32_t)((double)hits[x] * (double)RW_PROB_SCALE / (double)n[x]);
+    }
+}
+
+// Builds a RW_MSG_STATE snapshot: progress, finished flag, optional display path (interactive mode),
+// and the per-cell values depending on the chosen view (average steps vs probability of reaching center within K).
+// Obstacles are all zero for now, and cells outside w x h stay zero.
+void rw_sim_snapshot(const rw_sim_t *S, rw_local_view_t view, int with_path, rw_state_msg_t *st) {
+    memset(st, 0, sizeof(*st));
+
+    st->w = S->w;
+    st->h = S->h;
+    st->rep_done = S->rep_done;
+    st->rep_total = S->rep_total;
+    st->finished = (S->rep_done >= S->rep_total) ? 1u : 0u;
+
+    // interactive path is the display walker's, same for everyone
+    if (with_path) {
+        st->path_len = S->path_len;
+        memcpy(st->path_x, S->path_x, S->path_len * sizeof(S->path_x[0]));
+        memcpy(st->path_y, S->path_y, S->path_len * sizeof(S->path_y[0]));
+    }
+
+    if (S->rep_done == 0) return;   // nothing yet
+
+    for (uint32_t y = 0; y < st->h; y++) {
+        uint32_t row = idx(0, y);
+        uint32_t *out = &st->cell_value[row];
+        if (S->engine == RW_ENGINE_SPECTRAL) {
+            // exact AVG_STEPS only; PROB_K is not available from the spectral engine
+            if (view != RW_VIEW_AVG_STEPS) continue;
+            for (uint32_t x = 0; x < st->w; x++) {
+                double v = S->exact_avg[row + x] * 1000.0;
+                out[x] = (v < 4294967295.0) ? (uint32_t)(v + 0.5) : UINT32_MAX;
+            }
+        } else if (view == RW_VIEW_AVG_STEPS) {
+            row_avg_steps(&S->steps_sum[row], &S->samples[row], out, st->w);
+        } else if (S->split_factor > 0) {
+            // rare-event mode: weighted splitting estimate
+            for (uint32_t x = 0; x < st->w; x++) {
+                uint32_t i = row + x;
+                double p = (S->split_n[i] > 0) ? S->split_sum_y[i] / S->split_n[i] : 0.0;
+                out[x] = (uint32_t)(p * RW_PROB_SCALE + 0.5);
+            }
+        } else {
+            row_prob_k(&S->hit_k_count[row], &S->samples[row], out, st->w);
+        }
+    }
+}
+
+// Two-sided 95% normal quantile, for the confidence intervals of rw_sim_cell_stats.
+#define CELL_CI_Z 1.959963984540054
+
+//Converts a non-negative estimate to a fixed-point wire value (scale units per 1), saturating at max.
+static uint64_t cell_fixed(double v, double scale, uint64_t max) {
+    double f = v * scale + 0.5;
+    if (!(f > 0.0)) return 0;
+    return (f >= (double)max) ? max : (uint64_t)f;
+}
+
+void rw_sim_cell_stats(const rw_sim_t *S, uint32_t x, uint32_t y, rw_cell_stats_t *out) {
+    memset(out, 0, sizeof(*out));
+    out->x = (uint16_t)x;
+    out->y = (uint16_t)y;
+    const uint32_t i = idx(x, y);
+    const double z = CELL_CI_Z;
+
+    if (S->engine == RW_ENGINE_SPECTRAL) {
+        uint64_t v = cell_fixed(S->exact_avg[i], 1000.0, UINT64_MAX);
+        out->avg_steps = out->avg_lo = out->avg_hi = v;
+        out->flags = RW_CELL_EXACT;
+        return;
+    }
+    const uint32_t n = S->samples[i];
+    out->samples = n;
+    out->steps_sum = S->steps_sum[i];
+    out->hit_k_count = S->hit_k_count[i];
+    if (n == 0) {
+        out->flags = RW_CELL_NO_SPREAD;
+        return;
+    }
+
+    // mean: the spread of the walks simulated here stands for all of them (cached ones have the same distribution)
+    const double mean = (double)S->steps_sum[i] / n;
+    out->avg_steps = cell_fixed(mean, 1000.0, UINT64_MAX);
+    const uint32_t m = S->var_n[i];
+    if (m >= 2) {
+        double mm = S->var_sum[i] / m;
+        double s2 = (S->var_sum2[i] - m * mm * mm) / (m - 1);
+        double half = z * sqrt((s2 > 0.0 ? s2 : 0.0) / n);
+        out->avg_lo = cell_fixed(mean - half, 1000.0, UINT64_MAX);
+        out->avg_hi = cell_fixed(mean + half, 1000.0, UINT64_MAX);
+    } else {
+        out->flags |= RW_CELL_NO_SPREAD;
+    }
+
+    double p, lo, hi;
+    if (S->split_factor > 0 && S->split_n[i] > 0) {
+        // rare-event mode: the splitting estimate with the variance of its per-tree weights
+        uint32_t t = S->split_n[i];
+        p = S->split_sum_y[i] / t;
+        double s2 = (t > 1) ? (S->split_sum_y2[i] - t * p * p) / (t - 1) : 0.0;
+        double half = z * sqrt((s2 > 0.0 ? s2 : 0.0) / t);
+        lo = p - half;
+        hi = p + half;
+    } else {
+        // Wilson score interval: stays inside [0, 1] and is not empty at 0 or n hits
+        p = (double)S->hit_k_count[i] / n;
+        double z2n = z * z / n;
+        double centre = (p + z2n / 2.0) / (1.0 + z2n);
+        double half = z * sqrt(p * (1.0 - p) / n + z2n / (4.0 * n)) / (1.0 + z2n);
+        lo = centre - half;
+        hi = centre + half;
+    }
+    out->prob_k = (uint32_t)cell_fixed(p, RW_PROB_SCALE, RW_PROB_SCALE);
+    out->prob_lo = (uint32_t)cell_fixed(lo, RW_PROB_SCALE, RW_PROB_SCALE);
+    out->prob_hi = (uint32_t)cell_fixed(hi, RW_PROB_SCALE, RW_PROB_SCALE);
+}
+
+// Above this variance ratio the scheme removed practically all noise (e.g. a control variate equal to the walk).
+#define VR_FACTOR_MAX 1e9
+
+//Computes the variance-reduction statistics of one cell. factor is the ratio of the plain estimator's variance
+//to the scheme's variance for the same number of walks (i.e. the step savings at equal confidence interval);
+//est is the scheme's AVG_STEPS estimate. Returns 0 if the cell does not have enough pairs yet.
+static int vr_cell_stats(const rw_sim_t *S, uint32_t i, double *factor, double *est) {
+    uint32_t n = S->vr_n[i];
+    if (n < 2) return 0;
+
+    double ma = S->vr_sum_a[i] / n, mb = S->vr_sum_b[i] / n;
+    double var_a = (S->vr_sum_a2[i] - n * ma * ma) / (n - 1);
+    double var_b = (S->vr_sum_b2[i] - n * mb * mb) / (n - 1);
+    double cov = (S->vr_sum_ab[i] - n * ma * mb) / (n - 1);
+    if (var_a <= 0.0) return 0;
+
+    double f;
+    if (S->vr_scheme == RW_VR_ANTITHETIC) {
+        // plain: 2 independent walks, variance var/2; pair mean: (var_a + var_b + 2 cov) / 4
+        double var_pair = (var_a + var_b + 2.0 * cov) / 4.0;
+        double var_plain = (var_a + var_b) / 4.0;
+        f = (var_pair > var_plain / VR_FACTOR_MAX) ? var_plain / var_pair : VR_FACTOR_MAX;
+        *est = (ma + mb) / 2.0;
+    } else {
+        // control variate with the estimated optimal coefficient beta = cov / var_b
+        double beta = (var_b > 0.0) ? cov / var_b : 0.0;
+        double var_cv = var_a - beta * cov;
+        f = (var_cv > var_a / VR_FACTOR_MAX) ? var_a / var_cv : VR_FACTOR_MAX;
+        *est = ma - beta * (mb - S->exact_avg[i]);
+    }
+    *factor = f;
+    return 1;
+}
+
+//Formats the results-file header lines naming the variance-reduction scheme and the reduction it achieved.
+static void vr_summary_header(const rw_sim_t *S, char *out, size_t out_size) {
+    double fmin = 0.0, fsum = 0.0;
+    uint32_t n = 0;
+    for (uint32_t y = 0; y < S->h; y++) {
+        for (uint32_t x = 0; x < S->w; x++) {
+            double f, est;
+            if (!vr_cell_stats(S, idx(x, y), &f, &est)) continue;
+            if (n == 0 || f < fmin) fmin = f;
+            fsum += f;
+            n++;
+        }
+    }
+    snprintf(out, out_size,
+             "# Variance reduction: scheme=%s cells=%u variance_factor_mean=%.3g variance_factor_min=%.3g\n"
+             "# (variance_factor = plain variance / scheme variance at equal walks; see [VR_FACTOR])\n",
+             S->vr_scheme == RW_VR_ANTITHETIC ? "antithetic" : "control_variate",
+             n, n ? fsum / n : 0.0, fmin);
+}
+
+//Appends the per-cell variance-reduction factor and, for the control variate, the corrected AVG_STEPS estimate.
+static int append_vr_results(const rw_sim_t *S, const char *path) {
+    FILE *f = fopen(path, "a");
+    if (!f) return -1;
+
+    fprintf(f, "\n[VR_FACTOR]\n");
+    for (uint32_t y = 0; y < S->h; y++) {
+        for (uint32_t x = 0; x < S->w; x++) {
+            double fac, est;
+            if (vr_cell_stats(S, idx(x, y), &fac, &est)) fprintf(f, "%.3g", fac);
+            else fprintf(f, "-");
+            fprintf(f, "%s", (x + 1 == S->w) ? "" : " ");
+        }
+        fprintf(f, "\n");
+    }
+
+    if (S->vr_scheme == RW_VR_CONTROL_VARIATE) {
+        fprintf(f, "\n[AVG_STEPS_CV]\n");
+        for (uint32_t y = 0; y < S->h; y++) {
+            for (uint32_t x = 0; x < S->w; x++) {
+                uint32_t i = idx(x, y);
+                double fac, est = 0.0;
+                if (!vr_cell_stats(S, i, &fac, &est) && S->samples[i] > 0) {
+                    est = (double)S->steps_sum[i] / S->samples[i];
+                }
+                fprintf(f, "%.3f%s", est, (x + 1 == S->w) ? "" : " ");
+            }
+            fprintf(f, "\n");
+        }
+    }
+
+    if (fclose(f) != 0) return -1;
+    return 0;
+}
+
+//Appends one section per sweep vector to the results file: self-normalized importance-sampling estimates
+//of AVG_STEPS and PROB_K, and the effective sample size (sum W)^2 / sum W^2 per cell.
+static int append_sweep_results(const rw_sim_t *S, const char *path) {
+    FILE *f = fopen(path, "a");
+    if (!f) return -1;
+
+    static const char *dir_name[4] = { "p_up", "p_down", "p_left", "p_right" };
+    for (uint32_t v = 0; v < S->sweep_count; v++) {
+        double ess_min = INFINITY, ess_sum = 0.0;
+        for (uint32_t y = 0; y < S->h; y++) {
+            for (uint32_t x = 0; x < S->w; x++) {
+                const sweep_acc_t *a = &S->sweep_acc[v][idx(x, y)];
+                double ess = (a->sum_w2 > 0.0) ? a->sum_w * a->sum_w / a->sum_w2 : 0.0;
+                if (ess < ess_min) ess_min = ess;
+                ess_sum += ess;
+            }
+        }
+
+        fprintf(f, "\n[SWEEP %u]\n# proposal p_up=%u p_down=%u p_left=%u p_right=%u\n# target  ",
+                v, S->p_up, S->p_down, S->p_left, S->p_right);
+        for (int d = 0; d < 4; d++) fprintf(f, "%s=%u%s", dir_name[d], S->sweep_p[v][d], d == 3 ? "\n" : " ");
+        fprintf(f, "# ess_min=%.1f ess_mean=%.1f (of %u samples per cell)\n",
+                ess_min, ess_sum / ((double)S->w * S->h), S->rep_done);
+
+        fprintf(f, "[SWEEP %u AVG_STEPS]\n", v);
+        for (uint32_t y = 0; y < S->h; y++) {
+            for (uint32_t x = 0; x < S->w; x++) {
+                const sweep_acc_t *a = &S->sweep_acc[v][idx(x, y)];
+                double avg = (a->sum_w > 0.0) ? a->sum_wt / a->sum_w : 0.0;
+                fprintf(f, "%.3f%s", avg, (x + 1 == S->w) ? "" : " ");
+            }
+            fprintf(f, "\n");
+        }
+
+        fprintf(f, "[SWEEP %u PROB_K]\n", v);
+        for (uint32_t y = 0; y < S->h; y++) {
+            for (uint32_t x = 0; x < S->w; x++) {
+                const sweep_acc_t *a = &S->sweep_acc[v][idx(x, y)];
+                double p = (a->sum_w > 0.0) ? a->sum_wk / a->sum_w : 0.0;
+                fprintf(f, "%.6f%s", p, (x + 1 == S->w) ? "" : " ");
+            }
+            fprintf(f, "\n");
+        }
+
+        fprintf(f, "[SWEEP %u ESS]\n", v);
+        for (uint32_t y = 0; y < S->h; y++) {
+            for (uint32_t x = 0; x < S->w; x++) {
+                const sweep_acc_t *a = &S->sweep_acc[v][idx(x, y)];
+                double ess = (a->sum_w2 > 0.0) ? a->sum_w * a->sum_w / a->sum_w2 : 0.0;
+                fprintf(f, "%.1f%s", ess, (x + 1 == S->w) ? "" : " ");
+            }
+            fprintf(f, "\n");
+        }
+    }
+
+    if (fclose(f) != 0) return -1;
+    return 0;
+}
+
+//Appends the multilevel-splitting PROB_K estimate per cell and the variance of that estimate
+//(sample variance of the per-tree weights divided by the number of trees).
+static int append_split_results(const rw_sim_t *S, const char *path) {
+    FILE *f = fopen(path, "a");
+    if (!f) return -1;
+
+    fprintf(f, "\n# Multilevel splitting: factor=%u level_step=%u splitting_steps=%" PRIu64 "\n",
+            S->split_factor, S->split_level_step, S->split_steps);
+
+    fprintf(f, "[PROB_K_SPLIT]\n");
+    for (uint32_t y = 0; y < S->h; y++) {
+        for (uint32_t x = 0; x < S->w; x++) {
+            uint32_t i = idx(x, y);
+            double p = (S->split_n[i] > 0) ? S->split_sum_y[i] / S->split_n[i] : 0.0;
+            fprintf(f, "%.6e%s", p, (x + 1 == S->w) ? "" : " ");
+        }
+        fprintf(f, "\n");
+    }
+
+    fprintf(f, "\n[PROB_K_SPLIT_VAR]\n");
+    for (uint32_t y = 0; y < S->h; y++) {
+        for (uint32_t x = 0; x < S->w; x++) {
+            uint32_t i = idx(x, y);
+            double var = 0.0;
+            uint32_t n = S->split_n[i];
+            if (n > 1) {
+                double mean = S->split_sum_y[i] / n;
+                double s2 = (S->split_sum_y2[i] - n * mean * mean) / (n - 1);
+                var = (s2 > 0.0) ? s2 / n : 0.0;
+            }
+            fprintf(f, "%.6e%s", var, (x + 1 == S->w) ? "" : " ");
+        }
+        fprintf(f, "\n");
+    }
+
+    if (fclose(f) != 0) return -1;
+    return 0;
+}
+
+//Writes the final results: a raw shard if the name ends in .shard (mergeable with rw_merge), otherwise the text
+//tables of average steps and probability-to-hit-within-K per cell plus the sections of the enabled estimators.
+int rw_sim_export(rw_sim_t *S, const char *path) {
+    rw_sim_key_t key = sim_key(S);
+    rw_accum_ref_t acc = sim_accum(S);
+    int rc;
+    if (rw_path_is_shard(path)) {
+        // a shard only carries the plain accumulators; rw_sim_validate keeps such runs away from shards
+        if (S->engine != RW_ENGINE_MONTE_CARLO || S->sweep_count > 0 || S->split_factor > 0 || S->tail_cap > 0) {
+            errno = EINVAL;
+            return -1;
+        }
+        key.seed = S->seed_used;
+        return rw_shard_write(path, &key, S->rep_done, &S->seed_used, 1, &acc);
+    }
+
+    if (S->engine == RW_ENGINE_SPECTRAL) {
+        rc = rw_results_write_exact(path, &key, S->exact_avg, RW_MAX_W);
+    } else {
+        char extra_header[256];
+        extra_header[0] = '\0';
+        if (S->vr_scheme != RW_VR_NONE) vr_summary_header(S, extra_header, sizeof(extra_header));
+        if (S->tail_cap > 0) {
+            snprintf(extra_header, sizeof(extra_header),
+                     "# Tail memo (approximate): reservoir=%u memo_finishes=%" PRIu64 " walked_steps=%" PRIu64 "\n",
+                     S->tail_cap, S->tail_memo_finishes, S->walk_steps);
+        }
+        rc = rw_results_write_text(path, &key, S->rep_done, S->rep_total, &acc, extra_header);
+        if (rc == 0 && S->vr_scheme != RW_VR_NONE) rc = append_vr_results(S, path);
+    }
+    if (rc < 0) return -1;
+    if (S->sweep_count > 0 && append_sweep_results(S, path) < 0) return -1;
+    if (S->split_factor > 0 && append_split_results(S, path) < 0) return -1;
+    return 0;
+}
+
+//Checks world bounds, probability sum, replication/K values, the initial mode, and that the estimator options
+//are supported by the engine and world and fit the output format.
+int rw_sim_validate(const rw_create_sim_req_t *r) {
+    if (r->w == 0 || r->h == 0) return 0;
+    if (r->w > RW_MAX_W || r->h > RW_MAX_H) return 0;
+    uint64_t sum = (uint64_t)r->p_up + r->p_down + r->p_left + r->p_right;
+    if (sum != RW_PROB_SCALE) return 0;
+    if (r->rep_total == 0 || r->K == 0) return 0;
+    if (r->initial_mode != RW_MODE_INTERACTIVE && r->initial_mode != RW_MODE_SUMMARY) return 0;
+    if (r->engine != RW_ENGINE_MONTE_CARLO && r->engine != RW_ENGINE_SPECTRAL) return 0;
+    // the closed form only exists for the obstacle-free torus, and there are no raw counts for a shard
+    if (r->engine == RW_ENGINE_SPECTRAL) {
+        if (r->world_type != RW_WORLD_WRAP) return 0;
+        if (rw_path_is_shard(r->out_file)) return 0;
+    }
+
+    // sweep vectors must be valid distributions that only use directions the proposal can produce
+    if (r->sweep_count > RW_MAX_SWEEP) return 0;
+    if (r->sweep_count > 0 && (r->engine != RW_ENGINE_MONTE_CARLO || rw_path_is_shard(r->out_file))) return 0;
+
+    if (r->vr_scheme != RW_VR_NONE && r->vr_scheme != RW_VR_ANTITHETIC && r->vr_scheme != RW_VR_CONTROL_VARIATE) return 0;
+    if (r->vr_scheme != RW_VR_NONE) {
+        if (r->engine != RW_ENGINE_MONTE_CARLO) return 0;
+        // the reference walk's mean is only known in closed form on the obstacle-free torus
+        if (r->vr_scheme == RW_VR_CONTROL_VARIATE && r->world_type != RW_WORLD_WRAP) return 0;
+        // sweep weights need the direction counts of every sample, the antithetic partner has none
+        if (r->vr_scheme == RW_VR_ANTITHETIC && r->sweep_count > 0) return 0;
+    }
+
+    // splitting results are appended to the text results file
+    if (r->split_factor > RW_MAX_SPLIT_FACTOR) return 0;
+    if (r->split_factor > 1) {
+        if (r->split_level_step == 0) return 0;
+        if (r->engine != RW_ENGINE_MONTE_CARLO || rw_path_is_shard(r->out_file)) return 0;
+    }
+
+    // tail memo replaces part of each walk, so nothing that needs the full trajectory combines with it,
+    // and its approximate counts must not be merged into exact shards
+    if (r->tail_reservoir > RW_MAX_TAIL_RESERVOIR) return 0;
+    if (r->tail_reservoir > 0) {
+        if (r->engine != RW_ENGINE_MONTE_CARLO || rw_path_is_shard(r->out_file)) return 0;
+        if (r->vr_scheme != RW_VR_NONE || r->sweep_count > 0 || r->split_factor > 1) return 0;
+    }
+    const uint32_t p[4] = { r->p_up, r->p_down, r->p_left, r->p_right };
+    for (uint32_t v = 0; v < r->sweep_count; v++) {
+        uint64_t vs = 0;
+        for (int d = 0; d < 4; d++) {
+            if (r->sweep_p[v][d] > 0 && p[d] == 0) return 0;
+            vs += r->sweep_p[v][d];
+        }
+        if (vs != RW_PROB_SCALE) return 0;
+    }
+    return 1;
+}
+
+int rw_sim_create(const rw_create_sim_req_t *req, rw_sim_t **out) {
+    *out = NULL;
+    if (!rw_sim_validate(req)) { errno = EINVAL; return -1; }
+
+    // the sweep and splitting accumulators make rw_sim_t a few MB: it lives on huge pages where available,
+    // first written by sim_init so the pages land on the NUMA node of the creating thread
+    rw_sim_t *S = rw_huge_alloc(sizeof(*S));
+    if (!S) { errno = ENOMEM; return -1; }
+    sim_init(S, req);
+
+    int rc = 0;
+    if (S->engine == RW_ENGINE_SPECTRAL) rc = sim_solve_exact(S);
+    else if (S->vr_scheme == RW_VR_CONTROL_VARIATE) rc = sim_init_control_variate(S);
+    if (rc < 0) {
+        int saved = errno;
+        rw_huge_free(S, sizeof(*S));
+        errno = saved;
+        return -1;
+    }
+    *out = S;
+    return 0;
+}
+
+void rw_sim_destroy(rw_sim_t *S) {
+    rw_huge_free(S, sizeof(*S));
+}
+
+//Returns 1 if the simulation only has the plain accumulators (steps_sum, samples, hit_k_count), which add up
+//across independent runs; the estimator options keep per-run state that does not.
+static int sim_plain(const rw_sim_t *S) {
+    return S->engine == RW_ENGINE_MONTE_CARLO && S->sweep_count == 0 && S->split_factor == 0 &&
+           S->tail_cap == 0 && S->vr_scheme == RW_VR_NONE;
+}
+
+int rw_sim_merge(rw_sim_t *dst, rw_sim_t *const *parts, uint32_t nparts) {
+    if (!sim_plain(dst)) { errno = EINVAL; return -1; }
+    for (uint32_t i = 0; i < nparts; i++) {
+        const rw_sim_t *P = parts[i];
+        if (!sim_plain(P) || P->w != dst->w || P->h != dst->h || P->K != dst->K ||
+            P->p_up != dst->p_up || P->p_down != dst->p_down || P->p_left != dst->p_left ||
+            P->p_right != dst->p_right || P->world_type != dst->world_type) {
+            errno = EINVAL;
+            return -1;
+        }
+    }
+
+    memset(dst->steps_sum, 0, sizeof(dst->steps_sum));
+    memset(dst->hit_k_count, 0, sizeof(dst->hit_k_count));
+    memset(dst->samples, 0, sizeof(dst->samples));
+    memset(dst->var_n, 0, sizeof(dst->var_n));
+    memset(dst->var_sum, 0, sizeof(dst->var_sum));
+    memset(dst->var_sum2, 0, sizeof(dst->var_sum2));
+    dst->rep_done = 0;
+    dst->rep_total = 0;
+    dst->walk_steps = 0;
+    for (uint32_t i = 0; i < nparts; i++) {
+        const rw_sim_t *P = parts[i];
+        for (uint32_t y = 0; y < dst->h; y++) {
+            for (uint32_t x = 0; x < dst->w; x++) {
+                uint32_t k = idx(x, y);
+                dst->steps_sum[k] += P->steps_sum[k];
+                dst->hit_k_count[k] += P->hit_k_count[k];
+                dst->samples[k] += P->samples[k];
+                dst->var_n[k] += P->var_n[k];
+                dst->var_sum[k] += P->var_sum[k];
+                dst->var_sum2[k] += P->var_sum2[k];
+            }
+        }
+        dst->rep_done += P->rep_done;
+        dst->rep_total += P->rep_total;
+        dst->walk_steps += P->walk_steps;
+    }
+    dst->merged_parts = nparts;
+    dst->version++;
+    return 0;
+}
+
+int rw_sim_extend(rw_sim_t *S, uint32_t extra_reps) {
+    if (S->engine != RW_ENGINE_MONTE_CARLO) { errno = ENOTSUP; return -1; }
+    // never below what is done
+    uint32_t base = (S->rep_done > S->rep_total) ? S->rep_done : S->rep_total;
+    if (extra_reps == 0 || extra_reps > UINT32_MAX - base) { errno = ERANGE; return -1; }
+    S->rep_total = base + extra_reps;
+    S->version++;
+    return 0;
+}
+
+void rw_sim_get_info(const rw_sim_t *S, rw_sim_info_t *out) {
+    memset(out, 0, sizeof(*out));
+    out->w = S->w; out->h = S->h; out->K = S->K;
+    out->rep_done = S->rep_done;
+    out->rep_total = S->rep_total;
+    out->world_type = S->world_type;
+    out->engine = S->engine;
+    out->seed_used = S->seed_used;
+    out->finished = S->rep_done >= S->rep_total;
+    out->walk_steps = S->walk_steps;
+    out->tail_memo_finishes = S->tail_memo_finishes;
+}
+
+uint64_t rw_sim_version(const rw_sim_t *S) {
+    return S->version;
+}
+
+rw_accum_ref_t rw_sim_accumulators(rw_sim_t *S) {
+    return sim_accum(S);
+}
@@ -0,0 +1,151 @@
+// src/engine/numa.c (NUMA topology, thread pinning and huge-page backed buffers)
+#define _GNU_SOURCE
+#include "engine/numa.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#define HUGE_PAGE_SIZE ((size_t)2 * 1024 * 1024)
+
+//Parses a sysfs id list such as "0-3,8,10-11" into set[0..max). Ids outside the range are ignored.
+static void parse_id_list(const char *s, unsigned char *set, long max) {
+    while (*s) {
+        char *end = NULL;
+        long a = strtol(s, &end, 10);
+        if (end == s) break;
+        long b = a;
+        s = end;
+        if (*s == '-') {
+            b = strtol(s + 1, &end, 10);
+            s = end;
+        }
+        for (long i = a < 0 ? 0 : a; i <= b && i < max; i++) set[i] = 1;
+        if (*s != ',') break;
+        s++;
+    }
+}
+
+//Reads a sysfs id list file into set. Returns 0 on success, -1 if the file cannot be read.
+static int read_id_list(const char *path, unsigned char *set, long max) {
+    FILE *f = fopen(path, "r");
+    if (!f) return -1;
+    char buf[4096];
+    if (!fgets(buf, sizeof(buf), f)) buf[0] = '\0';
+    fclose(f);
+    parse_id_list(buf, set, max);
+    return 0;
+}
+
+//Appends a node with those of its CPUs the process may use. Nodes without usable CPUs (memory-only) are skipped.
+static void add_node(rw_numa_topo_t *t, const unsigned char *cpus, const unsigned char *allowed) {
+    if (t->nnodes >= RW_NUMA_MAX_NODES) return;
+    uint32_t first = t->ncpus;
+    for (long c = 0; c < RW_NUMA_MAX_CPUS; c++) {
+        if (!cpus[c] || !allowed[c]) continue;
+        t->cpu[t->ncpus++] = (uint16_t)c;
+    }
+    if (t->ncpus == first) return;
+    t->node_first[t->nnodes] = first;
+    t->node_ncpus[t->nnodes] = t->ncpus - first;
+    t->nnodes++;
+}
+
+void rw_numa_detect(rw_numa_topo_t *t) {
+    memset(t, 0, sizeof(*t));
+
+    // CPUs of the affinity mask (taskset, cgroups); CPU 0 alone if it cannot be read
+    unsigned char allowed[RW_NUMA_MAX_CPUS];
+    memset(allowed, 0, sizeof(allowed));
+    cpu_set_t mask;
+    CPU_ZERO(&mask);
+    if (sched_getaffinity(0, sizeof(mask), &mask) == 0) {
+        for (int c = 0; c < RW_NUMA_MAX_CPUS && c < CPU_SETSIZE; c++) allowed[c] = CPU_ISSET(c, &mask) ? 1 : 0;
+    } else {
+        allowed[0] = 1;
+    }
+
+    unsigned char nodes[RW_NUMA_MAX_CPUS];
+    unsigned char cpus[RW_NUMA_MAX_CPUS];
+    memset(nodes, 0, sizeof(nodes));
+    if (read_id_list("/sys/devices/system/node/online", nodes, RW_NUMA_MAX_CPUS) == 0) {
+        for (long n = 0; n < RW_NUMA_MAX_CPUS; n++) {
+            if (!nodes[n]) continue;
+            char path[64];
+            snprintf(path, sizeof(path), "/sys/devices/system/node/node%ld/cpulist", n);
+            memset(cpus, 0, sizeof(cpus));
+            if (read_id_list(path, cpus, RW_NUMA_MAX_CPUS) == 0) add_node(t, cpus, allowed);
+        }
+    }
+
+    // no NUMA information (or none of it usable): all usable CPUs form one node
+    if (t->ncpus == 0) {
+        memset(t, 0, sizeof(*t));
+        memset(cpus, 1, sizeof(cpus));
+        add_node(t, cpus, allowed);
+    }
+    if (t->ncpus == 0) {
+        t->nnodes = 1;
+        t->ncpus = 1;
+        t->node_ncpus[0] = 1;
+    }
+}
+
+int rw_numa_cpu_for_thread(const rw_numa_topo_t *t, uint32_t i) {
+    uint32_t node = i % t->nnodes;
+    uint32_t k = (i / t->nnodes) % t->node_ncpus[node];
+    return t->cpu[t->node_first[node] + k];
+}
+
+uint32_t rw_numa_node_of_cpu(const rw_numa_topo_t *t, int cpu) {
+    for (uint32_t n = 0; n < t->nnodes; n++)
+        for (uint32_t k = 0; k < t->node_ncpus[n]; k++)
+            if (t->cpu[t->node_first[n] + k] == cpu) return n;
+    return 0;
+}
+
+int rw_numa_pin_self(int cpu) {
+    if (cpu < 0 || cpu >= CPU_SETSIZE) { errno = EINVAL; return -1; }
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    int rc = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (rc != 0) { errno = rc; return -1; }
+    return 0;
+}
+
+//Large buffers are mapped with one extra huge page and trimmed to a 2 MB boundary, so that every full 2 MB
+//of the buffer can be backed by a huge page; the advice is ignored where transparent huge pages are off.
+void *rw_huge_alloc(size_t size) {
+    if (size == 0) size = 1;
+    if (size < HUGE_PAGE_SIZE) {
+        void *p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED) { errno = ENOMEM; return NULL; }
+        return p;
+    }
+
+    size_t len = (size + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+    unsigned char *raw = mmap(NULL, len + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (raw == MAP_FAILED) { errno = ENOMEM; return NULL; }
+    uintptr_t a = ((uintptr_t)raw + HUGE_PAGE_SIZE - 1) & ~(uintptr_t)(HUGE_PAGE_SIZE - 1);
+    unsigned char *p = (unsigned char *)a;
+    size_t head = (size_t)(p - raw);
+    if (head) munmap(raw, head);
+    if (HUGE_PAGE_SIZE - head) munmap(p + len, HUGE_PAGE_SIZE - head);
+#ifdef MADV_HUGEPAGE
+    (void)madvise(p, len, MADV_HUGEPAGE);
+#endif
+    return p;
+}
+
+void rw_huge_free(void *p, size_t size) {
+    if (!p) return;
+    if (size == 0) size = 1;
+    if (size >= HUGE_PAGE_SIZE) size = (size + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+    munmap(p, size);
+}
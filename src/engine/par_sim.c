@@ -0,0 +1,199 @@
+// src/engine/par_sim.c (one simulation split into per-thread accumulator shards)
+#include "engine/par_sim.h"
+#include "common/results_io.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+
+// One worker thread and the shard it owns.
+typedef struct {
+    rw_par_sim_t *P;
+    int cpu;                   // -1 = not pinned
+    rw_create_sim_req_t req;   // the shard's seed and share of the replications
+    rw_sim_t *sim;             // created by the worker itself (first touch on its node)
+    int create_errno;          // 0, or why the shard could not be created
+    uint64_t budget;           // steps for the current round
+    uint64_t steps;            // steps taken in the last round
+    pthread_t tid;
+} par_worker_t;
+
+struct rw_par_sim {
+    uint32_t n;
+    uint32_t started;          // worker threads that were created
+    par_worker_t *workers;
+    rw_sim_t **parts;          // workers[i].sim, for rw_sim_merge
+    rw_sim_t *merged;
+
+    // rounds: the caller bumps round and waits until pending drops to 0
+    pthread_mutex_t lock;
+    pthread_cond_t go, done;
+    uint64_t round;
+    uint32_t pending;
+    int quit;
+};
+
+int rw_par_sim_supported(const rw_create_sim_req_t *r) {
+    if (!rw_sim_validate(r)) return 0;
+    if (r->engine != RW_ENGINE_MONTE_CARLO || r->vr_scheme != RW_VR_NONE) return 0;
+    if (r->sweep_count > 0 || r->split_factor > 1 || r->tail_reservoir > 0) return 0;
+    // a shard file records a single seed; the merged text results carry no seed list
+    return !rw_path_is_shard(r->out_file);
+}
+
+//Worker thread: pins itself, creates its shard, reports back, then runs one step budget per round until told to quit.
+static void *worker_main(void *arg) {
+    par_worker_t *W = arg;
+    rw_par_sim_t *P = W->P;
+
+    // pinning is best effort: a refused affinity only costs locality
+    if (W->cpu >= 0) (void)rw_numa_pin_self(W->cpu);
+    if (rw_sim_create(&W->req, &W->sim) < 0) W->create_errno = errno;
+
+    uint64_t seen = 0;
+    pthread_mutex_lock(&P->lock);
+    for (;;) {
+        if (--P->pending == 0) pthread_cond_signal(&P->done);
+        while (P->round == seen && !P->quit) pthread_cond_wait(&P->go, &P->lock);
+        if (P->quit) break;
+        seen = P->round;
+        uint64_t budget = W->budget;
+        pthread_mutex_unlock(&P->lock);
+
+        W->steps = W->sim ? rw_sim_run(W->sim, budget) : 0;
+
+        pthread_mutex_lock(&P->lock);
+    }
+    pthread_mutex_unlock(&P->lock);
+    return NULL;
+}
+
+void rw_par_sim_destroy(rw_par_sim_t *P) {
+    if (!P) return;
+    pthread_mutex_lock(&P->lock);
+    P->quit = 1;
+    pthread_cond_broadcast(&P->go);
+    pthread_mutex_unlock(&P->lock);
+    for (uint32_t i = 0; i < P->started; i++) pthread_join(P->workers[i].tid, NULL);
+    for (uint32_t i = 0; i < P->n; i++) rw_sim_destroy(P->workers[i].sim);
+    rw_sim_destroy(P->merged);
+    pthread_cond_destroy(&P->go);
+    pthread_cond_destroy(&P->done);
+    pthread_mutex_destroy(&P->lock);
+    free(P->parts);
+    free(P->workers);
+    free(P);
+}
+
+int rw_par_sim_create(const rw_create_sim_req_t *req, uint32_t nthreads, const rw_numa_topo_t *topo, rw_par_sim_t **out) {
+    *out = NULL;
+    if (!rw_par_sim_supported(req)) { errno = EINVAL; return -1; }
+    if (nthreads == 0) nthreads = 1;
+    if (nthreads > req->rep_total) nthreads = req->rep_total;
+
+    rw_par_sim_t *P = calloc(1, sizeof(*P));
+    if (!P) { errno = ENOMEM; return -1; }
+    pthread_mutex_init(&P->lock, NULL);
+    pthread_cond_init(&P->go, NULL);
+    pthread_cond_init(&P->done, NULL);
+    P->workers = calloc(nthreads, sizeof(*P->workers));
+    P->parts = calloc(nthreads, sizeof(*P->parts));
+    if (!P->workers || !P->parts || rw_sim_create(req, &P->merged) < 0) {
+        rw_par_sim_destroy(P);
+        errno = ENOMEM;
+        return -1;
+    }
+    P->n = nthreads;
+
+    uint32_t base = req->seed ? req->seed : ((uint32_t)time(NULL) ^ (uint32_t)getpid());
+    for (uint32_t i = 0; i < nthreads; i++) {
+        par_worker_t *W = &P->workers[i];
+        W->P = P;
+        W->cpu = topo ? rw_numa_cpu_for_thread(topo, i) : -1;
+        W->req = *req;
+        W->req.rep_total = req->rep_total / nthreads + (i < req->rep_total % nthreads ? 1u : 0u);
+        W->req.seed = base + i * 0x9e3779b9u;
+        if (W->req.seed == 0) W->req.seed = 1;   // 0 would mean "pick a random seed"
+    }
+
+    // start the workers and wait until every shard exists (or failed)
+    int err = 0;
+    pthread_mutex_lock(&P->lock);
+    P->pending = nthreads;
+    for (uint32_t i = 0; i < nthreads; i++) {
+        int rc = pthread_create(&P->workers[i].tid, NULL, worker_main, &P->workers[i]);
+        if (rc != 0) {
+            err = rc;
+            P->pending -= nthreads - i;
+            break;
+        }
+        P->started++;
+    }
+    while (P->pending > 0) pthread_cond_wait(&P->done, &P->lock);
+    pthread_mutex_unlock(&P->lock);
+
+    for (uint32_t i = 0; i < P->started && !err; i++) err = P->workers[i].create_errno;
+    if (err) {
+        rw_par_sim_destroy(P);
+        errno = err;
+        return -1;
+    }
+    for (uint32_t i = 0; i < nthreads; i++) P->parts[i] = P->workers[i].sim;
+    (void)rw_sim_merge(P->merged, P->parts, P->n);
+    *out = P;
+    return 0;
+}
+
+uint32_t rw_par_sim_threads(const rw_par_sim_t *P) {
+    return P->n;
+}
+
+int rw_par_sim_cpu(const rw_par_sim_t *P, uint32_t i) {
+    return i < P->n ? P->workers[i].cpu : -1;
+}
+
+uint64_t rw_par_sim_run(rw_par_sim_t *P, uint64_t max_steps) {
+    uint64_t per = max_steps / P->n;
+    if (per == 0) per = 1;
+
+    pthread_mutex_lock(&P->lock);
+    for (uint32_t i = 0; i < P->n; i++) {
+        P->workers[i].budget = per;
+        P->workers[i].steps = 0;
+    }
+    P->pending = P->n;
+    P->round++;
+    pthread_cond_broadcast(&P->go);
+    while (P->pending > 0) pthread_cond_wait(&P->done, &P->lock);
+    pthread_mutex_unlock(&P->lock);
+
+    uint64_t steps = 0;
+    for (uint32_t i = 0; i < P->n; i++) steps += P->workers[i].steps;
+    return steps;
+}
+
+int rw_par_sim_extend(rw_par_sim_t *P, uint32_t extra_reps) {
+    // the merged count must stay representable, so check the total before touching any shard
+    uint64_t total = 0;
+    for (uint32_t i = 0; i < P->n; i++) {
+        rw_sim_info_t si;
+        rw_sim_get_info(P->parts[i], &si);
+        total += si.rep_done > si.rep_total ? si.rep_done : si.rep_total;
+    }
+    if (extra_reps == 0 || total + extra_reps > UINT32_MAX) { errno = ERANGE; return -1; }
+
+    for (uint32_t i = 0; i < P->n; i++) {
+        uint32_t share = extra_reps / P->n + (i < extra_reps % P->n ? 1u : 0u);
+        if (share > 0 && rw_sim_extend(P->parts[i], share) < 0) return -1;
+    }
+    return 0;
+}
+
+rw_sim_t *rw_par_sim_merged(rw_par_sim_t *P) {
+    // cannot fail: every shard was created from the same supported request
+    (void)rw_sim_merge(P->merged, P->parts, P->n);
+    return P->merged;
+}